@@ -16,8 +16,10 @@
 #include "public_settings.h"
 #include "logging/logging.h"
 #include "kangaroo_twelve.h"
+#include "merkle_tree_builder.h"
 #include "four_q.h"
 #include "common_buffers.h"
+#include "state_snapshot.h"
 
 
 // CAUTION: Currently, there is no locking of universeLock if contracts use the QPI asset iteration classes directly.
@@ -34,6 +36,7 @@ GLOBAL_VAR_DECL AssetRecord* assets GLOBAL_VAR_INIT(nullptr);
 GLOBAL_VAR_DECL m256i* assetDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long assetDigestsSizeInBytes = (ASSETS_CAPACITY * 2 - 1) * 32ULL;
 GLOBAL_VAR_DECL unsigned long long* assetChangeFlags GLOBAL_VAR_INIT(nullptr);
+GLOBAL_VAR_DECL bool assetDigestsMustBeRebuilt GLOBAL_VAR_INIT(false); // all assets changed, rebuild the whole tree in parallel
 static constexpr char CONTRACT_ASSET_UNIT_OF_MEASUREMENT[7] = { 0, 0, 0, 0, 0, 0, 0 };
 
 static constexpr unsigned int NO_ASSET_INDEX = 0xffffffff;
@@ -61,6 +64,9 @@ public: // TODO: make protected
         unsigned int issuancesFirstIdx;
         unsigned int ownershipsPossessionsFirstIdx[ASSETS_CAPACITY];
 
+        // Number of elements in the list ownershipsPossessionsFirstIdx[i] (ownerships of issuance i / possessions of ownership i)
+        unsigned int ownershipsPossessionsCount[ASSETS_CAPACITY];
+
         unsigned int nextIdx[ASSETS_CAPACITY];
 
         void addIssuance(unsigned int newIssuanceIdx)
@@ -71,6 +77,7 @@ public: // TODO: make protected
             ASSERT(issuancesFirstIdx == NO_ASSET_INDEX || assets[issuancesFirstIdx].varStruct.issuance.type == ISSUANCE);
             nextIdx[newIssuanceIdx] = issuancesFirstIdx;
             issuancesFirstIdx = newIssuanceIdx;
+            stateSnapshots.markAssetListsChanged(newIssuanceIdx);
         }
 
         // Add newOwnershipIdx as first element in linked list of all ownerships of issuanceIdx
@@ -83,6 +90,9 @@ public: // TODO: make protected
             ASSERT(ownershipsPossessionsFirstIdx[issuanceIdx] == NO_ASSET_INDEX || assets[ownershipsPossessionsFirstIdx[issuanceIdx]].varStruct.issuance.type == OWNERSHIP);
             nextIdx[newOwnershipIdx] = ownershipsPossessionsFirstIdx[issuanceIdx];
             ownershipsPossessionsFirstIdx[issuanceIdx] = newOwnershipIdx;
+            ownershipsPossessionsCount[issuanceIdx]++;
+            stateSnapshots.markAssetListsChanged(newOwnershipIdx);
+            stateSnapshots.markAssetListsChanged(issuanceIdx);
         }
 
         // Add newPossessionIdx as first element in linked list of all possessions of ownershipIdx
@@ -95,6 +105,9 @@ public: // TODO: make protected
             ASSERT(ownershipsPossessionsFirstIdx[ownershipIdx] == NO_ASSET_INDEX || assets[ownershipsPossessionsFirstIdx[ownershipIdx]].varStruct.possession.type == POSSESSION);
             nextIdx[newPossessionIdx] = ownershipsPossessionsFirstIdx[ownershipIdx];
             ownershipsPossessionsFirstIdx[ownershipIdx] = newPossessionIdx;
+            ownershipsPossessionsCount[ownershipIdx]++;
+            stateSnapshots.markAssetListsChanged(newPossessionIdx);
+            stateSnapshots.markAssetListsChanged(ownershipIdx);
         }
 
         // Reset lists to empty
@@ -103,7 +116,9 @@ public: // TODO: make protected
             issuancesFirstIdx = NO_ASSET_INDEX;
             static_assert(NO_ASSET_INDEX == 0xffffffff, "Following setMem() expects NO_ASSET_INDEX == 0xffffffff");
             setMem(ownershipsPossessionsFirstIdx, sizeof(ownershipsPossessionsFirstIdx), 0xff);
+            setMem(ownershipsPossessionsCount, sizeof(ownershipsPossessionsCount), 0);
             setMem(nextIdx, sizeof(nextIdx), 0xff);
+            stateSnapshots.markAllAssetListsChanged();
         }
 
         // Rebuild lists from assets array (includes reset)
@@ -159,6 +174,24 @@ static unsigned int issuanceIndex(const m256i& issuer, unsigned long long assetN
     return NO_ASSET_INDEX;
 }
 
+// Call callback(unsigned int index) for each issuance, ownership, and possession record of the entity publicKey. All
+// records of an entity are in the run of occupied slots starting at the hash position of its public key, because
+// records are only removed when assetsEndEpoch() rebuilds the universe. Acquire no lock.
+template <typename CallbackT>
+static void forEachAssetRecordOfEntity(const m256i& publicKey, CallbackT callback)
+{
+    unsigned int idx = publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+    for (unsigned int i = 0; i < ASSETS_CAPACITY && assets[idx].varStruct.issuance.type != EMPTY; i++)
+    {
+        if (assets[idx].varStruct.issuance.publicKey == publicKey)
+        {
+            callback(idx);
+        }
+
+        idx = (idx + 1) & (ASSETS_CAPACITY - 1);
+    }
+}
+
 
 
 
@@ -172,6 +205,8 @@ static bool initAssets()
         return false;
     }
     setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    assetDigestsMustBeRebuilt = true;
+    registerFileIOBuffer(assets, ASSETS_CAPACITY * sizeof(AssetRecord));
     return true;
 }
 
@@ -189,6 +224,7 @@ static void deinitAssets()
     }
     if (assets)
     {
+        unregisterFileIOBuffer(assets, ASSETS_CAPACITY * sizeof(AssetRecord));
         freePool(assets);
         assets = nullptr;
     }
@@ -711,11 +747,33 @@ iteration:
     }
 }
 
+static void hashAssetLeafs(const void* records, unsigned int firstIndex, unsigned int count, m256i* digests)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        KangarooTwelve(&((const AssetRecord*)records)[firstIndex + i], sizeof(AssetRecord), &digests[i], 32);
+    }
+}
+
 // Should only be called from tick processor to avoid concurrent asset state changes, which may cause race conditions
 static void getUniverseDigest(m256i& digest)
 {
     PROFILE_SCOPE();
 
+    // the flags of the changed records are cleared below
+    stateSnapshots.markAssetsChanged(assetChangeFlags);
+
+    if (assetDigestsMustBeRebuilt)
+    {
+        // Every asset is flagged as changed, so hash the whole universe with the help of idle processors
+        merkleTreeBuilder.build(assets, ASSETS_CAPACITY, hashAssetLeafs, assetDigests);
+        setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0);
+        assetDigestsMustBeRebuilt = false;
+
+        digest = assetDigests[(ASSETS_CAPACITY * 2 - 1) - 1];
+        return;
+    }
+
     unsigned int digestIndex;
     for (digestIndex = 0; digestIndex < ASSETS_CAPACITY; digestIndex++)
     {
@@ -783,6 +841,7 @@ static bool loadUniverse(const CHAR16* fileName = UNIVERSE_FILE_NAME, CHAR16* di
         return false;
     }
     as.indexLists.rebuild();
+    stateSnapshots.markAllAssetsChanged();
     return true;
 }
 
@@ -877,6 +936,7 @@ static void assetsEndEpoch()
     commonBuffers.releaseBuffer(reorgAssets);
 
     setMem(assetChangeFlags, ASSETS_CAPACITY / 8, 0xFF);
+    assetDigestsMustBeRebuilt = true;
 
     as.indexLists.rebuild();
 
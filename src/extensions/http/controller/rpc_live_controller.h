@@ -2,6 +2,8 @@
 #include "extensions/utils.h"
 #include "../utils.h"
 #include <drogon/HttpController.h>
+#include <algorithm>
+#include <vector>
 
 using namespace drogon;
 
@@ -34,35 +36,39 @@ class RpcLiveController : public HttpController<RpcLiveController>
     {
         auto issuerIdentity = req->getParameter("issuerIdentity");
         auto assetName = req->getParameter("assetName");
+        const HttpUtils::StateView state;
         Json::Value result;
         Json::Value assetsArray(Json::arrayValue);
         unsigned long long targetUniverseIndex = -1;
-        for (unsigned long long i = 0; i < ASSETS_CAPACITY; i++)
+        // walk the issuance list instead of the universe, keeping the match with the lowest universe index
+        for (unsigned int i = state.issuancesFirstIdx(); i != NO_ASSET_INDEX; i = state.nextIdx(i))
         {
-            if (assets[i].varStruct.issuance.type == ISSUANCE)
+            if (i >= targetUniverseIndex || state.asset(i).varStruct.issuance.type != ISSUANCE)
             {
-                auto &asset = assets[i].varStruct.issuance;
-                CHAR16 identity[61] = {};
-                getIdentity((unsigned char *)&asset.publicKey, identity, false);
-                std::string identityStr = wchar_to_string(identity);
-                std::string assetNameStr = std::string(asset.name);
-
-                if ((!issuerIdentity.empty() && identityStr != issuerIdentity) ||
-                    (!assetName.empty() && assetNameStr != assetName))
-                {
-                    continue;
-                }
-
-                Json::Value root;
-                Json::Value assetJson = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)&asset);
-                root["data"] = assetJson;
-                assetsArray.append(root);
-                targetUniverseIndex = i;
-                break;
+                continue;
             }
+            auto &asset = state.asset(i).varStruct.issuance;
+            CHAR16 identity[61] = {};
+            getIdentity((unsigned char *)&asset.publicKey, identity, false);
+            std::string identityStr = wchar_to_string(identity);
+            std::string assetNameStr = std::string(asset.name);
+
+            if ((!issuerIdentity.empty() && identityStr != issuerIdentity) ||
+                (!assetName.empty() && assetNameStr != assetName))
+            {
+                continue;
+            }
+            targetUniverseIndex = i;
+        }
+        if (targetUniverseIndex != (unsigned long long)-1)
+        {
+            Json::Value root;
+            Json::Value assetJson = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)&state.asset(targetUniverseIndex).varStruct.issuance);
+            root["data"] = assetJson;
+            assetsArray.append(root);
         }
         result["assets"] = assetsArray;
-        result["tick"] = system.tick;
+        result["tick"] = state.tick();
         result["universeIndex"] = Json::UInt64(targetUniverseIndex);
         cb(HttpResponse::newHttpJsonResponse(result));
     }
@@ -81,7 +87,8 @@ class RpcLiveController : public HttpController<RpcLiveController>
             return;
         }
 
-        if (assets[index].varStruct.issuance.type != ISSUANCE)
+        const HttpUtils::StateView state;
+        if (state.asset(index).varStruct.issuance.type != ISSUANCE)
         {
             result["code"] = 3;
             result["message"] = "No asset issuance at the given index";
@@ -89,10 +96,10 @@ class RpcLiveController : public HttpController<RpcLiveController>
             return;
         }
 
-        auto &asset = assets[index].varStruct.issuance;
+        auto &asset = state.asset(index).varStruct.issuance;
         Json::Value assetJson = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)&asset);
         result["data"] = assetJson;
-        result["tick"] = system.tick;
+        result["tick"] = state.tick();
         result["universeIndex"] = Json::UInt64(index);
         cb(HttpResponse::newHttpJsonResponse(result));
     }
@@ -113,30 +120,42 @@ class RpcLiveController : public HttpController<RpcLiveController>
 
         m256i issuerPublicKey;
         getPublicKeyFromIdentity(reinterpret_cast<const unsigned char *>(issuerIdentity.c_str()), issuerPublicKey.m256i_u8);
-        auto targetIssuanceIndex = issuanceIndex(issuerPublicKey, HttpUtils::assetNameFromString(assetName.c_str()));
-        for (unsigned long long i = 0; i < ASSETS_CAPACITY; i++)
+        const HttpUtils::StateView state;
+        auto targetIssuanceIndex = state.issuanceIndex(issuerPublicKey, HttpUtils::assetNameFromString(assetName.c_str()));
+
+        // only the ownerships of the issuance can match, reported in order of universe index
+        std::vector<unsigned int> ownershipIndices;
+        if (targetIssuanceIndex != NO_ASSET_INDEX)
         {
-            if (assets[i].varStruct.ownership.type == OWNERSHIP)
+            for (unsigned int i = state.ownershipsPossessionsFirstIdx(targetIssuanceIndex); i != NO_ASSET_INDEX; i = state.nextIdx(i))
             {
-                auto &asset = assets[i].varStruct.ownership;
-                CHAR16 identity[61] = {};
-                getIdentity((unsigned char *)&asset.publicKey, identity, false);
-                std::string identityStr = wchar_to_string(identity);
-
-                if ((!ownerIdentity.empty() && identityStr != ownerIdentity) ||
-                    (ownershipManagingContract >= 0 && asset.managingContractIndex != ownershipManagingContract) ||
-                    (targetIssuanceIndex >= 0 && asset.issuanceIndex != (unsigned int)targetIssuanceIndex))
-                {
-                    continue;
-                }
+                ownershipIndices.push_back(i);
+            }
+        }
+        std::sort(ownershipIndices.begin(), ownershipIndices.end());
+        for (unsigned int i : ownershipIndices)
+        {
+            auto &asset = state.asset(i).varStruct.ownership;
+            if (asset.type != OWNERSHIP)
+            {
+                continue;
+            }
+            CHAR16 identity[61] = {};
+            getIdentity((unsigned char *)&asset.publicKey, identity, false);
+            std::string identityStr = wchar_to_string(identity);
 
-                Json::Value root;
-                Json::Value assetJson = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)&asset);
-                root["tick"] = system.tick;
-                root["universeIndex"] = Json::UInt64(i);
-                root["data"] = assetJson;
-                assetsArray.append(root);
+            if ((!ownerIdentity.empty() && identityStr != ownerIdentity) ||
+                (ownershipManagingContract >= 0 && asset.managingContractIndex != ownershipManagingContract))
+            {
+                continue;
             }
+
+            Json::Value root;
+            Json::Value assetJson = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)&asset);
+            root["tick"] = state.tick();
+            root["universeIndex"] = Json::UInt64(i);
+            root["data"] = assetJson;
+            assetsArray.append(root);
         }
         result["assets"] = assetsArray;
         cb(HttpResponse::newHttpJsonResponse(result));
@@ -156,7 +175,8 @@ class RpcLiveController : public HttpController<RpcLiveController>
             return;
         }
 
-        if (assets[index].varStruct.ownership.type != OWNERSHIP)
+        const HttpUtils::StateView state;
+        if (state.asset(index).varStruct.ownership.type != OWNERSHIP)
         {
             result["code"] = 3;
             result["message"] = "No asset ownership at the given index";
@@ -164,10 +184,10 @@ class RpcLiveController : public HttpController<RpcLiveController>
             return;
         }
 
-        auto &asset = assets[index].varStruct.ownership;
+        auto &asset = state.asset(index).varStruct.ownership;
         Json::Value assetJson = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)&asset);
         result["data"] = assetJson;
-        result["tick"] = system.tick;
+        result["tick"] = state.tick();
         result["universeIndex"] = Json::UInt64(index);
         cb(HttpResponse::newHttpJsonResponse(result));
     }
@@ -194,34 +214,49 @@ class RpcLiveController : public HttpController<RpcLiveController>
 
         m256i issuerPublicKey;
         getPublicKeyFromIdentity(reinterpret_cast<const unsigned char *>(issuerIdentity.c_str()), issuerPublicKey.m256i_u8);
-        auto targetIssuanceIndex = issuanceIndex(issuerPublicKey, HttpUtils::assetNameFromString(assetName.c_str()));
+        const HttpUtils::StateView state;
+        auto targetIssuanceIndex = state.issuanceIndex(issuerPublicKey, HttpUtils::assetNameFromString(assetName.c_str()));
 
-        for (unsigned long long i = 0; i < ASSETS_CAPACITY; i++)
+        // only the possessions of the ownerships of the issuance can match, reported in order of universe index
+        std::vector<unsigned int> possessionIndices;
+        if (targetIssuanceIndex != NO_ASSET_INDEX)
         {
-            if (assets[i].varStruct.possession.type == POSSESSION)
+            for (unsigned int o = state.ownershipsPossessionsFirstIdx(targetIssuanceIndex); o != NO_ASSET_INDEX; o = state.nextIdx(o))
             {
-                auto &asset = assets[i].varStruct.possession;
-                CHAR16 identity[61] = {};
-                getIdentity((unsigned char *)&asset.publicKey, identity, false);
-                std::string identityStr = wchar_to_string(identity);
-                unsigned short currentOwnershipManagingContractIndex = assets[asset.ownershipIndex].varStruct.ownership.managingContractIndex;
-                unsigned int currentIssuanceIndex = assets[asset.ownershipIndex].varStruct.ownership.issuanceIndex;
-                if ((!possessorIdentity.empty() && identityStr != possessorIdentity) ||
-                    (!ownerIdentity.empty() && identityStr != ownerIdentity) ||
-                    (ownershipManagingContract >= 0 && currentOwnershipManagingContractIndex != ownershipManagingContract) ||
-                    (possessionManagingContract >= 0 && asset.managingContractIndex != possessionManagingContract) ||
-                    (targetIssuanceIndex >= 0 && currentIssuanceIndex != targetIssuanceIndex))
+                if (ownershipManagingContract >= 0 && state.asset(o).varStruct.ownership.managingContractIndex != ownershipManagingContract)
                 {
                     continue;
                 }
-
-                Json::Value root;
-                Json::Value assetJson = HttpUtils::possessionToJson((HttpUtils::AssetPossessionType *)&asset);
-                root["data"] = assetJson;
-                root["tick"] = system.tick;
-                root["universeIndex"] = Json::UInt64(i);
-                assetsArray.append(root);
+                for (unsigned int i = state.ownershipsPossessionsFirstIdx(o); i != NO_ASSET_INDEX; i = state.nextIdx(i))
+                {
+                    possessionIndices.push_back(i);
+                }
+            }
+        }
+        std::sort(possessionIndices.begin(), possessionIndices.end());
+        for (unsigned int i : possessionIndices)
+        {
+            auto &asset = state.asset(i).varStruct.possession;
+            if (asset.type != POSSESSION)
+            {
+                continue;
+            }
+            CHAR16 identity[61] = {};
+            getIdentity((unsigned char *)&asset.publicKey, identity, false);
+            std::string identityStr = wchar_to_string(identity);
+            if ((!possessorIdentity.empty() && identityStr != possessorIdentity) ||
+                (!ownerIdentity.empty() && identityStr != ownerIdentity) ||
+                (possessionManagingContract >= 0 && asset.managingContractIndex != possessionManagingContract))
+            {
+                continue;
             }
+
+            Json::Value root;
+            Json::Value assetJson = HttpUtils::possessionToJson((HttpUtils::AssetPossessionType *)&asset);
+            root["data"] = assetJson;
+            root["tick"] = state.tick();
+            root["universeIndex"] = Json::UInt64(i);
+            assetsArray.append(root);
         }
         result["assets"] = assetsArray;
         cb(HttpResponse::newHttpJsonResponse(result));
@@ -241,7 +276,8 @@ class RpcLiveController : public HttpController<RpcLiveController>
             return;
         }
 
-        if (assets[index].varStruct.possession.type != POSSESSION)
+        const HttpUtils::StateView state;
+        if (state.asset(index).varStruct.possession.type != POSSESSION)
         {
             result["code"] = 3;
             result["message"] = "No asset possession at the given index";
@@ -249,10 +285,10 @@ class RpcLiveController : public HttpController<RpcLiveController>
             return;
         }
 
-        auto &asset = assets[index].varStruct.possession;
+        auto &asset = state.asset(index).varStruct.possession;
         Json::Value assetJson = HttpUtils::possessionToJson((HttpUtils::AssetPossessionType *)&asset);
         result["data"] = assetJson;
-        result["tick"] = system.tick;
+        result["tick"] = state.tick();
         result["universeIndex"] = Json::UInt64(index);
         cb(HttpResponse::newHttpJsonResponse(result));
     }
@@ -267,26 +303,19 @@ class RpcLiveController : public HttpController<RpcLiveController>
         m256i identityPublicKey;
         getPublicKeyFromIdentity(reinterpret_cast<const unsigned char *>(identityStr.c_str()), identityPublicKey.m256i_u8);
 
-        for (unsigned long long i = 0; i < ASSETS_CAPACITY; i++)
+        const HttpUtils::StateView state;
+        for (unsigned int i : assetRecordsOfEntity(state, identityPublicKey, ISSUANCE))
         {
-            if (assets[i].varStruct.issuance.type == ISSUANCE)
-            {
-                auto &asset = assets[i].varStruct.issuance;
-
-                if (asset.publicKey != identityPublicKey)
-                {
-                    continue;
-                }
-
-                Json::Value root;
-                Json::Value assetJson = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)&asset);
-                root["data"] = assetJson;
-                Json::Value info(Json::objectValue);
-                info["tick"] = system.tick;
-                info["universeIndex"] = Json::UInt64(i);
-                root["info"] = info;
-                assetsArray.append(root);
-            }
+            auto &asset = state.asset(i).varStruct.issuance;
+
+            Json::Value root;
+            Json::Value assetJson = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)&asset);
+            root["data"] = assetJson;
+            Json::Value info(Json::objectValue);
+            info["tick"] = state.tick();
+            info["universeIndex"] = Json::UInt64(i);
+            root["info"] = info;
+            assetsArray.append(root);
         }
         result["issuedAssets"] = assetsArray;
         cb(HttpResponse::newHttpJsonResponse(result));
@@ -302,27 +331,21 @@ class RpcLiveController : public HttpController<RpcLiveController>
         m256i identityPublicKey;
         getPublicKeyFromIdentity(reinterpret_cast<const unsigned char *>(identityStr.c_str()), identityPublicKey.m256i_u8);
 
-        for (unsigned long long i = 0; i < ASSETS_CAPACITY; i++)
+        const HttpUtils::StateView state;
+        for (unsigned int i : assetRecordsOfEntity(state, identityPublicKey, OWNERSHIP))
         {
-            if (assets[i].varStruct.ownership.type == OWNERSHIP)
-            {
-                auto &asset = assets[i].varStruct.ownership;
-                auto issuanceAsset = &assets[asset.issuanceIndex].varStruct.issuance;
-                if (asset.publicKey != identityPublicKey)
-                {
-                    continue;
-                }
-
-                Json::Value root;
-                Json::Value assetJson = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)&asset);
-                assetJson["issuedAsset"] = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)issuanceAsset);
-                root["data"] = assetJson;
-                Json::Value info(Json::objectValue);
-                info["tick"] = system.tick;
-                info["universeIndex"] = Json::UInt64(i);
-                root["info"] = info;
-                assetsArray.append(root);
-            }
+            auto &asset = state.asset(i).varStruct.ownership;
+            auto issuanceAsset = &state.asset(asset.issuanceIndex).varStruct.issuance;
+
+            Json::Value root;
+            Json::Value assetJson = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)&asset);
+            assetJson["issuedAsset"] = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)issuanceAsset);
+            root["data"] = assetJson;
+            Json::Value info(Json::objectValue);
+            info["tick"] = state.tick();
+            info["universeIndex"] = Json::UInt64(i);
+            root["info"] = info;
+            assetsArray.append(root);
         }
         result["ownedAssets"] = assetsArray;
         cb(HttpResponse::newHttpJsonResponse(result));
@@ -338,29 +361,23 @@ class RpcLiveController : public HttpController<RpcLiveController>
         m256i identityPublicKey;
         getPublicKeyFromIdentity(reinterpret_cast<const unsigned char *>(identityStr.c_str()), identityPublicKey.m256i_u8);
 
-        for (unsigned long long i = 0; i < ASSETS_CAPACITY; i++)
+        const HttpUtils::StateView state;
+        for (unsigned int i : assetRecordsOfEntity(state, identityPublicKey, POSSESSION))
         {
-            if (assets[i].varStruct.possession.type == POSSESSION)
-            {
-                auto &asset = assets[i].varStruct.possession;
-                auto ownershipAsset = &assets[asset.ownershipIndex].varStruct.ownership;
-                auto issuanceAsset = &assets[ownershipAsset->issuanceIndex].varStruct.issuance;
-                if (asset.publicKey != identityPublicKey)
-                {
-                    continue;
-                }
-
-                Json::Value root;
-                Json::Value assetJson = HttpUtils::possessionToJson((HttpUtils::AssetPossessionType *)&asset);
-                assetJson["ownedAsset"] = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)ownershipAsset);
-                assetJson["ownedAsset"]["issuedAsset"] = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)issuanceAsset);
-                root["data"] = assetJson;
-                Json::Value info(Json::objectValue);
-                info["tick"] = system.tick;
-                info["universeIndex"] = Json::UInt64(i);
-                root["info"] = info;
-                assetsArray.append(root);
-            }
+            auto &asset = state.asset(i).varStruct.possession;
+            auto ownershipAsset = &state.asset(asset.ownershipIndex).varStruct.ownership;
+            auto issuanceAsset = &state.asset(ownershipAsset->issuanceIndex).varStruct.issuance;
+
+            Json::Value root;
+            Json::Value assetJson = HttpUtils::possessionToJson((HttpUtils::AssetPossessionType *)&asset);
+            assetJson["ownedAsset"] = HttpUtils::ownershipToJson((HttpUtils::AssetOwnershipType *)ownershipAsset);
+            assetJson["ownedAsset"]["issuedAsset"] = HttpUtils::issuanceToJson((HttpUtils::AssetIssuanceType *)issuanceAsset);
+            root["data"] = assetJson;
+            Json::Value info(Json::objectValue);
+            info["tick"] = state.tick();
+            info["universeIndex"] = Json::UInt64(i);
+            root["info"] = info;
+            assetsArray.append(root);
         }
         result["possessedAssets"] = assetsArray;
         cb(HttpResponse::newHttpJsonResponse(result));
@@ -374,10 +391,12 @@ class RpcLiveController : public HttpController<RpcLiveController>
         Json::Value balance;
         m256i identityPublicKey;
         getPublicKeyFromIdentity(reinterpret_cast<const unsigned char *>(idStr.c_str()), identityPublicKey.m256i_u8);
-        auto spectrumInfo = spectrum[spectrumIndex(identityPublicKey)];
+        const HttpUtils::StateView state;
+        const int index = state.spectrumIndex(identityPublicKey);
+        const EntityRecord spectrumInfo = (index >= 0) ? state.entity(index) : EntityRecord{};
         balance["id"] = idStr;
         balance["balance"] = std::to_string(spectrumInfo.incomingAmount - spectrumInfo.outgoingAmount);
-        balance["validForTick"] = system.tick;
+        balance["validForTick"] = state.tick();
         balance["latestIncomingTransferTick"] = spectrumInfo.latestIncomingTransferTick;
         balance["latestOutgoingTransferTick"] = spectrumInfo.latestOutgoingTransferTick;
         balance["incomingAmount"] = std::to_string(spectrumInfo.incomingAmount);
@@ -550,5 +569,21 @@ class RpcLiveController : public HttpController<RpcLiveController>
             cb(res);
         }
     }
+
+  private:
+    // Universe indices of the records of given type that belong to the entity, in order of universe index
+    static std::vector<unsigned int> assetRecordsOfEntity(const HttpUtils::StateView &state, const m256i &publicKey, unsigned char type)
+    {
+        std::vector<unsigned int> indices;
+        state.forEachAssetRecordOfEntity(publicKey, [&indices, &state, type](unsigned int index)
+        {
+            if (state.asset(index).varStruct.issuance.type == type)
+            {
+                indices.push_back(index);
+            }
+        });
+        std::sort(indices.begin(), indices.end());
+        return indices;
+    }
 };
 } // namespace RpcLive
\ No newline at end of file
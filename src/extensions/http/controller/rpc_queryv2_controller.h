@@ -1,8 +1,10 @@
 #pragma once
 #include "extensions/utils.h"
 #include "../utils.h"
+#include "../response_cache.h"
 #include <drogon/HttpController.h>
 #include <fmt/format.h>
+#include <vector>
 using namespace drogon;
 
 namespace RpcQueryV2
@@ -112,25 +114,26 @@ class RpcQueryV2Controller : public HttpController<RpcQueryV2Controller>
             return;
         }
 
-        unsigned int epoch = (*json)["epoch"].asUInt64();
-        Json::Value computorLists(Json::arrayValue);
-        Json::Value computorObject;
-        Json::Value idLists(Json::arrayValue);
-        for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+        httpResponseCache.respond(req, cb, [&json](Json::Value &result)
         {
-            m256i &pubKey = broadcastedComputors.computors.publicKeys[i];
-            CHAR16 id[61] = {};
-            getIdentity((const unsigned char *)&pubKey, id, false);
-            idLists.append(wchar_to_string(id));
-        }
-        computorObject["epoch"] = epoch;
-        computorObject["tickNumber"] = 0;
-        computorObject["identities"] = idLists;
-        computorObject["signature"] = base64_encode(broadcastedComputors.computors.signature, SIGNATURE_SIZE);
-        computorLists.append(computorObject);
-        result["computorsLists"] = computorLists;
-
-        cb(HttpResponse::newHttpJsonResponse(result));
+            unsigned int epoch = (*json)["epoch"].asUInt64();
+            Json::Value computorLists(Json::arrayValue);
+            Json::Value computorObject;
+            Json::Value idLists(Json::arrayValue);
+            for (unsigned int i = 0; i < NUMBER_OF_COMPUTORS; i++)
+            {
+                m256i &pubKey = broadcastedComputors.computors.publicKeys[i];
+                CHAR16 id[61] = {};
+                getIdentity((const unsigned char *)&pubKey, id, false);
+                idLists.append(wchar_to_string(id));
+            }
+            computorObject["epoch"] = epoch;
+            computorObject["tickNumber"] = 0;
+            computorObject["identities"] = idLists;
+            computorObject["signature"] = base64_encode(broadcastedComputors.computors.signature, SIGNATURE_SIZE);
+            computorLists.append(computorObject);
+            result["computorsLists"] = computorLists;
+        });
     }
 
     inline void getLastProcessedTick(const HttpRequestPtr &req,
@@ -276,10 +279,19 @@ class RpcQueryV2Controller : public HttpController<RpcQueryV2Controller>
             TickStorage::transactionsDigestAccess.releaseLock();
             return;
         }
-        Json::Value jsonObject = HttpUtils::transactionToJson(const_cast<Transaction *>(transaction));
-        auto resp = HttpResponse::newHttpJsonResponse(jsonObject);
-        cb(resp);
+        std::string &body = JsonStreamWriter::scratchBuffer();
+        std::string timestamp;
+        if (HttpUtils::getTickTimestamp(transaction->tick, timestamp))
+        {
+            JsonStreamWriter writer(body);
+            HttpUtils::writeTransaction(writer, transaction, txDigest, timestamp);
+        }
+        else
+        {
+            body = "null";
+        }
         TickStorage::transactionsDigestAccess.releaseLock();
+        cb(HttpUtils::newJsonBodyResponse(body));
     }
 
     inline void getTransactionsForIdentity(const HttpRequestPtr &req,
@@ -333,155 +345,184 @@ class RpcQueryV2Controller : public HttpController<RpcQueryV2Controller>
             return;
         }
 
-        Json::Value transactions(Json::arrayValue);
+        // Collect the matching transactions and write only the requested page without building a Json::Value per
+        // transaction. The transactions are only valid while the digest lock is held, so it is released if a filter
+        // can't be applied.
+        std::vector<const Transaction *> transactions;
+        std::string &body = JsonStreamWriter::scratchBuffer();
+        JsonStreamWriter writer(body);
+        size_t first = 0;
+        size_t end = 0;
         TickStorage::transactionsDigestAccess.acquireLock();
-        for (unsigned int tick = system.initialTick; tick <= system.tick; tick++)
+        try
         {
-            TickData *tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
-            if (!tickData)
-            {
-                continue;
-            }
-
-            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+            // Outgoing transactions come from the per-identity index; only scan the ticks if the index is incomplete
+            bool indexed = TickStorage::identityTransactionsAccess.forEachTransaction(publicKey,
+                [&transactions](const Transaction *transaction, bool isSource)
+                {
+                    if (isSource)
+                    {
+                        transactions.push_back(transaction);
+                    }
+                });
+            for (unsigned int tick = system.initialTick; !indexed && tick <= system.tick; tick++)
             {
-                m256i &txDigest = tickData->transactionDigests[i];
-                if (isZero(txDigest))
+                TickData *tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
+                if (!tickData)
                 {
                     continue;
                 }
 
-                const Transaction *transaction = TickStorage::transactionsDigestAccess.findTransaction(txDigest);
-                if (!transaction)
+                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
                 {
-                    continue;
-                }
+                    m256i &txDigest = tickData->transactionDigests[i];
+                    if (isZero(txDigest))
+                    {
+                        continue;
+                    }
 
-                if (transaction->sourcePublicKey == publicKey)
-                {
-                    Json::Value txJson = HttpUtils::transactionToJson((Transaction *)transaction);
-                    transactions.append(txJson);
+                    const Transaction *transaction = TickStorage::transactionsDigestAccess.findTransaction(txDigest);
+                    if (!transaction)
+                    {
+                        continue;
+                    }
+
+                    if (transaction->sourcePublicKey == publicKey)
+                    {
+                        transactions.push_back(transaction);
+                    }
                 }
             }
-        }
-        TickStorage::transactionsDigestAccess.releaseLock();
 
-        // filter transactions based on filters
-        if (filters.isObject())
-        {
-            Json::Value filteredTransactions(Json::arrayValue);
-            for (unsigned int i = 0; i < transactions.size(); i++)
+            // transactions are ordered by tick, so the timestamp of the previous one can mostly be reused
+            unsigned int timestampTick = 0;
+            bool hasTimestamp = false;
+            std::string timestamp;
+            auto getTimestamp = [&](const Transaction *transaction) -> bool
+            {
+                if (transaction->tick != timestampTick || !timestamp.size())
+                {
+                    timestampTick = transaction->tick;
+                    hasTimestamp = HttpUtils::getTickTimestamp(timestampTick, timestamp);
+                    if (!hasTimestamp)
+                    {
+                        timestamp = "0";
+                    }
+                }
+                return hasTimestamp;
+            };
+            auto getDigest = [](const Transaction *transaction)
+            {
+                m256i digest;
+                KangarooTwelve(transaction, transaction->totalSize(), &digest, sizeof(digest));
+                return digest;
+            };
+            auto getField = [&](const Transaction *transaction, const std::string &key, std::string &value) -> bool
             {
-                Json::Value tx = transactions[i];
+                return HttpUtils::transactionFieldToString(transaction, key, value,
+                    [&]() { return getDigest(transaction); },
+                    [&]() -> const std::string & { getTimestamp(transaction); return timestamp; });
+            };
+
+            // filter transactions based on filters and ranges, members the transactions don't have are ignored
+            std::vector<const Transaction *> matchingTransactions;
+            std::string fieldValue;
+            for (const Transaction *transaction : transactions)
+            {
+                if (!getTimestamp(transaction))
+                {
+                    continue;
+                }
                 bool match = true;
-                for (const auto &key : filters.getMemberNames())
+                if (filters.isObject())
                 {
-                    if (tx.isMember(key))
+                    for (const auto &key : filters.getMemberNames())
                     {
-                        if (tx[key].asString() != filters[key].asString())
+                        if (getField(transaction, key, fieldValue) && fieldValue != filters[key].asString())
                         {
                             match = false;
                             break;
                         }
                     }
                 }
-                if (match)
-                {
-                    filteredTransactions.append(tx);
-                }
-            }
-            transactions = filteredTransactions;
-        }
-        // filter transactions based on ranges
-        if (ranges.isObject())
-        {
-            Json::Value rangedTransactions(Json::arrayValue);
-            for (unsigned int i = 0; i < transactions.size(); i++)
-            {
-                Json::Value tx = transactions[i];
-                bool match = true;
-                for (const auto &key : ranges.getMemberNames())
+                if (match && ranges.isObject())
                 {
-                    if (tx.isMember(key))
+                    for (const auto &key : ranges.getMemberNames())
                     {
                         Json::Value range = ranges[key];
-                        if (range.isObject())
+                        if (!range.isObject() || !getField(transaction, key, fieldValue))
                         {
-                            if (range.isMember("lt"))
-                            {
-                                if (!(stoull(tx[key].asString()) < stoull(range["lt"].asString())))
-                                {
-                                    match = false;
-                                    break;
-                                }
-                            }
-                            if (range.isMember("gt"))
-                            {
-                                if (!(stoull(tx[key].asString()) > stoull(range["gt"].asString())))
-                                {
-                                    match = false;
-                                    break;
-                                }
-                            }
-                            if (range.isMember("lte"))
-                            {
-                                if (!(stoull(tx[key].asString()) <= stoull(range["lte"].asString())))
-                                {
-                                    match = false;
-                                    break;
-                                }
-                            }
-                            if (range.isMember("gte"))
-                            {
-                                if (!(stoull(tx[key].asString()) >= stoull(range["gte"].asString())))
-                                {
-                                    match = false;
-                                    break;
-                                }
-                            }
+                            continue;
+                        }
+                        const unsigned long long number = stoull(fieldValue);
+                        if ((range.isMember("lt") && !(number < stoull(range["lt"].asString())))
+                            || (range.isMember("gt") && !(number > stoull(range["gt"].asString())))
+                            || (range.isMember("lte") && !(number <= stoull(range["lte"].asString())))
+                            || (range.isMember("gte") && !(number >= stoull(range["gte"].asString()))))
+                        {
+                            match = false;
+                            break;
                         }
                     }
                 }
                 if (match)
                 {
-                    rangedTransactions.append(tx);
+                    matchingTransactions.push_back(transaction);
                 }
             }
-            transactions = rangedTransactions;
-        }
-        // apply pagination
-        if (pagination.isObject())
-        {
-            unsigned int offset = 0;
-            unsigned int size = 0;
-            if (pagination.isMember("offset"))
-            {
-                offset = pagination["offset"].asUInt64();
-            }
-            offset = std::min(offset, (unsigned int)10000);
-            if (pagination.isMember("size"))
-            {
-                size = pagination["size"].asUInt64();
-            } else
+
+            // apply pagination
+            end = matchingTransactions.size();
+            if (pagination.isObject())
             {
-                size = 10;
+                unsigned int offset = 0;
+                unsigned int size = 0;
+                if (pagination.isMember("offset"))
+                {
+                    offset = pagination["offset"].asUInt64();
+                }
+                offset = std::min(offset, (unsigned int)10000);
+                if (pagination.isMember("size"))
+                {
+                    size = pagination["size"].asUInt64();
+                } else
+                {
+                    size = 10;
+                }
+                size = std::min(size, (unsigned int)1000);
+                first = std::min((size_t)offset, end);
+                end = std::min((size_t)offset + size, end);
             }
-            size = std::min(size, (unsigned int)1000);
-            Json::Value paginatedTransactions(Json::arrayValue);
-            for (unsigned int i = offset; i < transactions.size() && i < offset + size; i++)
+
+            writer.beginObject();
+            writer.key("transactions");
+            writer.beginArray();
+            for (size_t i = first; i < end; i++)
             {
-                paginatedTransactions.append(transactions[i]);
+                getTimestamp(matchingTransactions[i]);
+                HttpUtils::writeTransaction(writer, matchingTransactions[i], getDigest(matchingTransactions[i]), timestamp);
             }
-            transactions = paginatedTransactions;
+            writer.endArray();
         }
-
-        result["transactions"] = transactions;
-        result["validForTick"] = 0;
-        result["hits"]["total"] = transactions.size();
-        result["hits"]["from"] = 0;
-        result["hits"]["size"] = transactions.size();
-        auto resp = HttpResponse::newHttpJsonResponse(result);
-        cb(resp);
+        catch (...)
+        {
+            TickStorage::transactionsDigestAccess.releaseLock();
+            throw;
+        }
+        TickStorage::transactionsDigestAccess.releaseLock();
+        writer.key("validForTick");
+        writer.value(0);
+        writer.key("hits");
+        writer.beginObject();
+        writer.key("total");
+        writer.value((unsigned long long)(end - first));
+        writer.key("from");
+        writer.value(0);
+        writer.key("size");
+        writer.value((unsigned long long)(end - first));
+        writer.endObject();
+        writer.endObject();
+        cb(HttpUtils::newJsonBodyResponse(body));
         } catch (const std::exception &e)
         {
             Json::Value result;
@@ -517,7 +558,20 @@ class RpcQueryV2Controller : public HttpController<RpcQueryV2Controller>
             return;
         }
 
-        Json::Value transactions(Json::arrayValue);
+        // all transactions share the timestamp of the tick and their digests are in the tick data
+        const std::string timestamp = HttpUtils::formatTimestamp(
+            localTickData.millisecond,
+            localTickData.second,
+            localTickData.minute,
+            localTickData.hour,
+            localTickData.day,
+            localTickData.month,
+            localTickData.year);
+        std::string &body = JsonStreamWriter::scratchBuffer();
+        JsonStreamWriter writer(body);
+        writer.beginObject();
+        writer.key("transactions");
+        writer.beginArray();
         TickStorage::transactionsDigestAccess.acquireLock();
         for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
         {
@@ -533,13 +587,12 @@ class RpcQueryV2Controller : public HttpController<RpcQueryV2Controller>
                 continue;
             }
 
-            Json::Value txJson = HttpUtils::transactionToJson((Transaction *)transaction);
-            transactions.append(txJson);
+            HttpUtils::writeTransaction(writer, transaction, txDigest, timestamp);
         }
         TickStorage::transactionsDigestAccess.releaseLock();
-        result["transactions"] = transactions;
-        auto resp = HttpResponse::newHttpJsonResponse(result);
-        cb(resp);
+        writer.endArray();
+        writer.endObject();
+        cb(HttpUtils::newJsonBodyResponse(body));
     }
 };
 } // namespace RpcQueryV2
\ No newline at end of file
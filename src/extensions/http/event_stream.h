@@ -0,0 +1,575 @@
+#pragma once
+
+#include <drogon/drogon.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json_stream_writer.h"
+#include "utils.h"
+
+// Push stream of node events as server-sent events (text/event-stream), so clients don't need to poll the tick info
+// endpoints. A publisher thread follows system.tick and the committed logs of qLogger and formats each event once into
+// a bounded buffer, from which it is sent to all subscribers. Events are:
+// - epoch: the publisher started following an epoch, log ids restart at 0
+// - tick: a tick has been processed (tick number, timestamp, whether it is empty, number of transactions)
+// - transactions: summary of the transactions of a non-empty tick
+// - log: a qLogger event with its header fields and the base64 encoded message
+//
+// Each event has a sequence number as SSE id, so clients resume with the standard Last-Event-ID header (or the
+// lastEventId parameter). Alternatively fromTick or fromLogId start with the buffered events of a tick or log id. A
+// truncated event tells the client that events before the cursor have already been dropped from the buffer.
+class EventStream
+{
+public:
+    enum EventType : unsigned int
+    {
+        EPOCH_EVENT = 1,
+        TICK_EVENT = 2,
+        TRANSACTIONS_EVENT = 4,
+        LOG_EVENT = 8,
+    };
+
+    // Limits of the buffer used for resuming, the oldest events are dropped when any of them is exceeded
+    static constexpr size_t maxNumberOfEvents = 16384;
+    static constexpr size_t maxBufferedBytes = 64ULL << 20;
+
+    // Output a subscriber may have waiting in its connection before it is disconnected, so a client that doesn't
+    // read doesn't make the server buffer events without limit. It resumes with Last-Event-ID after reconnecting.
+    static constexpr size_t maxSubscriberBacklog = 8ULL << 20;
+
+    void start()
+    {
+        stopFlag = false;
+        publisherThread = std::thread(&EventStream::publish, this);
+    }
+
+    void stop()
+    {
+        stopFlag = true;
+        if (publisherThread.joinable())
+        {
+            publisherThread.join();
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &subscriber : subscribers)
+        {
+            subscriber.stream->close();
+        }
+        subscribers.clear();
+    }
+
+    // Answer req with an event stream. Logs are only sent if canReadLogs, the default is all readable event types.
+    void subscribe(const drogon::HttpRequestPtr &req, std::function<void(const drogon::HttpResponsePtr &)> &&cb, bool canReadLogs)
+    {
+        unsigned int types = EPOCH_EVENT | TICK_EVENT | TRANSACTIONS_EVENT | ((canReadLogs) ? LOG_EVENT : 0);
+        const std::string typesParameter = req->getParameter("types");
+        if (!typesParameter.empty())
+        {
+            types = EPOCH_EVENT;
+            size_t begin = 0;
+            while (begin <= typesParameter.size())
+            {
+                size_t end = typesParameter.find(',', begin);
+                if (end == std::string::npos)
+                {
+                    end = typesParameter.size();
+                }
+                const std::string type = typesParameter.substr(begin, end - begin);
+                if (type == "tick")
+                {
+                    types |= TICK_EVENT;
+                }
+                else if (type == "transactions")
+                {
+                    types |= TRANSACTIONS_EVENT;
+                }
+                else if (type == "logs" && canReadLogs)
+                {
+                    types |= LOG_EVENT;
+                }
+                else
+                {
+                    cb(newErrorResponse((type == "logs") ? drogon::k401Unauthorized : drogon::k400BadRequest, "Invalid event type: " + type));
+                    return;
+                }
+                begin = end + 1;
+            }
+        }
+
+        Cursor cursor;
+        std::string lastEventId = req->getHeader("last-event-id");
+        if (lastEventId.empty())
+        {
+            lastEventId = req->getParameter("lastEventId");
+        }
+        try
+        {
+            if (!lastEventId.empty())
+            {
+                cursor.kind = Cursor::SEQUENCE_CURSOR;
+                cursor.value = std::stoull(lastEventId) + 1;
+            }
+            else if (!req->getParameter("fromLogId").empty())
+            {
+                cursor.kind = Cursor::LOG_ID_CURSOR;
+                cursor.value = std::stoull(req->getParameter("fromLogId"));
+            }
+            else if (!req->getParameter("fromTick").empty())
+            {
+                cursor.kind = Cursor::TICK_CURSOR;
+                cursor.value = std::stoull(req->getParameter("fromTick"));
+            }
+        }
+        catch (const std::exception &)
+        {
+            cb(newErrorResponse(drogon::k400BadRequest, "Invalid cursor"));
+            return;
+        }
+
+        std::shared_ptr<trantor::TcpConnection> connection = req->getConnectionPtr().lock();
+        if (connection)
+        {
+            connection->getLoop()->runInLoop(
+                [this, connection]()
+                {
+                    connection->setHighWaterMarkCallback(
+                        [this](const trantor::TcpConnectionPtr &conn, size_t)
+                        {
+                            slowSubscriberDisconnects++;
+                            conn->forceClose();
+                        },
+                        maxSubscriberBacklog);
+                });
+        }
+
+        auto resp = drogon::HttpResponse::newAsyncStreamResponse(
+            [this, types, cursor](drogon::ResponseStreamPtr stream)
+            {
+                attach(std::move(stream), types, cursor);
+            },
+            true);
+        resp->setContentTypeString("text/event-stream");
+        resp->addHeader("Cache-Control", "no-cache");
+        cb(resp);
+    }
+
+    Json::Value getStats()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Json::Value json;
+        json["subscribers"] = Json::UInt64(subscribers.size());
+        json["bufferedEvents"] = Json::UInt64(events.size());
+        json["bufferedBytes"] = Json::UInt64(bufferedBytes);
+        json["nextSequence"] = Json::UInt64(nextSequence);
+        json["firstCompleteTick"] = firstCompleteTick;
+        json["slowSubscriberDisconnects"] = Json::UInt64(slowSubscriberDisconnects.load());
+        return json;
+    }
+
+private:
+    struct Event
+    {
+        unsigned long long sequence;
+        unsigned long long logId; // only for log events
+        unsigned int tick;
+        EventType type;
+        std::string frame;
+    };
+
+    struct Cursor
+    {
+        enum Kind
+        {
+            NO_CURSOR,
+            SEQUENCE_CURSOR,
+            TICK_CURSOR,
+            LOG_ID_CURSOR,
+        } kind = NO_CURSOR;
+        unsigned long long value = 0;
+    };
+
+    struct Subscriber
+    {
+        drogon::ResponseStreamPtr stream;
+        unsigned int types;
+    };
+
+    static constexpr std::chrono::milliseconds pollInterval{100};
+    static constexpr std::chrono::seconds keepAliveInterval{15};
+
+    static drogon::HttpResponsePtr newErrorResponse(drogon::HttpStatusCode statusCode, const std::string &message)
+    {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(statusCode);
+        resp->setBody(message);
+        return resp;
+    }
+
+    // Send the buffered events at the cursor and add the subscriber for new events in one step, so no event is
+    // skipped or sent twice
+    void attach(drogon::ResponseStreamPtr stream, unsigned int types, const Cursor &cursor)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        size_t first = events.size();
+        bool isTruncated = false;
+        switch (cursor.kind)
+        {
+        case Cursor::SEQUENCE_CURSOR:
+            isTruncated = cursor.value < nextSequence - events.size();
+            first = (cursor.value > nextSequence) ? events.size() : events.size() - (size_t)std::min<unsigned long long>(nextSequence - cursor.value, events.size());
+            break;
+        case Cursor::TICK_CURSOR:
+            isTruncated = cursor.value < firstCompleteTick;
+            for (first = 0; first < events.size() && events[first].tick < cursor.value; first++)
+            {
+            }
+            break;
+        case Cursor::LOG_ID_CURSOR:
+            // log ids restart with each epoch, so only the events after the last epoch event are searched
+            isTruncated = cursor.value < firstCompleteLogId;
+            first = (epochSequence < nextSequence - events.size()) ? 0 : (size_t)(epochSequence - (nextSequence - events.size()));
+            for (; first < events.size() && (events[first].type != LOG_EVENT || events[first].logId < cursor.value); first++)
+            {
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (isTruncated)
+        {
+            std::string json;
+            JsonStreamWriter writer(json);
+            writer.beginObject();
+            writer.key("firstSequence");
+            writer.value(nextSequence - events.size());
+            writer.key("firstCompleteTick");
+            writer.value(firstCompleteTick);
+            writer.key("firstCompleteLogId");
+            writer.value(firstCompleteLogId);
+            writer.endObject();
+            if (!stream->send("event: truncated\ndata: " + json + "\n\n"))
+            {
+                return;
+            }
+        }
+        for (size_t i = first; i < events.size(); i++)
+        {
+            if ((events[i].type & types) && !stream->send(events[i].frame))
+            {
+                return;
+            }
+        }
+        subscribers.push_back({std::move(stream), types});
+    }
+
+    // Format the event, buffer it and send it to the subscribers of its type. Only called by the publisher thread.
+    void push(EventType type, const char *name, unsigned int tick, unsigned long long logId, const std::string &json)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Event event;
+        event.sequence = nextSequence++;
+        event.logId = logId;
+        event.tick = tick;
+        event.type = type;
+        event.frame.reserve(json.size() + 64);
+        event.frame += "id: ";
+        event.frame += std::to_string(event.sequence);
+        event.frame += "\nevent: ";
+        event.frame += name;
+        event.frame += "\ndata: ";
+        event.frame += json;
+        event.frame += "\n\n";
+
+        for (size_t i = 0; i < subscribers.size();)
+        {
+            if ((subscribers[i].types & type) && !subscribers[i].stream->send(event.frame))
+            {
+                // connection closed by the client
+                subscribers[i] = std::move(subscribers.back());
+                subscribers.pop_back();
+                continue;
+            }
+            i++;
+        }
+
+        if (type == EPOCH_EVENT)
+        {
+            epochSequence = event.sequence;
+            firstCompleteLogId = 0;
+        }
+        bufferedBytes += event.frame.size();
+        events.push_back(std::move(event));
+        while (events.size() > maxNumberOfEvents || (bufferedBytes > maxBufferedBytes && events.size() > 1))
+        {
+            const Event &dropped = events.front();
+            // events of the same tick may still be buffered, but not all of them
+            if (dropped.tick >= firstCompleteTick)
+            {
+                firstCompleteTick = dropped.tick + 1;
+            }
+            if (dropped.type == LOG_EVENT && dropped.sequence > epochSequence)
+            {
+                firstCompleteLogId = dropped.logId + 1;
+            }
+            bufferedBytes -= dropped.frame.size();
+            events.pop_front();
+        }
+    }
+
+    void sendKeepAlive()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < subscribers.size();)
+        {
+            if (!subscribers[i].stream->send(": keep-alive\n\n"))
+            {
+                subscribers[i] = std::move(subscribers.back());
+                subscribers.pop_back();
+                continue;
+            }
+            i++;
+        }
+    }
+
+    void publish()
+    {
+        auto lastKeepAlive = std::chrono::steady_clock::now();
+        while (!stopFlag)
+        {
+            const unsigned short epoch = system.epoch;
+            const unsigned int tick = system.tick;
+            if (epoch && tick)
+            {
+                if (epoch != publishedEpoch)
+                {
+                    beginEpoch(epoch, tick);
+                }
+                // ticks before system.tick have been processed
+                while (nextTick < tick && !stopFlag)
+                {
+                    publishTick(nextTick++);
+                }
+#if ENABLED_LOGGING
+                publishLogs();
+#endif
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (now - lastKeepAlive >= keepAliveInterval)
+            {
+                // comment line, keeps proxies and idle timeouts from closing the connection
+                sendKeepAlive();
+                lastKeepAlive = now;
+            }
+            std::this_thread::sleep_for(pollInterval);
+        }
+    }
+
+    void beginEpoch(unsigned short epoch, unsigned int tick)
+    {
+        if (!publishedEpoch)
+        {
+            // started during the epoch: only publish what happens from now on
+            nextTick = tick;
+            firstCompleteTick = tick;
+#if ENABLED_LOGGING
+            nextLogId = qLogger::mapLogIdToBufferIndex.size();
+#endif
+        }
+        else
+        {
+            // new epoch: follow it from its initial tick, the logger starts with log id 0 again
+            if (system.initialTick > nextTick)
+            {
+                nextTick = system.initialTick;
+            }
+            nextLogId = 0;
+        }
+        publishedEpoch = epoch;
+
+        std::string json;
+        JsonStreamWriter writer(json);
+        writer.beginObject();
+        writer.key("epoch");
+        writer.value((unsigned int)epoch);
+        writer.key("initialTick");
+        writer.value(system.initialTick);
+        writer.key("firstLogId");
+        writer.value(nextLogId);
+        writer.endObject();
+        push(EPOCH_EVENT, "epoch", nextTick, 0, json);
+        if (nextLogId > firstCompleteLogId)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            firstCompleteLogId = nextLogId;
+        }
+    }
+
+    void publishTick(unsigned int tick)
+    {
+        TickStorage::tickData.acquireLock();
+        const TickData *tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
+        if (tickData)
+        {
+            copyMem(&localTickData, tickData, sizeof(TickData));
+        }
+        TickStorage::tickData.releaseLock();
+
+        std::string timestamp;
+        unsigned int numberOfTransactions = 0;
+        if (tickData)
+        {
+            timestamp = HttpUtils::formatTimestamp(
+                localTickData.millisecond,
+                localTickData.second,
+                localTickData.minute,
+                localTickData.hour,
+                localTickData.day,
+                localTickData.month,
+                localTickData.year);
+            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+            {
+                if (!isZero(localTickData.transactionDigests[i]))
+                {
+                    numberOfTransactions++;
+                }
+            }
+        }
+
+        std::string json;
+        JsonStreamWriter writer(json);
+        writer.beginObject();
+        writer.key("epoch");
+        writer.value((unsigned int)((tickData) ? localTickData.epoch : publishedEpoch));
+        writer.key("tick");
+        writer.value(tick);
+        writer.key("empty");
+        writer.value(tickData == nullptr);
+        writer.key("timestamp");
+        writer.value(timestamp);
+        writer.key("numberOfTransactions");
+        writer.value(numberOfTransactions);
+        writer.endObject();
+        push(TICK_EVENT, "tick", tick, 0, json);
+
+        if (!numberOfTransactions)
+        {
+            return;
+        }
+
+        json.clear();
+        JsonStreamWriter txWriter(json);
+        txWriter.beginObject();
+        txWriter.key("tick");
+        txWriter.value(tick);
+        txWriter.key("transactions");
+        txWriter.beginArray();
+        TickStorage::transactionsDigestAccess.acquireLock();
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        {
+            const m256i &digest = localTickData.transactionDigests[i];
+            if (isZero(digest))
+            {
+                continue;
+            }
+            const Transaction *transaction = TickStorage::transactionsDigestAccess.findTransaction(digest);
+            if (!transaction)
+            {
+                continue;
+            }
+            txWriter.beginObject();
+            txWriter.key("hash");
+            txWriter.identityValue(digest.m256i_u8, true);
+            txWriter.key("source");
+            txWriter.identityValue(transaction->sourcePublicKey.m256i_u8, false);
+            txWriter.key("destination");
+            txWriter.identityValue(transaction->destinationPublicKey.m256i_u8, false);
+            txWriter.key("amount");
+            txWriter.value((unsigned long long)transaction->amount);
+            txWriter.key("inputType");
+            txWriter.value((unsigned int)transaction->inputType);
+            txWriter.key("inputSize");
+            txWriter.value((unsigned int)transaction->inputSize);
+            txWriter.endObject();
+        }
+        TickStorage::transactionsDigestAccess.releaseLock();
+        txWriter.endArray();
+        txWriter.endObject();
+        push(TRANSACTIONS_EVENT, "transactions", tick, 0, json);
+    }
+
+#if ENABLED_LOGGING
+    // Publish the logs committed since the last call. The blob info of a log is appended before its bytes, so a log
+    // whose bytes aren't in the log buffer yet is left for the next call.
+    void publishLogs()
+    {
+        const unsigned long long numberOfLogs = qLogger::mapLogIdToBufferIndex.size();
+        std::string json;
+        while (nextLogId < numberOfLogs && !stopFlag)
+        {
+            const qLogger::BlobInfo info = qLogger::mapLogIdToBufferIndex[nextLogId];
+            if (info.startIndex < 0 || info.length < LOG_HEADER_SIZE
+                || (unsigned long long)(info.startIndex + info.length) > qLogger::logBuffer.size())
+            {
+                break;
+            }
+            logData.resize(info.length);
+            qLogger::logBuf.getMany(logData.data(), info.startIndex, info.length);
+            if (!qLogger::verifyLog(logData.data(), nextLogId))
+            {
+                break;
+            }
+
+            const char *header = logData.data();
+            const unsigned int tick = *((const unsigned int *)(header + 2));
+            const unsigned int messageSize = qLogger::getLogSize(header);
+            json.clear();
+            JsonStreamWriter writer(json);
+            writer.beginObject();
+            writer.key("epoch");
+            writer.value((unsigned int)*((const unsigned short *)header));
+            writer.key("tick");
+            writer.value(tick);
+            writer.key("logId");
+            writer.value(nextLogId);
+            writer.key("type");
+            writer.value(*((const unsigned int *)(header + 6)) >> 24);
+            writer.key("data");
+            writer.base64Value((const unsigned char *)header + LOG_HEADER_SIZE, std::min<size_t>(messageSize, info.length - LOG_HEADER_SIZE));
+            writer.endObject();
+            push(LOG_EVENT, "log", tick, nextLogId, json);
+            nextLogId++;
+        }
+    }
+#endif
+
+    std::mutex lock;
+    std::deque<Event> events;
+    size_t bufferedBytes = 0;
+    unsigned long long nextSequence = 0;
+    unsigned long long epochSequence = 0;
+    unsigned int firstCompleteTick = 0;
+    unsigned long long firstCompleteLogId = 0;
+    std::vector<Subscriber> subscribers;
+    std::atomic<unsigned long long> slowSubscriberDisconnects{0};
+
+    // state of the publisher thread
+    std::thread publisherThread;
+    std::atomic<bool> stopFlag{false};
+    unsigned short publishedEpoch = 0;
+    unsigned int nextTick = 0;
+    unsigned long long nextLogId = 0;
+    TickData localTickData;
+    std::vector<char> logData;
+};
+
+inline EventStream eventStream;
@@ -6,6 +6,10 @@ static unsigned long long httpPasscodes[4] = {};
 
 #include <drogon/drogon.h>
 
+#include "response_cache.h"
+#include "event_stream.h"
+#include "state_download.h"
+
 #ifndef NO_RPC
 #include "controller/rpc_queryv2_controller.h"
 #include "controller/rpc_live_controller.h"
@@ -21,16 +25,20 @@ class PasscodeVerifier : public HttpMiddleware<PasscodeVerifier>
 public:
     PasscodeVerifier() {}
 
-    void invoke(const HttpRequestPtr &req,
-                MiddlewareNextCallback &&nextCb,
-                MiddlewareCallback &&mcb) override
+    static bool isPasscodeValid(const HttpRequestPtr &req)
     {
         static std::string correctPasscode = std::to_string(httpPasscodes[0]) + "-" +
                                                 std::to_string(httpPasscodes[1]) + "-" +
                                                     std::to_string(httpPasscodes[2]) + "-" +
                                                         std::to_string(httpPasscodes[3]);
-        bool isPasscodeValid = req->getParameter("passcode") == correctPasscode;
-        if (!isPasscodeValid)
+        return req->getParameter("passcode") == correctPasscode;
+    }
+
+    void invoke(const HttpRequestPtr &req,
+                MiddlewareNextCallback &&nextCb,
+                MiddlewareCallback &&mcb) override
+    {
+        if (!isPasscodeValid(req))
         {
             auto resp = HttpResponse::newHttpResponse();
             resp->setStatusCode(k401Unauthorized);
@@ -47,8 +55,6 @@ public:
 class QubicHttpServer
 {
 private:
-    static inline std::string hiddenFolder = ".qubic-tmp";
-
     static void __http_thread(int port)
     {
         HttpAppFramework &app = drogon::app();
@@ -135,18 +141,125 @@ private:
             [](const HttpRequestPtr &req,
                std::function<void(const HttpResponsePtr &)> &&callback)
             {
-                Json::Value json(Json::arrayValue);
-                for (unsigned int i = 0; i < system.numberOfSolutions; i++)
+                httpResponseCache.respond(req, callback, [](Json::Value &json)
+                {
+                    json = Json::Value(Json::arrayValue);
+                    for (unsigned int i = 0; i < system.numberOfSolutions; i++)
+                    {
+                        Json::Value solutionJson;
+                        solutionJson["computorPublicKey"] = byteToHex((unsigned char *)&system.solutions[i].computorPublicKey, sizeof(m256i));
+                        solutionJson["miningSeed"] = byteToHex((unsigned char *)&system.solutions[i].miningSeed, sizeof(m256i));
+                        solutionJson["nonce"] = byteToHex((unsigned char *)&system.solutions[i].nonce, sizeof(m256i));
+                        json.append(solutionJson);
+                    }
+                });
+            });
+
+        app.registerHandler(
+            "/epoch-stats",
+            [](const HttpRequestPtr &req,
+               std::function<void(const HttpResponsePtr &)> &&callback)
+            {
+                const EpochStats::Data stats = epochStats.get();
+                Json::Value json;
+                json["epoch"] = stats.epoch;
+                json["initialTick"] = stats.initialTick;
+                json["numberOfTicks"] = stats.numberOfTicks;
+                json["numberOfEmptyTicks"] = stats.numberOfEmptyTicks;
+                json["numberOfTransactions"] = Json::UInt64(stats.numberOfTransactions);
+                json["tickQuality"] = stats.quality();
+                json["numberOfTimedTicks"] = stats.numberOfTimedTicks;
+                json["averageTickDuration"] = (stats.numberOfTimedTicks) ? Json::UInt64(stats.totalTickDuration / stats.numberOfTimedTicks) : Json::UInt64(0);
+                json["maxTickDuration"] = stats.maxTickDuration;
+                auto resp = HttpResponse::newHttpJsonResponse(json);
+                callback(resp);
+            });
+
+        app.registerHandler(
+            "/response-cache-stats",
+            [](const HttpRequestPtr &req,
+               std::function<void(const HttpResponsePtr &)> &&callback)
+            {
+                auto resp = HttpResponse::newHttpJsonResponse(httpResponseCache.getStats());
+                callback(resp);
+            });
+
+        // Server-sent events of ticks, transactions and (with passcode) logs, see EventStream
+        app.registerHandler(
+            "/events",
+            [](const HttpRequestPtr &req,
+               std::function<void(const HttpResponsePtr &)> &&callback)
+            {
+                eventStream.subscribe(req, std::move(callback), MiddleWare::PasscodeVerifier::isPasscodeValid(req));
+            }, {drogon::Get});
+
+        app.registerHandler(
+            "/event-stream-stats",
+            [](const HttpRequestPtr &req,
+               std::function<void(const HttpResponsePtr &)> &&callback)
+            {
+                auto resp = HttpResponse::newHttpJsonResponse(eventStream.getStats());
+                callback(resp);
+            });
+
+#ifdef USE_SWAP
+        app.registerHandler(
+            "/swap-stats",
+            [](const HttpRequestPtr &req,
+               std::function<void(const HttpResponsePtr &)> &&callback)
+            {
+                const auto toJson = [](const SwapStats &stats)
+                {
+                    Json::Value json;
+                    json["hits"] = Json::UInt64(stats.hits);
+                    json["misses"] = Json::UInt64(stats.misses);
+                    json["stallMicroseconds"] = Json::UInt64(stats.stallMicroseconds);
+                    json["readAheadPages"] = Json::UInt64(stats.readAheadPages);
+                    json["readAheadHits"] = Json::UInt64(stats.readAheadHits);
+                    json["writtenBehindPages"] = Json::UInt64(stats.writtenBehindPages);
+                    return json;
+                };
+                const TickStorage::SwapStorageStats stats = ts.getSwapStats();
+                Json::Value json;
+                json["tickData"] = toJson(stats.tickData);
+                json["ticks"] = toJson(stats.ticks);
+                json["transactions"] = toJson(stats.transactions);
+                json["transactionDigests"] = toJson(stats.transactionDigests);
+                auto resp = HttpResponse::newHttpJsonResponse(json);
+                callback(resp);
+            });
+#endif
+
+#ifdef USE_DIRECT_FILE_IO
+        app.registerHandler(
+            "/file-io-stats",
+            [](const HttpRequestPtr &req,
+               std::function<void(const HttpResponsePtr &)> &&callback)
+            {
+                if (!gDirectFileIO)
                 {
-                    Json::Value solutionJson;
-                    solutionJson["computorPublicKey"] = byteToHex((unsigned char *)&system.solutions[i].computorPublicKey, sizeof(m256i));
-                    solutionJson["miningSeed"] = byteToHex((unsigned char *)&system.solutions[i].miningSeed, sizeof(m256i));
-                    solutionJson["nonce"] = byteToHex((unsigned char *)&system.solutions[i].nonce, sizeof(m256i));
-                    json.append(solutionJson);
+                    auto resp = HttpResponse::newHttpResponse();
+                    resp->setStatusCode(k503ServiceUnavailable);
+                    callback(resp);
+                    return;
                 }
+                const DirectFileIO::Stats stats = gDirectFileIO->getStats();
+                const unsigned long long completed = stats.reads + stats.writes + stats.failures;
+                Json::Value json;
+                json["backend"] = (gDirectFileIO->getBackend() == DirectFileIO::kIoUring) ? "io_uring" : "threadPool";
+                json["reads"] = Json::UInt64(stats.reads);
+                json["writes"] = Json::UInt64(stats.writes);
+                json["failures"] = Json::UInt64(stats.failures);
+                json["bytesRead"] = Json::UInt64(stats.bytesRead);
+                json["bytesWritten"] = Json::UInt64(stats.bytesWritten);
+                json["fixedBufferTransfers"] = Json::UInt64(stats.fixedBufferTransfers);
+                json["averageLatencyMicroseconds"] = Json::UInt64(completed ? stats.totalLatencyMicroseconds / completed : 0);
+                json["maxLatencyMicroseconds"] = Json::UInt64(stats.maxLatencyMicroseconds);
+                json["inFlight"] = stats.inFlight;
                 auto resp = HttpResponse::newHttpJsonResponse(json);
                 callback(resp);
             });
+#endif
 
         app.registerHandler(
             "/solution-publish-ticks",
@@ -177,87 +290,49 @@ private:
                 callback(resp);
             });
 
+        // Epoch file of the spectrum, as zip archive with zip=true. With format=sparse, the spectrum of the latest state
+        // snapshot in the sparse encoding of SparseStateDownload.
         app.registerHandler(
             "/spectrum",
             [](const HttpRequestPtr &req,
                std::function<void(const HttpResponsePtr &)> &&callback)
             {
-                bool isZip = req->getParameter("zip") == "true";
-                std::string path;
-                if (isZip)
-                {
-                    path = hiddenFolder + "/" + "spectrum.zip";
-                }
-                else
+                if (req->getParameter("format") == "sparse")
                 {
-                    path = "spectrum." + std::to_string(system.epoch);
+                    StateDownload::respondWithSparseState(req, callback, false);
+                    return;
                 }
-
-                // create zip if not exists in .qubic-tmp/
-                if (isZip && !std::filesystem::exists(path))
+                if (req->getParameter("zip") == "true")
                 {
-                    // check if hidden folder exists
-                    if (!std::filesystem::exists(hiddenFolder + "/"))
-                    {
-                        std::filesystem::create_directory(hiddenFolder);
-                    }
-
-                    std::string inputFile = "spectrum." + std::to_string(system.epoch);
-                    std::string command = "zip -j " + path + " " + inputFile;
-                    if (exec(command.c_str()) != 0)
-                    {
-                        auto resp = HttpResponse::newHttpResponse();
-                        resp->setStatusCode(k500InternalServerError);
-                        resp->setBody("Failed to create zip file");
-                        callback(resp);
-                        return;
-                    }
+                    StateDownload::respondWithZippedEpochFile(req, callback, "spectrum");
+                    return;
                 }
 
-                auto resp = HttpResponse::newFileResponse(path);
-                std::string fileName = isZip ? "spectrum.zip" : ("spectrum." + std::to_string(system.epoch));
+                std::string fileName = "spectrum." + std::to_string(system.epoch);
+                auto resp = HttpResponse::newFileResponse(fileName);
                 resp->addHeader("Content-Disposition", "attachment; filename=\"" + fileName + "\"");
                 callback(resp);
             }, {drogon::Get, "MiddleWare::PasscodeVerifier"});
 
+        // Same as /spectrum for the universe
         app.registerHandler(
             "/universe",
             [](const HttpRequestPtr &req,
                std::function<void(const HttpResponsePtr &)> &&callback)
             {
-                bool isZip = req->getParameter("zip") == "true";
-                std::string path;
-                if (isZip)
-                {
-                    path = hiddenFolder + "/" + "universe.zip";
-                }
-                else
+                if (req->getParameter("format") == "sparse")
                 {
-                    path = "universe." + std::to_string(system.epoch);
+                    StateDownload::respondWithSparseState(req, callback, true);
+                    return;
                 }
-
-                // create zip if not exists in .qubic-tmp/
-                if (isZip && !std::filesystem::exists(path))
+                if (req->getParameter("zip") == "true")
                 {
-                    // check if hidden folder exists
-                    if (!std::filesystem::exists(hiddenFolder + "/"))
-                    {
-                        std::filesystem::create_directory(hiddenFolder);
-                    }
-                    std::string inputFile = "universe." + std::to_string(system.epoch);
-                    std::string command = "zip -j " + path + " " + inputFile;
-                    if (exec(command.c_str()) != 0)
-                    {
-                        Json::Value json;
-                        json["error"] = "Failed to create zip file";
-                        auto resp = HttpResponse::newHttpJsonResponse(json);
-                        callback(resp);
-                        return;
-                    }
+                    StateDownload::respondWithZippedEpochFile(req, callback, "universe");
+                    return;
                 }
 
-                auto resp = HttpResponse::newFileResponse(path);
-                std::string fileName = isZip ? "universe.zip" : ("universe." + std::to_string(system.epoch));
+                std::string fileName = "universe." + std::to_string(system.epoch);
+                auto resp = HttpResponse::newFileResponse(fileName);
                 resp->addHeader("Content-Disposition", "attachment; filename=\"" + fileName + "\"");
                 callback(resp);
             }, {drogon::Get, "MiddleWare::PasscodeVerifier"});
@@ -341,10 +416,12 @@ public:
     {
         std::thread server_thread(__http_thread, port);
         server_thread.detach();
+        eventStream.start();
     }
 
     static void stop()
     {
+        eventStream.stop();
         drogon::app().quit();
     }
 };
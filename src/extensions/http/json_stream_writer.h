@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+#include "four_q.h"
+#include "extensions/utils.h"
+
+// Writes JSON text directly into a string, for responses with many elements that would otherwise be built as a
+// Json::Value tree first and serialized afterwards. The caller writes the structure in order, the writer only inserts
+// the separators and encodes the values. Identities and base64 data are encoded in place without temporary strings.
+class JsonStreamWriter
+{
+public:
+    explicit JsonStreamWriter(std::string &out) : out(out) {}
+
+    // Buffer of the calling thread, cleared but keeping its capacity, so the body of each response isn't grown from
+    // scratch again
+    static std::string &scratchBuffer()
+    {
+        thread_local std::string buffer;
+        buffer.clear();
+        return buffer;
+    }
+
+    void beginObject()
+    {
+        separate();
+        out += '{';
+        needsComma = false;
+    }
+
+    void endObject()
+    {
+        out += '}';
+        needsComma = true;
+    }
+
+    void beginArray()
+    {
+        separate();
+        out += '[';
+        needsComma = false;
+    }
+
+    void endArray()
+    {
+        out += ']';
+        needsComma = true;
+    }
+
+    // Name of the next member of an object, must not need escaping
+    void key(const char *name)
+    {
+        separate();
+        out += '"';
+        out += name;
+        out += "\":";
+        needsComma = false;
+    }
+
+    void value(const char *str, size_t length)
+    {
+        separate();
+        out += '"';
+        for (size_t i = 0; i < length; i++)
+        {
+            const unsigned char c = str[i];
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20)
+                {
+                    static const char hexDigits[] = "0123456789abcdef";
+                    out += "\\u00";
+                    out += hexDigits[c >> 4];
+                    out += hexDigits[c & 15];
+                }
+                else
+                {
+                    out += (char)c;
+                }
+            }
+        }
+        out += '"';
+        needsComma = true;
+    }
+
+    void value(const std::string &str)
+    {
+        value(str.data(), str.size());
+    }
+
+    void value(const char *str)
+    {
+        value(str, strlen(str));
+    }
+
+    void value(unsigned long long number)
+    {
+        separate();
+        char digits[20];
+        int n = 0;
+        do
+        {
+            digits[n++] = '0' + (char)(number % 10);
+            number /= 10;
+        } while (number);
+        while (n)
+        {
+            out += digits[--n];
+        }
+        needsComma = true;
+    }
+
+    void value(unsigned int number)
+    {
+        value((unsigned long long)number);
+    }
+
+    void value(long long number)
+    {
+        if (number < 0)
+        {
+            separate();
+            out += '-';
+            needsComma = false;
+            value(0ULL - (unsigned long long)number);
+        }
+        else
+        {
+            value((unsigned long long)number);
+        }
+    }
+
+    void value(int number)
+    {
+        value((long long)number);
+    }
+
+    void value(bool b)
+    {
+        separate();
+        out += (b) ? "true" : "false";
+        needsComma = true;
+    }
+
+    // Identity of a public key (or transaction digest), as returned by getIdentity()
+    void identityValue(const unsigned char *publicKey, bool isLowerCase)
+    {
+        CHAR16 identity[61];
+        getIdentity(publicKey, identity, isLowerCase);
+        separate();
+        const size_t offset = out.size();
+        out.resize(offset + 62);
+        char *p = &out[offset];
+        p[0] = '"';
+        for (int i = 0; i < 60; i++)
+        {
+            p[i + 1] = (char)identity[i];
+        }
+        p[61] = '"';
+        needsComma = true;
+    }
+
+    // Standard base64 with padding, like base64_encode()
+    void base64Value(const unsigned char *data, size_t size)
+    {
+        separate();
+        const size_t offset = out.size();
+        out.resize(offset + 2 + (size + 2) / 3 * 4);
+        char *p = &out[offset];
+        *p++ = '"';
+        size_t i = 0;
+        for (; i + 3 <= size; i += 3)
+        {
+            const unsigned int triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            p[0] = B64_TABLE[(triple >> 18) & 0x3F];
+            p[1] = B64_TABLE[(triple >> 12) & 0x3F];
+            p[2] = B64_TABLE[(triple >> 6) & 0x3F];
+            p[3] = B64_TABLE[triple & 0x3F];
+            p += 4;
+        }
+        if (i < size)
+        {
+            const unsigned int triple = (data[i] << 16) | ((i + 1 < size) ? (data[i + 1] << 8) : 0);
+            p[0] = B64_TABLE[(triple >> 18) & 0x3F];
+            p[1] = B64_TABLE[(triple >> 12) & 0x3F];
+            p[2] = (i + 1 < size) ? B64_TABLE[(triple >> 6) & 0x3F] : '=';
+            p[3] = '=';
+            p += 4;
+        }
+        *p = '"';
+        needsComma = true;
+    }
+
+private:
+    void separate()
+    {
+        if (needsComma)
+        {
+            out += ',';
+        }
+    }
+
+    std::string &out;
+    bool needsComma = false;
+};
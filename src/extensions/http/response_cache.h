@@ -0,0 +1,184 @@
+#pragma once
+
+#include <drogon/drogon.h>
+#include <drogon/utils/Utilities.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Serialized responses of read-only endpoints, for answering repeated polls without rebuilding and serializing the
+// Json::Value tree. The responses are keyed by route and normalized parameters and are valid for the tick (and epoch)
+// they were built in: the whole cache is dropped as soon as a request sees that the tick has advanced.
+//
+// Concurrent requests for the same key wait for the first one to build the response, so each key is built at most
+// once per tick. The gzip variant of a body is created on the first request accepting it.
+class HttpResponseCache
+{
+public:
+    // Maximum number of responses stored per tick. Requests with further keys are answered without caching.
+    static constexpr size_t maxNumberOfEntries = 4096;
+
+    // Bodies of at most this size are sent uncompressed
+    static constexpr size_t minGzipBodySize = 1024;
+
+    // Answer req with the cached response for the current tick or with the JSON built by build(Json::Value& result)
+    template <typename BuildT>
+    void respond(const drogon::HttpRequestPtr &req, const std::function<void(const drogon::HttpResponsePtr &)> &cb, BuildT build)
+    {
+        const std::string key = makeKey(req);
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> guard(entriesLock);
+            const unsigned long long version = currentVersion();
+            if (version != entriesVersion)
+            {
+                entries.clear();
+                entriesVersion = version;
+            }
+            auto it = entries.find(key);
+            if (it != entries.end())
+            {
+                entry = it->second;
+            }
+            else if (entries.size() < maxNumberOfEntries)
+            {
+                entry = std::make_shared<Entry>();
+                entries.emplace(key, entry);
+            }
+        }
+
+        const bool acceptsGzip = req->getHeader("accept-encoding").find("gzip") != std::string::npos;
+        if (!entry)
+        {
+            misses++;
+            Json::Value result;
+            build(result);
+            cb(makeResponse(serialize(result), false));
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(entry->lock);
+        if (entry->isBuilt)
+        {
+            hits++;
+        }
+        else
+        {
+            misses++;
+            Json::Value result;
+            build(result);
+            entry->body = serialize(result);
+            entry->isBuilt = true;
+        }
+        if (acceptsGzip && entry->body.size() > minGzipBodySize)
+        {
+            if (entry->gzipBody.empty())
+            {
+                entry->gzipBody = drogon::utils::gzipCompress(entry->body.data(), entry->body.size());
+            }
+            if (!entry->gzipBody.empty())
+            {
+                cb(makeResponse(entry->gzipBody, true));
+                return;
+            }
+        }
+        cb(makeResponse(entry->body, false));
+    }
+
+    Json::Value getStats()
+    {
+        Json::Value json;
+        json["hits"] = Json::UInt64(hits);
+        json["misses"] = Json::UInt64(misses);
+        std::lock_guard<std::mutex> guard(entriesLock);
+        json["entries"] = Json::UInt64(entries.size());
+        json["tick"] = (unsigned int)(entriesVersion & 0xFFFFFFFF);
+        return json;
+    }
+
+private:
+    struct Entry
+    {
+        std::mutex lock;
+        bool isBuilt = false;
+        std::string body;
+        std::string gzipBody;
+    };
+
+    static unsigned long long currentVersion()
+    {
+        return ((unsigned long long)system.epoch << 32) | system.tick;
+    }
+
+    // Path, query parameters sorted by name and the JSON body rewritten by jsoncpp, whose objects are ordered by key
+    static std::string makeKey(const drogon::HttpRequestPtr &req)
+    {
+        std::vector<std::pair<std::string, std::string>> parameters(req->getParameters().begin(), req->getParameters().end());
+        std::sort(parameters.begin(), parameters.end());
+        std::string key = req->path();
+        key += '?';
+        for (const auto &parameter : parameters)
+        {
+            key += parameter.first;
+            key += '=';
+            key += parameter.second;
+            key += '&';
+        }
+        if (req->method() != drogon::Get)
+        {
+            key += '\n';
+            auto json = req->getJsonObject();
+            if (json)
+            {
+                key += serialize(*json);
+            }
+            else
+            {
+                key += std::string(req->body());
+            }
+        }
+        return key;
+    }
+
+    static std::string serialize(const Json::Value &json)
+    {
+        static const Json::StreamWriterBuilder builder = []()
+        {
+            Json::StreamWriterBuilder b;
+            b["commentStyle"] = "None";
+            b["indentation"] = "";
+            b["emitUTF8"] = true;
+            return b;
+        }();
+        return Json::writeString(builder, json);
+    }
+
+    static drogon::HttpResponsePtr makeResponse(const std::string &body, bool isGzip)
+    {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+        resp->setBody(body);
+        // the same URL is answered with a gzip or an identity body depending on the request
+        resp->addHeader("Vary", "Accept-Encoding");
+        if (isGzip)
+        {
+            // drogon doesn't compress responses that already have a content encoding
+            resp->addHeader("Content-Encoding", "gzip");
+        }
+        return resp;
+    }
+
+    std::mutex entriesLock;
+    unsigned long long entriesVersion = 0;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+    std::atomic<unsigned long long> hits{0};
+    std::atomic<unsigned long long> misses{0};
+};
+
+inline HttpResponseCache httpResponseCache;
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <drogon/drogon.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "state_snapshot.h"
+
+// Downloads of the spectrum and universe, compressed in-process. read() returns the compressed data chunk by chunk,
+// so only one chunk of input and output is in memory at a time:
+//
+// - ZipFileDownload: the epoch file (spectrum.<epoch>, universe.<epoch>) as zip archive with one deflated entry, the
+//   format of the former `zip -j` download. ZipFileCache writes it once per version of the epoch file.
+// - SparseStateDownload: the spectrum or universe of the latest state snapshot as gzip of a sparse encoding, which
+//   skips empty records:
+//
+//     header:  char magic[4] = "QSP1", unsigned short epoch, unsigned short recordSize, unsigned int tick,
+//              unsigned int capacity (number of records including the empty ones)
+//     runs:    unsigned int firstIndex, unsigned int numberOfRecords, followed by numberOfRecords records
+//     end:     a run with numberOfRecords = 0
+//
+//   All numbers are little endian and records have the layout of EntityRecord or AssetRecord.
+class CompressedDownload
+{
+public:
+    virtual ~CompressedDownload()
+    {
+        deflateEnd(&zstream);
+    }
+
+    // Callback of the stream response: write the next part of the body to buffer and return its size, 0 at the end.
+    // buffer is nullptr if the connection has been closed.
+    size_t read(char* buffer, size_t size)
+    {
+        if (!buffer || failed)
+        {
+            return 0;
+        }
+
+        size_t written = 0;
+        while (written < size)
+        {
+            if (pendingOffset < pending.size())
+            {
+                const size_t n = std::min(size - written, pending.size() - pendingOffset);
+                memcpy(buffer + written, pending.data() + pendingOffset, n);
+                pendingOffset += n;
+                written += n;
+                continue;
+            }
+            if (finished)
+            {
+                break;
+            }
+
+            if (!zstream.avail_in && !inputEnded)
+            {
+                const unsigned char* data = nullptr;
+                size_t dataSize = 0;
+                if (!nextInput(data, dataSize))
+                {
+                    if (failed)
+                    {
+                        return 0;
+                    }
+                    inputEnded = true;
+                }
+                else
+                {
+                    zstream.next_in = (Bytef*)data;
+                    zstream.avail_in = (uInt)dataSize;
+                    crc = crc32(crc, data, (uInt)dataSize);
+                    uncompressedSize += dataSize;
+                }
+            }
+
+            zstream.next_out = (Bytef*)(buffer + written);
+            zstream.avail_out = (uInt)(size - written);
+            const int ret = deflate(&zstream, (inputEnded) ? Z_FINISH : Z_NO_FLUSH);
+            const size_t produced = (size - written) - zstream.avail_out;
+            written += produced;
+            compressedSize += produced;
+            if (ret == Z_STREAM_END)
+            {
+                finished = true;
+                pending = trailer();
+                pendingOffset = 0;
+            }
+            else if (ret == Z_STREAM_ERROR)
+            {
+                failed = true;
+                return 0;
+            }
+        }
+        return written;
+    }
+
+    bool hasFailed() const
+    {
+        return failed;
+    }
+
+protected:
+    // windowBits as for deflateInit2(): negative for raw deflate data, 16 + 15 for gzip
+    explicit CompressedDownload(int windowBits)
+    {
+        memset(&zstream, 0, sizeof(zstream));
+        deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    }
+
+    // Next block of uncompressed data, which must stay valid until the following call. Returns false at the end of
+    // the data or if reading failed (then also setting failed).
+    virtual bool nextInput(const unsigned char*& data, size_t& size) = 0;
+
+    // Bytes following the compressed data
+    virtual std::string trailer()
+    {
+        return std::string();
+    }
+
+    static void append(std::string& out, unsigned long long value, int numberOfBytes)
+    {
+        for (int i = 0; i < numberOfBytes; i++)
+        {
+            out += (char)(value >> (i * 8));
+        }
+    }
+
+    // Bytes preceding the compressed data, set by the constructor of the derived class
+    std::string pending;
+    size_t pendingOffset = 0;
+
+    // CRC-32 and sizes of the data so far
+    unsigned long crc = crc32(0, nullptr, 0);
+    unsigned long long uncompressedSize = 0;
+    unsigned long long compressedSize = 0;
+
+    bool failed = false;
+
+private:
+    z_stream zstream;
+    bool inputEnded = false;
+    bool finished = false;
+};
+
+class ZipFileDownload : public CompressedDownload
+{
+public:
+    // Archive of the file at path, stored as entryName. Check isOpen() before streaming it.
+    ZipFileDownload(const std::string& path, const std::string& entryName) : CompressedDownload(-MAX_WBITS), file(path, std::ios::binary), entryName(entryName)
+    {
+        // Local file header, with sizes and CRC-32 in the data descriptor after the data (flag bit 3)
+        append(pending, 0x04034b50, 4);
+        append(pending, 20, 2); // version needed to extract
+        append(pending, generalPurposeFlags, 2);
+        append(pending, Z_DEFLATED, 2);
+        append(pending, dosTime, 2);
+        append(pending, dosDate, 2);
+        append(pending, 0, 4); // CRC-32
+        append(pending, 0, 4); // compressed size
+        append(pending, 0, 4); // uncompressed size
+        append(pending, entryName.size(), 2);
+        append(pending, 0, 2); // extra field length
+        pending += entryName;
+        localHeaderSize = pending.size();
+    }
+
+    bool isOpen() const
+    {
+        return file.is_open();
+    }
+
+protected:
+    bool nextInput(const unsigned char*& data, size_t& size) override
+    {
+        if (file.eof())
+        {
+            return false;
+        }
+        file.read(block.get(), blockSize);
+        if (file.bad() || (file.fail() && !file.eof()))
+        {
+            failed = true;
+            return false;
+        }
+        data = (const unsigned char*)block.get();
+        size = (size_t)file.gcount();
+        return size > 0;
+    }
+
+    std::string trailer() override
+    {
+        // Zip64 is not needed, the epoch files are smaller than 4 GB
+        std::string out;
+        append(out, 0x08074b50, 4); // data descriptor
+        append(out, crc, 4);
+        append(out, compressedSize, 4);
+        append(out, uncompressedSize, 4);
+
+        const unsigned long long centralDirectoryOffset = localHeaderSize + compressedSize + out.size();
+        append(out, 0x02014b50, 4); // central directory file header
+        append(out, 20, 2); // version made by
+        append(out, 20, 2); // version needed to extract
+        append(out, generalPurposeFlags, 2);
+        append(out, Z_DEFLATED, 2);
+        append(out, dosTime, 2);
+        append(out, dosDate, 2);
+        append(out, crc, 4);
+        append(out, compressedSize, 4);
+        append(out, uncompressedSize, 4);
+        append(out, entryName.size(), 2);
+        append(out, 0, 2); // extra field length
+        append(out, 0, 2); // comment length
+        append(out, 0, 2); // disk number
+        append(out, 0, 2); // internal attributes
+        append(out, 0, 4); // external attributes
+        append(out, 0, 4); // offset of the local file header
+        out += entryName;
+        const unsigned long long centralDirectorySize = localHeaderSize + compressedSize + out.size() - centralDirectoryOffset;
+
+        append(out, 0x06054b50, 4); // end of central directory
+        append(out, 0, 2); // disk number
+        append(out, 0, 2); // disk with the central directory
+        append(out, 1, 2); // entries on this disk
+        append(out, 1, 2); // entries
+        append(out, centralDirectorySize, 4);
+        append(out, centralDirectoryOffset, 4);
+        append(out, 0, 2); // comment length
+        return out;
+    }
+
+private:
+    static constexpr unsigned short generalPurposeFlags = 0x0008;
+    static constexpr unsigned short dosTime = 0;
+    static constexpr unsigned short dosDate = (1 << 5) | 1; // 1980-01-01
+    static constexpr size_t blockSize = 1 << 20;
+
+    std::ifstream file;
+    std::string entryName;
+    std::unique_ptr<char[]> block{new char[blockSize]};
+    size_t localHeaderSize = 0;
+};
+
+// RecordsT is SnapshotPages of the snapshot, which is kept alive by the download
+template <typename RecordT, typename RecordsT>
+class SparseStateDownload : public CompressedDownload
+{
+public:
+    SparseStateDownload(std::shared_ptr<const StateSnapshot> snapshot, const RecordsT& records) : CompressedDownload(16 + MAX_WBITS), snapshot(std::move(snapshot)), records(records)
+    {
+        static_assert(sizeof(RecordT) < 0x10000, "Record size must fit into the header");
+        chunk.reserve(RecordsT::recordsPerPage * (sizeof(RecordT) + 8));
+        chunk.append("QSP1", 4);
+        append(chunk, this->snapshot->epoch, 2);
+        append(chunk, sizeof(RecordT), 2);
+        append(chunk, this->snapshot->tick, 4);
+        append(chunk, capacity, 4);
+        hasChunk = true;
+    }
+
+protected:
+    static constexpr unsigned long long capacity = (unsigned long long)RecordsT::numberOfPages * RecordsT::recordsPerPage;
+
+    // One chunk per page of the snapshot, pages with only empty records are skipped
+    bool nextInput(const unsigned char*& data, size_t& size) override
+    {
+        while (!hasChunk)
+        {
+            if (nextIndex >= capacity)
+            {
+                if (endWritten)
+                {
+                    return false;
+                }
+                append(chunk, capacity, 4);
+                append(chunk, 0, 4);
+                endWritten = true;
+                hasChunk = true;
+                break;
+            }
+
+            const unsigned int end = (unsigned int)(nextIndex + RecordsT::recordsPerPage);
+            unsigned int index = (unsigned int)nextIndex;
+            while (index < end)
+            {
+                if (isZero(&records[index], sizeof(RecordT)))
+                {
+                    index++;
+                    continue;
+                }
+
+                const unsigned int firstIndex = index;
+                while (index < end && !isZero(&records[index], sizeof(RecordT)))
+                {
+                    index++;
+                }
+                append(chunk, firstIndex, 4);
+                append(chunk, index - firstIndex, 4);
+                chunk.append((const char*)&records[firstIndex], (size_t)(index - firstIndex) * sizeof(RecordT));
+            }
+            nextIndex = end;
+            hasChunk = !chunk.empty();
+        }
+
+        // The chunk is only overwritten by the following call, after deflate() has consumed it
+        consumedChunk.swap(chunk);
+        chunk.clear();
+        hasChunk = false;
+        data = (const unsigned char*)consumedChunk.data();
+        size = consumedChunk.size();
+        return true;
+    }
+
+private:
+    std::shared_ptr<const StateSnapshot> snapshot;
+    const RecordsT& records;
+    std::string chunk;
+    std::string consumedChunk;
+    unsigned long long nextIndex = 0;
+    bool hasChunk = false;
+    bool endWritten = false;
+};
+
+// Zip archives of the epoch files in .qubic-tmp/, written on a worker thread once per version of the file (identified
+// by the ETag) and then sent as file response. Deflating an epoch file takes seconds, which must neither block the
+// drogon event loop nor be repeated for every download. Requests arriving while the archive is written are answered
+// when it is complete.
+class ZipFileCache
+{
+public:
+    using Callback = std::function<void(const drogon::HttpResponsePtr&)>;
+
+    ~ZipFileCache()
+    {
+        stopFlag = true;
+        for (auto& item : entries)
+        {
+            if (item.second.worker.joinable())
+            {
+                item.second.worker.join();
+            }
+        }
+    }
+
+    // Respond with the zip archive of the file <name>.<epoch> with the given version
+    void respond(const std::string& name, const std::string& fileName, const std::string& etag, Callback callback)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        Entry& entry = entries[name];
+        if (entry.ready && entry.etag == etag)
+        {
+            const std::string path = entry.path;
+            guard.unlock();
+            callback(makeFileResponse(name, path, etag));
+            return;
+        }
+
+        entry.waiting.push_back(std::move(callback));
+        entry.etag = etag;
+        entry.fileName = fileName;
+        entry.ready = false;
+        if (!entry.writing)
+        {
+            // The previous worker has finished writing, it only has to be joined
+            if (entry.worker.joinable())
+            {
+                entry.worker.join();
+            }
+            entry.writing = true;
+            entry.worker = std::thread(&ZipFileCache::write, this, name);
+        }
+    }
+
+private:
+    struct Entry
+    {
+        // Latest version requested and the file it is read from
+        std::string etag;
+        std::string fileName;
+
+        // Archive of etag, valid if ready is set
+        std::string path;
+        bool ready = false;
+
+        bool writing = false;
+        std::thread worker;
+        std::vector<Callback> waiting;
+    };
+
+    static constexpr const char* folder = ".qubic-tmp";
+    static constexpr size_t blockSize = 1 << 20;
+
+    static drogon::HttpResponsePtr makeFileResponse(const std::string& name, const std::string& path, const std::string& etag)
+    {
+        auto resp = drogon::HttpResponse::newFileResponse(path, name + ".zip", drogon::CT_NONE, "application/zip");
+        resp->addHeader("ETag", etag);
+        return resp;
+    }
+
+    // Worker writing the archive of the latest version requested until no newer version has been requested meanwhile
+    void write(std::string name)
+    {
+        const std::string path = std::string(folder) + "/" + name + ".zip";
+        while (true)
+        {
+            std::string etag, fileName;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                etag = entries[name].etag;
+                fileName = entries[name].fileName;
+            }
+
+            const bool ok = writeArchive(fileName, path);
+
+            std::vector<Callback> waiting;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                Entry& entry = entries[name];
+                if (ok && entry.etag != etag && !stopFlag)
+                {
+                    // The epoch file has changed while it was compressed
+                    continue;
+                }
+                entry.writing = false;
+                entry.ready = ok;
+                entry.path = path;
+                if (!ok)
+                {
+                    entry.etag.clear();
+                }
+                waiting.swap(entry.waiting);
+            }
+
+            for (auto& callback : waiting)
+            {
+                if (ok)
+                {
+                    callback(makeFileResponse(name, path, etag));
+                }
+                else
+                {
+                    auto errorResp = drogon::HttpResponse::newHttpResponse();
+                    errorResp->setStatusCode(drogon::k500InternalServerError);
+                    errorResp->setBody("Failed to compress " + fileName);
+                    callback(errorResp);
+                }
+            }
+            return;
+        }
+    }
+
+    // Write the archive to a temporary file and rename it, so responses sending the previous archive are not affected
+    bool writeArchive(const std::string& fileName, const std::string& path)
+    {
+        ZipFileDownload download(fileName, fileName);
+        if (!download.isOpen())
+        {
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(folder, error);
+        const std::string tempPath = path + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            std::unique_ptr<char[]> buffer(new char[blockSize]);
+            size_t size;
+            while (!stopFlag && (size = download.read(buffer.get(), blockSize)) > 0)
+            {
+                out.write(buffer.get(), size);
+            }
+            if (stopFlag || download.hasFailed() || !out.good())
+            {
+                out.close();
+                std::filesystem::remove(tempPath, error);
+                return false;
+            }
+        }
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+
+    std::mutex lock;
+    std::map<std::string, Entry> entries;
+    std::atomic<bool> stopFlag{false};
+};
+
+inline ZipFileCache zipFileCache;
+
+namespace StateDownload
+{
+    // Respond with 304 if the client already has the version identified by etag
+    static bool respondIfNotModified(const drogon::HttpRequestPtr& req, const std::function<void(const drogon::HttpResponsePtr&)>& callback, const std::string& etag)
+    {
+        if (req->getHeader("if-none-match") != etag)
+        {
+            return false;
+        }
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::k304NotModified);
+        resp->addHeader("ETag", etag);
+        callback(resp);
+        return true;
+    }
+
+    static void respondWithStream(const std::function<void(const drogon::HttpResponsePtr&)>& callback, std::shared_ptr<CompressedDownload> download, const std::string& fileName, const std::string& contentType, const std::string& etag)
+    {
+        auto resp = drogon::HttpResponse::newStreamResponse(
+            [download](char* buffer, std::size_t size) { return download->read(buffer, size); },
+            fileName, drogon::CT_NONE, contentType);
+        resp->addHeader("ETag", etag);
+        callback(resp);
+    }
+
+    static void respondWithError(const std::function<void(const drogon::HttpResponsePtr&)>& callback, drogon::HttpStatusCode statusCode, const std::string& message)
+    {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(statusCode);
+        resp->setBody(message);
+        callback(resp);
+    }
+
+    // Zip archive of the file <name>.<epoch>, the ETag changes if the file is written again
+    static void respondWithZippedEpochFile(const drogon::HttpRequestPtr& req, const std::function<void(const drogon::HttpResponsePtr&)>& callback, const std::string& name)
+    {
+        const std::string fileName = name + "." + std::to_string(system.epoch);
+        std::error_code error;
+        const auto size = std::filesystem::file_size(fileName, error);
+        const auto modified = std::filesystem::last_write_time(fileName, error);
+        if (error)
+        {
+            respondWithError(callback, drogon::k404NotFound, "File " + fileName + " not found");
+            return;
+        }
+
+        const std::string etag = "\"" + fileName + "-" + std::to_string(size) + "-" + std::to_string(modified.time_since_epoch().count()) + "-zip\"";
+        if (respondIfNotModified(req, callback, etag))
+        {
+            return;
+        }
+
+        zipFileCache.respond(name, fileName, etag, callback);
+    }
+
+    // Sparse encoding of the spectrum (isUniverse = false) or universe of the latest state snapshot. The snapshot
+    // identifies the state by epoch and tick, so these make the ETag.
+    static void respondWithSparseState(const drogon::HttpRequestPtr& req, const std::function<void(const drogon::HttpResponsePtr&)>& callback, bool isUniverse)
+    {
+        std::shared_ptr<const StateSnapshot> snapshot = stateSnapshots.get();
+        if (!snapshot)
+        {
+            respondWithError(callback, drogon::k503ServiceUnavailable,
+                (stateSnapshots.isEnabled()) ? "No state snapshot has been published yet" : "State snapshots are disabled (see --state-snapshots)");
+            return;
+        }
+
+        const std::string name = (isUniverse) ? "universe" : "spectrum";
+        const std::string etag = "\"" + name + "-" + std::to_string(snapshot->epoch) + "-" + std::to_string(snapshot->tick) + "-sparse\"";
+        if (respondIfNotModified(req, callback, etag))
+        {
+            return;
+        }
+
+        const std::string fileName = name + "." + std::to_string(snapshot->epoch) + "." + std::to_string(snapshot->tick) + ".sparse.gz";
+        std::shared_ptr<CompressedDownload> download;
+        if (isUniverse)
+        {
+            download = std::make_shared<SparseStateDownload<AssetRecord, decltype(snapshot->universe)>>(snapshot, snapshot->universe);
+        }
+        else
+        {
+            download = std::make_shared<SparseStateDownload<EntityRecord, decltype(snapshot->entities)>>(snapshot, snapshot->entities);
+        }
+        respondWithStream(callback, std::move(download), fileName, "application/gzip", etag);
+    }
+}
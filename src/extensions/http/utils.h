@@ -1,5 +1,7 @@
 #pragma once
 
+#include "json_stream_writer.h"
+
 class HttpUtils
 {
 public:
@@ -32,6 +34,92 @@ public:
         long long numberOfShares{};
     };
 
+    // Spectrum and universe as read by a request: the latest state snapshot if snapshots are enabled and one has been
+    // published, otherwise the live state, which the tick processor may change while it is read
+    class StateView
+    {
+    public:
+        StateView() : snapshot(stateSnapshots.get()) {}
+
+        // Tick at whose start the state is valid
+        unsigned int tick() const
+        {
+            return (snapshot) ? snapshot->tick : system.tick;
+        }
+
+        const EntityRecord &entity(unsigned int index) const
+        {
+            return (snapshot) ? snapshot->entities[index] : spectrum[index];
+        }
+
+        const AssetRecord &asset(unsigned int index) const
+        {
+            return (snapshot) ? snapshot->universe[index] : assets[index];
+        }
+
+        int spectrumIndex(const m256i &publicKey) const
+        {
+            return (snapshot) ? snapshot->spectrumIndex(publicKey) : ::spectrumIndex(publicKey);
+        }
+
+        // Asset index lists matching the records returned by asset() (see AssetStorage::IndexLists)
+        unsigned int issuancesFirstIdx() const
+        {
+            return (snapshot) ? snapshot->issuancesFirstIdx : as.indexLists.issuancesFirstIdx;
+        }
+
+        unsigned int ownershipsPossessionsFirstIdx(unsigned int index) const
+        {
+            return (snapshot) ? snapshot->ownershipsPossessionsFirstIdx[index] : as.indexLists.ownershipsPossessionsFirstIdx[index];
+        }
+
+        unsigned int ownershipsPossessionsCount(unsigned int index) const
+        {
+            return (snapshot) ? snapshot->ownershipsPossessionsCount[index] : as.indexLists.ownershipsPossessionsCount[index];
+        }
+
+        unsigned int nextIdx(unsigned int index) const
+        {
+            return (snapshot) ? snapshot->nextIdx[index] : as.indexLists.nextIdx[index];
+        }
+
+        // Same as ::issuanceIndex(), but looking up the issuance in this state
+        unsigned int issuanceIndex(const m256i &issuer, unsigned long long assetName) const
+        {
+            unsigned int idx = issuer.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+            while (asset(idx).varStruct.issuance.type != EMPTY)
+            {
+                const auto &issuance = asset(idx).varStruct.issuance;
+                if (issuance.type == ISSUANCE
+                    && ((*((unsigned long long *)issuance.name)) & 0xFFFFFFFFFFFFFF) == assetName
+                    && issuance.publicKey == issuer)
+                {
+                    return idx;
+                }
+                idx = (idx + 1) & (ASSETS_CAPACITY - 1);
+            }
+            return NO_ASSET_INDEX;
+        }
+
+        // Same as ::forEachAssetRecordOfEntity(), but iterating the records of this state
+        template <typename CallbackT>
+        void forEachAssetRecordOfEntity(const m256i &publicKey, CallbackT callback) const
+        {
+            unsigned int idx = publicKey.m256i_u32[0] & (ASSETS_CAPACITY - 1);
+            for (unsigned int i = 0; i < ASSETS_CAPACITY && asset(idx).varStruct.issuance.type != EMPTY; i++)
+            {
+                if (asset(idx).varStruct.issuance.publicKey == publicKey)
+                {
+                    callback(idx);
+                }
+                idx = (idx + 1) & (ASSETS_CAPACITY - 1);
+            }
+        }
+
+    private:
+        std::shared_ptr<const StateSnapshot> snapshot;
+    };
+
     static unsigned long long assetNameFromString(const char *assetName)
     {
         size_t n = strlen(assetName);
@@ -103,6 +191,7 @@ public:
             TickData *tmptickData = TickStorage::tickData.getByTickIfNotEmpty(tx->tick);
             if (!tmptickData)
             {
+                TickStorage::tickData.releaseLock();
                 delete tickData;
                 return jsonObject;
             }
@@ -142,6 +231,121 @@ public:
         return jsonObject;
     }
 
+    // Write the transaction with the same members as transactionToJson(). The digest of the transaction and the
+    // timestamp of its tick are passed in, because the callers know them without computing them per transaction.
+    static void writeTransaction(JsonStreamWriter &writer, const Transaction *tx, const m256i &digest, const std::string &timestamp)
+    {
+        writer.beginObject();
+        writer.key("hash");
+        writer.identityValue(digest.m256i_u8, true);
+        writer.key("amount");
+        writer.value((unsigned long long)tx->amount);
+        writer.key("source");
+        writer.identityValue(tx->sourcePublicKey.m256i_u8, false);
+        writer.key("destination");
+        writer.identityValue(tx->destinationPublicKey.m256i_u8, false);
+        writer.key("tickNumber");
+        writer.value(tx->tick);
+        writer.key("timestamp");
+        writer.value(timestamp);
+        writer.key("inputType");
+        writer.value((unsigned int)tx->inputType);
+        writer.key("inputSize");
+        writer.value((unsigned int)tx->inputSize);
+        writer.key("inputData");
+        writer.base64Value(tx->inputPtr(), tx->inputSize);
+        writer.key("signature");
+        writer.base64Value(tx->signaturePtr(), SIGNATURE_SIZE);
+        writer.key("moneyFlew");
+        writer.value(tx->amount > 0);
+        writer.endObject();
+    }
+
+    // Get a member of the transaction JSON as Json::Value::asString() would return it, for filtering without building
+    // the JSON. The digest and timestamp are only requested if needed. Returns false if there is no such member.
+    template <typename GetDigestT, typename GetTimestampT>
+    static bool transactionFieldToString(const Transaction *tx, const std::string &key, std::string &value, GetDigestT getDigest, GetTimestampT getTimestamp)
+    {
+        CHAR16 identity[61] = {};
+        if (key == "hash")
+        {
+            const m256i digest = getDigest();
+            getIdentity(digest.m256i_u8, identity, true);
+            value.assign(identity, identity + 60);
+        }
+        else if (key == "amount")
+        {
+            value = std::to_string((unsigned long long)tx->amount);
+        }
+        else if (key == "source" || key == "destination")
+        {
+            getIdentity((key == "source") ? tx->sourcePublicKey.m256i_u8 : tx->destinationPublicKey.m256i_u8, identity, false);
+            value.assign(identity, identity + 60);
+        }
+        else if (key == "tickNumber")
+        {
+            value = std::to_string(tx->tick);
+        }
+        else if (key == "timestamp")
+        {
+            value = getTimestamp();
+        }
+        else if (key == "inputType")
+        {
+            value = std::to_string(tx->inputType);
+        }
+        else if (key == "inputSize")
+        {
+            value = std::to_string(tx->inputSize);
+        }
+        else if (key == "inputData")
+        {
+            value = base64_encode(const_cast<unsigned char *>(tx->inputPtr()), tx->inputSize);
+        }
+        else if (key == "signature")
+        {
+            value = base64_encode(const_cast<unsigned char *>(tx->signaturePtr()), SIGNATURE_SIZE);
+        }
+        else if (key == "moneyFlew")
+        {
+            value = (tx->amount > 0) ? "true" : "false";
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    // Get the timestamp of the tick as in transactionToJson(), returns false if there is no tick data
+    static bool getTickTimestamp(unsigned int tick, std::string &timestamp)
+    {
+        TickStorage::tickData.acquireLock();
+        const TickData *tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
+        if (tickData)
+        {
+            timestamp = formatTimestamp(
+                tickData->millisecond,
+                tickData->second,
+                tickData->minute,
+                tickData->hour,
+                tickData->day,
+                tickData->month,
+                tickData->year);
+        }
+        TickStorage::tickData.releaseLock();
+        return tickData != nullptr;
+    }
+
+    // Response with a JSON body written by JsonStreamWriter
+    static drogon::HttpResponsePtr newJsonBodyResponse(const std::string &body)
+    {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+        resp->setBody(body);
+        return resp;
+    }
+
     static std::string formatTimestamp(
        unsigned short millisecond,
        unsigned char second,
@@ -172,34 +376,27 @@ public:
 
     static TickData *findTickDataFromTxHash(m256i &hash)
     {
-        TickData localTickData;
-        for (unsigned int tick = system.initialTick; tick <= system.tick; tick++)
+        // The digest hash map knows the tick of each transaction of the epoch, so only one tick data is copied
+        unsigned int tick, transactionIndex;
+        TickStorage::transactionsDigestAccess.acquireLock();
+        bool found = TickStorage::transactionsDigestAccess.findTransactionLocation(hash, tick, transactionIndex);
+        TickStorage::transactionsDigestAccess.releaseLock();
+        if (!found)
         {
-            TickStorage::tickData.acquireLock();
-            TickData *tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
-            if (tickData)
-            {
-                copyMem(&localTickData, tickData, sizeof(TickData));
-            }
-            TickStorage::tickData.releaseLock();
-            if (!tickData)
-            {
-                continue;
-            }
+            return nullptr;
+        }
 
-            for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
-            {
-                if (localTickData.transactionDigests[i] == hash)
-                {
-                    // found
-                    TickData *result = new TickData();
-                    copyMem(result, &localTickData, sizeof(TickData));
-                    return result;
-                }
-            }
+        TickData *result = nullptr;
+        TickStorage::tickData.acquireLock();
+        TickData *tickData = TickStorage::tickData.getByTickIfNotEmpty(tick);
+        if (tickData && tickData->transactionDigests[transactionIndex] == hash)
+        {
+            result = new TickData();
+            copyMem(result, tickData, sizeof(TickData));
         }
+        TickStorage::tickData.releaseLock();
 
-        return nullptr;
+        return result;
     }
 
     static void fetch(const std::string &url, const std::string &path, const drogon::HttpMethod method, const Json::Value &body, const std::map<std::string, std::string> &headers = {}, std::function<void(drogon::ReqResult &result, const drogon::HttpResponsePtr &resp)> callback = nullptr)
@@ -116,6 +116,11 @@ static inline unsigned long long tickDelay = 0;
 
 static inline unsigned long long securityTick = 1;
 
+//////////// Network I/O Threads \\\\\\\\\\\\
+
+// Number of epoll reactor threads serving peer sockets (Linux only)
+static inline unsigned int numberOfNetworkIoThreads = 2;
+
 bool isSystemAtSecurityTick()
 {
     if (forceDontCheckComputerDigest)
@@ -320,6 +325,10 @@ enum class ConnectStatus
     Error
 };
 
+#if defined(__linux__)
+#include "extensions/tcp_reactor.h"
+#endif
+
 template <typename T>
 class EventQueue {
 public:
@@ -376,6 +385,7 @@ struct Overload {
 
     inline static std::vector<std::thread> threads;
     inline static std::map<unsigned long long, SOCKET> incomingSocketMap;
+    inline static std::mutex incomingSocketMapLock;
     inline static std::map<unsigned long long, TcpData> tcpDataMap;
     inline static std::map<unsigned long long, EventData> eventDataMap;
     inline static std::map<unsigned long long, bool> isReceiveThreadSetupMap;
@@ -518,12 +528,17 @@ struct Overload {
         if (memcmp(Protocol, &tcp4ProtocolGuid, sizeof(EFI_GUID)) == 0) {
             *Interface = new EFI_TCP4_PROTOCOL;
             // Check if this is a incomming socket and set socket instance if it is
+            std::unique_lock<std::mutex> incomingSocketLock(incomingSocketMapLock);
             if (incomingSocketMap.contains((unsigned long long)Handle)) {
                 TcpData& tcpData = tcpDataMap[(unsigned long long) * Interface];
                 tcpData.socket = incomingSocketMap[(unsigned long long)Handle];
+#if defined(__linux__)
+                TcpReactor::add(tcpData.socket);
+#endif
 
                 incomingSocketMap.erase((unsigned long long)Handle);
             }
+            incomingSocketLock.unlock();
 
             // Map handle to the tcp4Protocol so we can get tcp4Protocol from the handle
             *(unsigned long long*)Handle = (unsigned long long) * Interface;
@@ -713,7 +728,12 @@ struct Overload {
 		if (tcpDataMap.contains(key)) {
 			TcpData& tcpData = tcpDataMap[key];
 			if (tcpData.socket != INVALID_SOCKET) {
+#if defined(__linux__)
+				// The reactor aborts the pending tokens and closes the socket after its queued commands
+				TcpReactor::remove(tcpData.socket);
+#else
 				closesocket(tcpData.socket);
+#endif
 				tcpData.socket = INVALID_SOCKET;
 			}
 			tcpDataMap.erase(key);
@@ -768,7 +788,11 @@ struct Overload {
             return EFI_ABORTED;
         }
 
+#if defined(__linux__)
+        TcpReactor::transmit(tcpData->socket, Token);
+#else
         transmitQueue.push({ tcpData->socket, Token});
+#endif
 
         return EFI_SUCCESS;
     }
@@ -797,7 +821,11 @@ struct Overload {
             return EFI_ABORTED;
         }
 
+#if defined(__linux__)
+        TcpReactor::receive(tcpData->socket, Token);
+#else
         receiveQueue.push({ tcpData->socket, Token});
+#endif
 
         return EFI_SUCCESS;
     }
@@ -865,6 +893,13 @@ struct Overload {
     static EFI_STATUS Configure(IN void* This, IN EFI_TCP4_CONFIG_DATA* TcpConfigData OPTIONAL) {
         static bool isGlobalSocketInitialized = false;
         if (!TcpConfigData) {
+#if defined(__linux__)
+            // Resetting the instance aborts the connection and all of its pending tokens
+            auto it = tcpDataMap.find((unsigned long long)This);
+            if (it != tcpDataMap.end() && it->second.socket != INVALID_SOCKET && (unsigned long long)This != (unsigned long long)peerTcp4Protocol) {
+                TcpReactor::cancel(it->second.socket);
+            }
+#endif
             return EFI_SUCCESS;
         }
 
@@ -906,7 +941,12 @@ struct Overload {
                 return EFI_ABORTED;
             }
 
-            if (listen(sock, SOMAXCONN) == SOCKET_ERROR) {
+#if defined(__linux__)
+            const int backlog = TcpReactor::listenBacklog;
+#else
+            const int backlog = SOMAXCONN;
+#endif
+            if (listen(sock, backlog) == SOCKET_ERROR) {
                 logToConsole(L"Failed to listen socket!");
                 closesocket(sock);
 
@@ -915,6 +955,9 @@ struct Overload {
 
             logToConsole(L"Socket binded");
             data.socket = sock;
+#if defined(__linux__)
+            TcpReactor::listen(sock);
+#endif
 			isGlobalSocketInitialized = true;
         }
 
@@ -935,6 +978,10 @@ struct Overload {
             return EFI_UNSUPPORTED;
         }
 
+#if defined(__linux__)
+        // The reactor completes the token with the next connection, see registerIncomingSocket()
+        TcpReactor::accept(tcpData->socket, ListenToken);
+#else
         // accept in a thread
         std::thread acceptThread([tcpData, ListenToken]() {
             sockaddr_in addr{};
@@ -959,17 +1006,23 @@ struct Overload {
             ioctlsocket(clientSocket, FIONBIO, &mode);
 #endif
 
-            CreateChild(NULL, &ListenToken->NewChildHandle);
-            // At this point we dont know the tcp4Protocol for this peer (tcp4Protocol will be inititialzed in peerConnectionNewlyEstablished())
-            // so we map the clientSocket to the handle to process it later in peerConnectionNewlyEstablished()
-            incomingSocketMap[(unsigned long long)ListenToken->NewChildHandle] = clientSocket;
+            registerIncomingSocket(ListenToken, clientSocket);
             ListenToken->CompletionToken.Status = EFI_SUCCESS;
             tcpData->connectStatus = ConnectStatus::Connected;
             });
         acceptThread.detach();
+#endif
         return EFI_SUCCESS;
     }
 
+    static void registerIncomingSocket(EFI_TCP4_LISTEN_TOKEN* ListenToken, SOCKET clientSocket) {
+        CreateChild(NULL, &ListenToken->NewChildHandle);
+        // At this point we dont know the tcp4Protocol for this peer (tcp4Protocol will be inititialzed in peerConnectionNewlyEstablished())
+        // so we map the clientSocket to the handle to process it later in peerConnectionNewlyEstablished()
+        std::lock_guard<std::mutex> lock(incomingSocketMapLock);
+        incomingSocketMap[(unsigned long long)ListenToken->NewChildHandle] = clientSocket;
+    }
+
     static EFI_STATUS Connect(IN void* This, IN EFI_TCP4_CONNECTION_TOKEN* ConnectionToken) {
         static std::map<int, long long> latestConnectTimestampMap; // map of <ip, timestamp>
         TcpData* tcpData = nullptr;
@@ -999,6 +1052,14 @@ struct Overload {
         #endif
 
         unsigned int ipInNumber = *(unsigned int*)tcpData->configData.AccessPoint.RemoteAddress.Addr;
+#if defined(__linux__)
+        // Throttle reconnects to the same IP by deferring the attempt inside the reactor instead of sleeping in a thread
+        long long nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        long long delayMs = (nowMs - latestConnectTimestampMap[ipInNumber] < 2'000) ? 5'000 : 0;
+        latestConnectTimestampMap[ipInNumber] = nowMs + delayMs;
+        tcpData->connectStatus = ConnectStatus::Connecting;
+        TcpReactor::connect(sock, serverAddr, ConnectionToken, &tcpData->connectStatus, delayMs);
+#else
         // connect in a thread
         std::thread connectThread([tcpData, serverAddr, ConnectionToken, ipInNumber]() {
             auto now = std::chrono::system_clock::now();
@@ -1023,6 +1084,7 @@ struct Overload {
             latestConnectTimestampMap[ipInNumber] = ms;
             });
         connectThread.detach();
+#endif
 
         return EFI_SUCCESS;
     }
@@ -1181,11 +1243,17 @@ struct Overload {
         st->ConOut->ClearScreen = Overload::ClearScreen;
         st->ConIn->ReadKeyStroke = Overload::ReadKeyStroke;
 
+#if defined(__linux__)
+        // Serve peer sockets from the epoll reactor
+        TcpReactor::onAccepted = registerIncomingSocket;
+        TcpReactor::start(numberOfNetworkIoThreads);
+#else
         // Open transmit and receive processor threads
         std::thread transmitProcessorThread(transmitProcessor);
         transmitProcessorThread.detach();
         std::thread receiveProcessorThread(receiveProcessor);
         receiveProcessorThread.detach();
+#endif
     }
 };
 
@@ -0,0 +1,727 @@
+#pragma once
+
+// Edge-triggered epoll reactor serving the EFI_TCP4 tokens of the TCP4 shim in Overload (Linux only).
+// Sockets are sharded over a configurable number of I/O threads. Each shard exclusively owns the state of
+// its sockets; other threads only hand over commands through the shard's queue and wake it via eventfd.
+// Tokens are completed when the kernel reports readiness, so a slow peer only delays its own socket.
+// Accepting and connecting are driven by the same loop (non-blocking connect + EPOLLOUT), so connection
+// churn does not create any threads.
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "platform/console_logging.h"
+
+struct TcpReactor
+{
+    static constexpr unsigned int maxNumberOfThreads = 64;
+    static constexpr int maxEventsPerWait = 256;
+    // Transmission that could not be finished within this time is completed with EFI_TIMEOUT
+    static constexpr long long transmitTimeoutMs = 1000;
+    // Upper bound of epoll_wait() so that timers are handled without any socket activity
+    static constexpr int timeoutScanIntervalMs = 100;
+    // Number of fragments of a transmit token passed to a single sendmsg() call
+    static constexpr unsigned int maxIoVectors = 64;
+    // Pending connections the kernel queues on the listening socket before refusing new ones
+    static constexpr int listenBacklog = 256;
+    // Incoming connections accepted from one IP within the window, further ones are closed right away
+    static constexpr unsigned int maxAcceptsPerIpPerWindow = 8;
+    static constexpr long long acceptRateWindowMs = 10'000;
+
+    enum class CommandType
+    {
+        Add,
+        Remove,
+        Receive,
+        Transmit,
+        Cancel,
+        Listen,
+        Accept,
+        Connect
+    };
+
+    struct Command
+    {
+        CommandType type;
+        int socket;
+        EFI_TCP4_IO_TOKEN* token;
+        EFI_TCP4_LISTEN_TOKEN* listenToken;
+        EFI_TCP4_CONNECTION_TOKEN* connectionToken;
+        ConnectStatus* connectStatus;
+        sockaddr_in address;
+        long long notBeforeMs;
+    };
+
+    struct SocketState
+    {
+        EFI_TCP4_IO_TOKEN* receiveToken = nullptr;
+        EFI_TCP4_IO_TOKEN* transmitToken = nullptr;
+        unsigned int transmittedBytes = 0;
+        long long transmitStartMs = 0;
+        // Readiness cached from edge-triggered events, cleared when the kernel returns EAGAIN
+        bool readable = true;
+        bool writable = true;
+        bool closed = false;
+
+        // Listening socket: tokens waiting for the next incoming connection
+        bool isListening = false;
+        std::deque<EFI_TCP4_LISTEN_TOKEN*> listenTokens;
+
+        // Outgoing connection in progress
+        EFI_TCP4_CONNECTION_TOKEN* connectionToken = nullptr;
+        ConnectStatus* connectStatus = nullptr;
+    };
+
+    struct AcceptRate
+    {
+        long long windowStartMs;
+        unsigned int count;
+    };
+
+    struct Shard
+    {
+        int epollFd = -1;
+        int wakeFd = -1;
+        std::mutex commandLock;
+        std::vector<Command> commands;
+        std::unordered_map<int, SocketState> sockets;
+        // Connects throttled by the caller, started once their notBeforeMs has passed
+        std::vector<Command> deferredConnects;
+        std::unordered_map<unsigned int, AcceptRate> acceptRates;
+        long long lastTimeoutScanMs = 0;
+    };
+
+    inline static Shard* shards = nullptr;
+    inline static unsigned int numberOfShards = 0;
+
+    // Called from a reactor thread for every accepted connection before its listen token is completed
+    inline static void (*onAccepted)(EFI_TCP4_LISTEN_TOKEN* listenToken, int socket) = nullptr;
+
+    inline static std::atomic<unsigned long long> numberOfRateLimitedConnections = 0;
+
+    static long long steadyMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static bool start(unsigned int numberOfThreads)
+    {
+        if (numberOfThreads == 0)
+        {
+            numberOfThreads = 1;
+        }
+        if (numberOfThreads > maxNumberOfThreads)
+        {
+            numberOfThreads = maxNumberOfThreads;
+        }
+
+        shards = new Shard[numberOfThreads];
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            Shard& shard = shards[i];
+            shard.epollFd = epoll_create1(EPOLL_CLOEXEC);
+            shard.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (shard.epollFd < 0 || shard.wakeFd < 0)
+            {
+                logToConsole(L"CRITICAL: failed to create epoll/eventfd for the network reactor");
+                return false;
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = shard.wakeFd;
+            epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, shard.wakeFd, &event);
+        }
+        numberOfShards = numberOfThreads;
+
+        for (unsigned int i = 0; i < numberOfShards; i++)
+        {
+            std::thread shardThread(shardProcessor, &shards[i]);
+            shardThread.detach();
+        }
+        return true;
+    }
+
+    // Start serving an established connection. The socket is switched to non-blocking mode.
+    static void add(int socket)
+    {
+        setNonBlocking(socket);
+        post(makeCommand(CommandType::Add, socket));
+    }
+
+    // Stop serving the socket, complete its pending tokens with EFI_ABORTED and close it. The socket is closed by its
+    // shard after all commands queued before, so a queued cancel never hits a closed (or reused) descriptor. The caller
+    // must not use or close the socket afterwards.
+    static void remove(int socket)
+    {
+        post(makeCommand(CommandType::Remove, socket));
+    }
+
+    static void receive(int socket, EFI_TCP4_IO_TOKEN* token)
+    {
+        Command command = makeCommand(CommandType::Receive, socket);
+        command.token = token;
+        post(command);
+    }
+
+    static void transmit(int socket, EFI_TCP4_IO_TOKEN* token)
+    {
+        Command command = makeCommand(CommandType::Transmit, socket);
+        command.token = token;
+        post(command);
+    }
+
+    // Shut the connection down and complete all pending tokens with EFI_ABORTED (UEFI Configure(NULL) semantics)
+    static void cancel(int socket)
+    {
+        post(makeCommand(CommandType::Cancel, socket));
+    }
+
+    // Serve a bound socket that listen() has been called on
+    static void listen(int socket)
+    {
+        setNonBlocking(socket);
+        post(makeCommand(CommandType::Listen, socket));
+    }
+
+    // Complete the listen token with the next incoming connection that passes the per-IP rate limit
+    static void accept(int listeningSocket, EFI_TCP4_LISTEN_TOKEN* listenToken)
+    {
+        Command command = makeCommand(CommandType::Accept, listeningSocket);
+        command.listenToken = listenToken;
+        post(command);
+    }
+
+    // Connect without blocking, the attempt is started after delayMs (reconnect throttling)
+    static void connect(int socket, const sockaddr_in& address, EFI_TCP4_CONNECTION_TOKEN* connectionToken, ConnectStatus* connectStatus, long long delayMs)
+    {
+        setNonBlocking(socket);
+        Command command = makeCommand(CommandType::Connect, socket);
+        command.connectionToken = connectionToken;
+        command.connectStatus = connectStatus;
+        command.address = address;
+        command.notBeforeMs = steadyMs() + delayMs;
+        post(command);
+    }
+
+private:
+    static Command makeCommand(CommandType type, int socket)
+    {
+        Command command{};
+        command.type = type;
+        command.socket = socket;
+        return command;
+    }
+
+    static void setNonBlocking(int socket)
+    {
+        int flags = fcntl(socket, F_GETFL, 0);
+        fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    static void post(const Command& command)
+    {
+        Shard& shard = shards[(unsigned int)command.socket % numberOfShards];
+        bool wasEmpty;
+        {
+            std::lock_guard<std::mutex> lock(shard.commandLock);
+            wasEmpty = shard.commands.empty();
+            shard.commands.push_back(command);
+        }
+
+        // The shard drains its whole queue at once, so it only needs to be woken on the empty -> non-empty transition
+        if (wasEmpty)
+        {
+            unsigned long long one = 1;
+            write(shard.wakeFd, &one, sizeof(one));
+        }
+    }
+
+    static void complete(EFI_TCP4_COMPLETION_TOKEN& completionToken, EFI_STATUS status)
+    {
+        // Make data written into the token visible before the main thread sees the status change
+        std::atomic_thread_fence(std::memory_order_release);
+        completionToken.Status = status;
+    }
+
+    static bool watch(Shard& shard, int socket)
+    {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = socket;
+        return epoll_ctl(shard.epollFd, EPOLL_CTL_ADD, socket, &event) == 0;
+    }
+
+    static void serviceReceive(int socket, SocketState& state)
+    {
+        if (!state.receiveToken)
+        {
+            return;
+        }
+
+        if (state.closed)
+        {
+            complete(state.receiveToken->CompletionToken, EFI_ABORTED);
+            state.receiveToken = nullptr;
+            return;
+        }
+
+        EFI_TCP4_RECEIVE_DATA* rxData = state.receiveToken->Packet.RxData;
+        while (state.readable)
+        {
+            auto n = recv(socket, (char*)rxData->FragmentTable[0].FragmentBuffer, rxData->FragmentTable[0].FragmentLength, 0);
+            if (n > 0)
+            {
+                rxData->DataLength = (unsigned int)n;
+                complete(state.receiveToken->CompletionToken, EFI_SUCCESS);
+                state.receiveToken = nullptr;
+                return;
+            }
+            else if (n == 0)
+            {
+                // connection closed by peer
+                state.closed = true;
+                break;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // wait for the next EPOLLIN edge
+                state.readable = false;
+                return;
+            }
+            else if (errno != EINTR)
+            {
+                state.closed = true;
+                break;
+            }
+        }
+
+        if (state.closed)
+        {
+            complete(state.receiveToken->CompletionToken, EFI_ABORTED);
+            state.receiveToken = nullptr;
+        }
+    }
+
+    static void serviceTransmit(int socket, SocketState& state)
+    {
+        if (!state.transmitToken)
+        {
+            return;
+        }
+
+        if (state.closed)
+        {
+            complete(state.transmitToken->CompletionToken, EFI_ABORTED);
+            state.transmitToken = nullptr;
+            return;
+        }
+
+        // The whole fragment table is handed to the kernel as one scatter/gather list, so all messages batched for
+        // this peer leave with a single syscall as long as the socket buffer has room
+        const EFI_TCP4_TRANSMIT_DATA* txData = state.transmitToken->Packet.TxData;
+        const unsigned int totalLength = transmitLength(txData);
+        while (state.writable && state.transmittedBytes < totalLength)
+        {
+            iovec vectors[maxIoVectors];
+            msghdr msg{};
+            msg.msg_iov = vectors;
+            msg.msg_iovlen = fillIoVectors(txData, state.transmittedBytes, vectors);
+            auto n = sendmsg(socket, &msg, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                state.transmittedBytes += (unsigned int)n;
+            }
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                // wait for the next EPOLLOUT edge
+                state.writable = false;
+            }
+            else if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                logToConsole(L"Closed a transmit socket");
+                complete(state.transmitToken->CompletionToken, EFI_ABORTED);
+                state.transmitToken = nullptr;
+                return;
+            }
+        }
+
+        if (state.transmittedBytes >= totalLength)
+        {
+            complete(state.transmitToken->CompletionToken, EFI_SUCCESS);
+            state.transmitToken = nullptr;
+        }
+    }
+
+    static unsigned int transmitLength(const EFI_TCP4_TRANSMIT_DATA* txData)
+    {
+        unsigned int length = 0;
+        for (unsigned int i = 0; i < txData->FragmentCount; i++)
+        {
+            length += txData->FragmentTable[i].FragmentLength;
+        }
+        return length;
+    }
+
+    // Describe the not yet transmitted part of the fragment table, starting at byte offset skip
+    static unsigned int fillIoVectors(const EFI_TCP4_TRANSMIT_DATA* txData, unsigned int skip, iovec* vectors)
+    {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < txData->FragmentCount && count < maxIoVectors; i++)
+        {
+            const EFI_TCP4_FRAGMENT_DATA& fragment = txData->FragmentTable[i];
+            if (skip >= fragment.FragmentLength)
+            {
+                skip -= fragment.FragmentLength;
+                continue;
+            }
+            vectors[count].iov_base = (char*)fragment.FragmentBuffer + skip;
+            vectors[count].iov_len = fragment.FragmentLength - skip;
+            skip = 0;
+            count++;
+        }
+        return count;
+    }
+
+    static bool isAcceptRateLimited(Shard& shard, unsigned int ip, long long now)
+    {
+        AcceptRate& rate = shard.acceptRates[ip];
+        if (now - rate.windowStartMs >= acceptRateWindowMs)
+        {
+            rate.windowStartMs = now;
+            rate.count = 0;
+        }
+        return ++rate.count > maxAcceptsPerIpPerWindow;
+    }
+
+    static void serviceAccept(Shard& shard, int listeningSocket, SocketState& state)
+    {
+        // Connections are only taken from the kernel backlog while someone waits for them
+        while (state.readable && !state.listenTokens.empty())
+        {
+            sockaddr_in address{};
+            socklen_t addressLength = sizeof(address);
+            int clientSocket = accept4(listeningSocket, (sockaddr*)&address, &addressLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (clientSocket < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    state.readable = false;
+                }
+                else if (errno != EINTR && errno != ECONNABORTED)
+                {
+                    logToConsole(L"Obtained tcpData failed");
+                    EFI_TCP4_LISTEN_TOKEN* listenToken = state.listenTokens.front();
+                    state.listenTokens.pop_front();
+                    complete(listenToken->CompletionToken, EFI_ABORTED);
+                }
+                continue;
+            }
+
+            if (isAcceptRateLimited(shard, address.sin_addr.s_addr, steadyMs()))
+            {
+                close(clientSocket);
+                numberOfRateLimitedConnections++;
+                continue;
+            }
+
+            EFI_TCP4_LISTEN_TOKEN* listenToken = state.listenTokens.front();
+            state.listenTokens.pop_front();
+            onAccepted(listenToken, clientSocket);
+            complete(listenToken->CompletionToken, EFI_SUCCESS);
+        }
+    }
+
+    static void finishConnect(int socket, SocketState& state, bool isConnected)
+    {
+        *state.connectStatus = isConnected ? ConnectStatus::Connected : ConnectStatus::Error;
+        complete(state.connectionToken->CompletionToken, isConnected ? EFI_SUCCESS : EFI_ABORTED);
+        state.connectionToken = nullptr;
+        state.connectStatus = nullptr;
+        state.closed = !isConnected;
+    }
+
+    static void serviceConnect(int socket, SocketState& state, unsigned int flags)
+    {
+        if (!(flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+        {
+            return;
+        }
+
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &errorLength) != 0)
+        {
+            error = errno;
+        }
+        finishConnect(socket, state, error == 0);
+    }
+
+    static void startConnect(Shard& shard, const Command& command)
+    {
+        SocketState& state = shard.sockets[command.socket];
+        state = SocketState();
+        state.connectionToken = command.connectionToken;
+        state.connectStatus = command.connectStatus;
+
+        if (::connect(command.socket, (const sockaddr*)&command.address, sizeof(command.address)) == 0)
+        {
+            finishConnect(command.socket, state, watch(shard, command.socket));
+        }
+        else if (errno != EINPROGRESS || !watch(shard, command.socket))
+        {
+            finishConnect(command.socket, state, false);
+        }
+        // otherwise the first EPOLLOUT/EPOLLERR reports the outcome
+    }
+
+    static void abortPending(SocketState& state)
+    {
+        if (state.receiveToken)
+        {
+            complete(state.receiveToken->CompletionToken, EFI_ABORTED);
+            state.receiveToken = nullptr;
+        }
+        if (state.transmitToken)
+        {
+            complete(state.transmitToken->CompletionToken, EFI_ABORTED);
+            state.transmitToken = nullptr;
+        }
+    }
+
+    static void removeSocket(Shard& shard, int socket)
+    {
+        auto it = shard.sockets.find(socket);
+        if (it != shard.sockets.end())
+        {
+            SocketState& state = it->second;
+            abortPending(state);
+            for (EFI_TCP4_LISTEN_TOKEN* listenToken : state.listenTokens)
+            {
+                complete(listenToken->CompletionToken, EFI_ABORTED);
+            }
+            // The connect status belongs to the instance that is being destroyed, only the token is completed
+            if (state.connectionToken)
+            {
+                complete(state.connectionToken->CompletionToken, EFI_ABORTED);
+            }
+            shard.sockets.erase(it);
+        }
+        for (size_t i = 0; i < shard.deferredConnects.size();)
+        {
+            if (shard.deferredConnects[i].socket == socket)
+            {
+                complete(shard.deferredConnects[i].connectionToken->CompletionToken, EFI_ABORTED);
+                shard.deferredConnects[i] = shard.deferredConnects.back();
+                shard.deferredConnects.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        // Unwatch before closing, the descriptor number can be reused as soon as it is closed
+        epoll_ctl(shard.epollFd, EPOLL_CTL_DEL, socket, nullptr);
+        shutdown(socket, SHUT_RDWR);
+        close(socket);
+    }
+
+    static void processCommands(Shard& shard)
+    {
+        std::vector<Command> commands;
+        {
+            std::lock_guard<std::mutex> lock(shard.commandLock);
+            commands.swap(shard.commands);
+        }
+
+        for (const Command& command : commands)
+        {
+            switch (command.type)
+            {
+            case CommandType::Add:
+            case CommandType::Listen:
+            {
+                SocketState& state = shard.sockets[command.socket];
+                state = SocketState();
+                state.isListening = (command.type == CommandType::Listen);
+                state.closed = !watch(shard, command.socket);
+                break;
+            }
+            case CommandType::Remove:
+                removeSocket(shard, command.socket);
+                break;
+            case CommandType::Receive:
+            case CommandType::Transmit:
+            {
+                auto it = shard.sockets.find(command.socket);
+                if (it == shard.sockets.end())
+                {
+                    complete(command.token->CompletionToken, EFI_ABORTED);
+                    break;
+                }
+                SocketState& state = it->second;
+                if (command.type == CommandType::Receive)
+                {
+                    state.receiveToken = command.token;
+                    serviceReceive(command.socket, state);
+                }
+                else
+                {
+                    state.transmitToken = command.token;
+                    state.transmittedBytes = 0;
+                    state.transmitStartMs = steadyMs();
+                    serviceTransmit(command.socket, state);
+                }
+                break;
+            }
+            case CommandType::Cancel:
+            {
+                auto it = shard.sockets.find(command.socket);
+                if (it != shard.sockets.end())
+                {
+                    it->second.closed = true;
+                    abortPending(it->second);
+                    shutdown(command.socket, SHUT_RDWR);
+                }
+                break;
+            }
+            case CommandType::Accept:
+            {
+                auto it = shard.sockets.find(command.socket);
+                if (it == shard.sockets.end() || !it->second.isListening)
+                {
+                    complete(command.listenToken->CompletionToken, EFI_ABORTED);
+                    break;
+                }
+                it->second.listenTokens.push_back(command.listenToken);
+                serviceAccept(shard, command.socket, it->second);
+                break;
+            }
+            case CommandType::Connect:
+                if (command.notBeforeMs > steadyMs())
+                {
+                    shard.deferredConnects.push_back(command);
+                }
+                else
+                {
+                    startConnect(shard, command);
+                }
+                break;
+            }
+        }
+    }
+
+    static void processTimers(Shard& shard)
+    {
+        const long long now = steadyMs();
+        if (now - shard.lastTimeoutScanMs < timeoutScanIntervalMs)
+        {
+            return;
+        }
+        shard.lastTimeoutScanMs = now;
+
+        for (auto& [socket, state] : shard.sockets)
+        {
+            if (state.transmitToken && now - state.transmitStartMs > transmitTimeoutMs)
+            {
+                complete(state.transmitToken->CompletionToken, EFI_TIMEOUT);
+                state.transmitToken = nullptr;
+            }
+        }
+
+        for (size_t i = 0; i < shard.deferredConnects.size();)
+        {
+            if (shard.deferredConnects[i].notBeforeMs <= now)
+            {
+                startConnect(shard, shard.deferredConnects[i]);
+                shard.deferredConnects[i] = shard.deferredConnects.back();
+                shard.deferredConnects.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        for (auto it = shard.acceptRates.begin(); it != shard.acceptRates.end();)
+        {
+            if (now - it->second.windowStartMs >= acceptRateWindowMs)
+            {
+                it = shard.acceptRates.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    static void shardProcessor(Shard* shard)
+    {
+        epoll_event events[maxEventsPerWait];
+        while (true)
+        {
+            int numberOfEvents = epoll_wait(shard->epollFd, events, maxEventsPerWait, timeoutScanIntervalMs);
+            for (int i = 0; i < numberOfEvents; i++)
+            {
+                const int socket = events[i].data.fd;
+                if (socket == shard->wakeFd)
+                {
+                    unsigned long long counter;
+                    read(shard->wakeFd, &counter, sizeof(counter));
+                    continue;
+                }
+
+                auto it = shard->sockets.find(socket);
+                if (it == shard->sockets.end())
+                {
+                    continue;
+                }
+
+                SocketState& state = it->second;
+                const unsigned int flags = events[i].events;
+                if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                {
+                    state.readable = true;
+                }
+                if (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                {
+                    state.writable = true;
+                }
+
+                if (state.isListening)
+                {
+                    serviceAccept(*shard, socket, state);
+                    continue;
+                }
+                if (state.connectionToken)
+                {
+                    serviceConnect(socket, state, flags);
+                }
+                serviceReceive(socket, state);
+                serviceTransmit(socket, state);
+            }
+
+            processCommands(*shard);
+            processTimers(*shard);
+        }
+    }
+};
@@ -42,6 +42,8 @@
 #define C3 0x7DD2D17C4625FA78
 #define C4 0x6BC57DEF56CE8877
 
+#define VERIFY_BATCH_MAX_SIZE 32 // Maximum number of signatures checked by one call of verifyBatch()
+
 #ifdef __AVX512F__
 static m256i B1, B2, B3, B4, C;
 
@@ -805,6 +807,62 @@ static void eccnorm(point_extproj_t P, point_t Q)
     mod1271(Q->y[1]);
 }
 
+static void eccnorm_batch(point_extproj_t* P, point_t* Q, unsigned int count)
+{ // Normalize count projective points with a single field inversion (Montgomery's simultaneous inversion),
+  // the results are identical to calling eccnorm() for each point. Z is never zero for points on the curve.
+    felm_t norms[VERIFY_BATCH_MAX_SIZE], products[VERIFY_BATCH_MAX_SIZE], t1, t2;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        fpsqr1271(P[i]->z[0], t1);
+        fpsqr1271(P[i]->z[1], t2);
+        fpadd1271(t1, t2, norms[i]);                // norms[i] = Z0^2 + Z1^2
+        if (i)
+        {
+            fpmul1271(products[i - 1], norms[i], products[i]);
+        }
+        else
+        {
+            products[0][0] = norms[0][0];
+            products[0][1] = norms[0][1];
+        }
+    }
+    if (!count)
+    {
+        return;
+    }
+
+    fpexp1251(products[count - 1], t2);             // t1 = products[count - 1]^-1
+    fpsqr1271(t2, t2);
+    fpsqr1271(t2, t2);
+    fpmul1271(products[count - 1], t2, t1);
+
+    for (unsigned int i = count; i--; )
+    {
+        if (i)
+        {
+            fpmul1271(t1, products[i - 1], t2);     // t2 = norms[i]^-1
+            fpmul1271(t1, norms[i], t1);
+        }
+        else
+        {
+            t2[0] = t1[0];
+            t2[1] = t1[1];
+        }
+
+        fpneg1271(P[i]->z[1]);                      // Z1 = Z1^-1
+        fpmul1271(P[i]->z[0], t2, P[i]->z[0]);
+        fpmul1271(P[i]->z[1], t2, P[i]->z[1]);
+
+        fp2mul1271(P[i]->x, P[i]->z, Q[i]->x);      // X1 = X1/Z1
+        fp2mul1271(P[i]->y, P[i]->z, Q[i]->y);      // Y1 = Y1/Z1
+        mod1271(Q[i]->x[0]);
+        mod1271(Q[i]->x[1]);
+        mod1271(Q[i]->y[0]);
+        mod1271(Q[i]->y[1]);
+    }
+}
+
 static void R1_to_R2(point_extproj_t P, point_extproj_precomp_t Q)
 { // Conversion from representation (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT), where T = Ta*Tb
     fp2add1271(P->ta, P->ta, Q->t2);                  // T = 2*Ta
@@ -1355,14 +1413,14 @@ static void ecc_precomp_double(point_extproj_t P, point_extproj_precomp_t* Table
     R1_to_R2(Q, Table[3]);                  // Converting from (X,Y,Z,Ta,Tb) to (X+Y,Y-X,2Z,2dT)
 }
 
-static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
-{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
+static bool ecc_mul_double_extproj(unsigned long long* k, unsigned long long* l, point_t Q, point_extproj_t T)
+{ // Double scalar multiplication T = k*G + l*Q, where the G is the generator, without normalizing T
   // Uses DOUBLE_SCALAR_TABLE, which contains multiples of G, Phi(G), Psi(G) and Phi(Psi(G))
   // The function uses wNAF with interleaving.
     char digits_k1[65], digits_k2[65], digits_k3[65], digits_k4[65];
     char digits_l1[65], digits_l2[65], digits_l3[65], digits_l4[65];
     point_precomp_t V;
-    point_extproj_t Q1, Q2, Q3, Q4, T;
+    point_extproj_t Q1, Q2, Q3, Q4;
     point_extproj_precomp_t U, Q_table1[4], Q_table2[4], Q_table3[4], Q_table4[4];
     unsigned long long k_scalars[4], l_scalars[4];
 
@@ -1497,6 +1555,18 @@ static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t
         }
     }
 
+    return true;
+}
+
+static bool ecc_mul_double(unsigned long long* k, unsigned long long* l, point_t Q)
+{ // Double scalar multiplication R = k*G + l*Q, where the G is the generator
+    point_extproj_t T;
+
+    if (!ecc_mul_double_extproj(k, l, Q, T))
+    {
+        return false;
+    }
+
     eccnorm(T, Q);
 
     return true;
@@ -1944,3 +2014,56 @@ static bool verify(const unsigned char* publicKey, const unsigned char* messageD
     encode(A, (unsigned char*)A);
     return *(const m256i*)A == *(const m256i*)signature;
 }
+
+static void verifyBatch(unsigned int count, const unsigned char* const* publicKeys, const unsigned char* const* messageDigests, const unsigned char* const* signatures, bool* results)
+{ // Batched SchnorrQ signature verification
+  // It verifies count <= VERIFY_BATCH_MAX_SIZE signatures with exactly the same outcome as verify(), but normalizes
+  // all resulting points with a single field inversion
+  // Inputs: arrays of 32-byte PublicKeys, 64-byte Signatures, and MessageDigests of size 32 in bytes
+  // Output: results[i] is TRUE if signature i is valid, FALSE otherwise
+    point_extproj_t T[VERIFY_BATCH_MAX_SIZE];
+    point_t R[VERIFY_BATCH_MAX_SIZE];
+    unsigned int indices[VERIFY_BATCH_MAX_SIZE];
+    unsigned int numberOfPoints = 0;
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        const unsigned char* publicKey = publicKeys[i];
+        const unsigned char* signature = signatures[i];
+        point_t A;
+        unsigned char temp[32 + 64], h[64];
+
+        results[i] = false;
+
+        if ((publicKey[15] & 0x80) || (signature[15] & 0x80) || (signature[62] & 0xC0) || signature[63])
+        {
+            continue;
+        }
+
+        if (!decode(publicKey, A))
+        {
+            continue;
+        }
+
+        *((m256i*)temp) = *((m256i*)signature);
+        *((m256i*)(temp + 32)) = *((m256i*)publicKey);
+        *((m256i*)(temp + 64)) = *((m256i*)messageDigests[i]);
+
+        KangarooTwelve(temp, 32 + 64, h, 64);
+
+        if (!ecc_mul_double_extproj((unsigned long long*)(signature + 32), (unsigned long long*)h, A, T[numberOfPoints]))
+        {
+            continue;
+        }
+
+        indices[numberOfPoints++] = i;
+    }
+
+    eccnorm_batch(T, R, numberOfPoints);
+
+    for (unsigned int j = 0; j < numberOfPoints; j++)
+    {
+        encode(R[j], (unsigned char*)R[j]);
+        results[indices[j]] = *(const m256i*)R[j] == *(const m256i*)signatures[indices[j]];
+    }
+}
@@ -2495,6 +2495,179 @@ static void KangarooTwelve64To32(const void* input, void* output)
     KangarooTwelve64To32((const unsigned char*)input, (unsigned char*)output);
 }
 
+// Multi-buffer variant of KangarooTwelve64To32 for hashing Merkle tree levels: the 64-byte inputs are independent, so
+// several of them are run through Keccak-p[1600, 12] at once with one instance per 64-bit vector element (8 with
+// AVX-512, 4 with AVX2). The kernel is selected at compile time like the rest of this file, the remainder that doesn't
+// fill a vector goes through the scalar KangarooTwelve64To32. Output is identical to calling KangarooTwelve64To32
+// for each input.
+
+#if defined (__AVX512F__)
+#define K12_MULTI_WIDTH 8
+typedef __m512i K12MultiLanes;
+#define K12MultiXor(a, b) _mm512_xor_si512(a, b)
+#define K12MultiAndNot(a, b) _mm512_andnot_si512(a, b)
+#define K12MultiRol(a, offset) _mm512_rol_epi64(a, offset)
+#define K12MultiConst(value) _mm512_set1_epi64(value)
+#elif defined (__AVX2__)
+#define K12_MULTI_WIDTH 4
+typedef __m256i K12MultiLanes;
+#define K12MultiXor(a, b) _mm256_xor_si256(a, b)
+#define K12MultiAndNot(a, b) _mm256_andnot_si256(a, b)
+#define K12MultiRol(a, offset) _mm256_or_si256(_mm256_slli_epi64(a, offset), _mm256_srli_epi64(a, 64 - (offset)))
+#define K12MultiConst(value) _mm256_set1_epi64x(value)
+#endif
+
+#ifdef K12_MULTI_WIDTH
+// One round of Keccak-p[1600] on the lanes A0 ... A24 (lane x + 5 * y in Ai), using B0 ... B24, C0 ... C4, D0 ... D4
+#define K12MultiRound(roundConstant) \
+    C0 = K12MultiXor(K12MultiXor(K12MultiXor(A0, A5), K12MultiXor(A10, A15)), A20);   \
+    C1 = K12MultiXor(K12MultiXor(K12MultiXor(A1, A6), K12MultiXor(A11, A16)), A21);   \
+    C2 = K12MultiXor(K12MultiXor(K12MultiXor(A2, A7), K12MultiXor(A12, A17)), A22);   \
+    C3 = K12MultiXor(K12MultiXor(K12MultiXor(A3, A8), K12MultiXor(A13, A18)), A23);   \
+    C4 = K12MultiXor(K12MultiXor(K12MultiXor(A4, A9), K12MultiXor(A14, A19)), A24);   \
+    D0 = K12MultiXor(C4, K12MultiRol(C1, 1));                                         \
+    D1 = K12MultiXor(C0, K12MultiRol(C2, 1));                                         \
+    D2 = K12MultiXor(C1, K12MultiRol(C3, 1));                                         \
+    D3 = K12MultiXor(C2, K12MultiRol(C4, 1));                                         \
+    D4 = K12MultiXor(C3, K12MultiRol(C0, 1));                                         \
+    B0 = K12MultiXor(A0, D0);                                                         \
+    B10 = K12MultiRol(K12MultiXor(A1, D1), 1);                                        \
+    B20 = K12MultiRol(K12MultiXor(A2, D2), 62);                                       \
+    B5 = K12MultiRol(K12MultiXor(A3, D3), 28);                                        \
+    B15 = K12MultiRol(K12MultiXor(A4, D4), 27);                                       \
+    B16 = K12MultiRol(K12MultiXor(A5, D0), 36);                                       \
+    B1 = K12MultiRol(K12MultiXor(A6, D1), 44);                                        \
+    B11 = K12MultiRol(K12MultiXor(A7, D2), 6);                                        \
+    B21 = K12MultiRol(K12MultiXor(A8, D3), 55);                                       \
+    B6 = K12MultiRol(K12MultiXor(A9, D4), 20);                                        \
+    B7 = K12MultiRol(K12MultiXor(A10, D0), 3);                                        \
+    B17 = K12MultiRol(K12MultiXor(A11, D1), 10);                                      \
+    B2 = K12MultiRol(K12MultiXor(A12, D2), 43);                                       \
+    B12 = K12MultiRol(K12MultiXor(A13, D3), 25);                                      \
+    B22 = K12MultiRol(K12MultiXor(A14, D4), 39);                                      \
+    B23 = K12MultiRol(K12MultiXor(A15, D0), 41);                                      \
+    B8 = K12MultiRol(K12MultiXor(A16, D1), 45);                                       \
+    B18 = K12MultiRol(K12MultiXor(A17, D2), 15);                                      \
+    B3 = K12MultiRol(K12MultiXor(A18, D3), 21);                                       \
+    B13 = K12MultiRol(K12MultiXor(A19, D4), 8);                                       \
+    B14 = K12MultiRol(K12MultiXor(A20, D0), 18);                                      \
+    B24 = K12MultiRol(K12MultiXor(A21, D1), 2);                                       \
+    B9 = K12MultiRol(K12MultiXor(A22, D2), 61);                                       \
+    B19 = K12MultiRol(K12MultiXor(A23, D3), 56);                                      \
+    B4 = K12MultiRol(K12MultiXor(A24, D4), 14);                                       \
+    A0 = K12MultiXor(B0, K12MultiAndNot(B1, B2));                                     \
+    A1 = K12MultiXor(B1, K12MultiAndNot(B2, B3));                                     \
+    A2 = K12MultiXor(B2, K12MultiAndNot(B3, B4));                                     \
+    A3 = K12MultiXor(B3, K12MultiAndNot(B4, B0));                                     \
+    A4 = K12MultiXor(B4, K12MultiAndNot(B0, B1));                                     \
+    A5 = K12MultiXor(B5, K12MultiAndNot(B6, B7));                                     \
+    A6 = K12MultiXor(B6, K12MultiAndNot(B7, B8));                                     \
+    A7 = K12MultiXor(B7, K12MultiAndNot(B8, B9));                                     \
+    A8 = K12MultiXor(B8, K12MultiAndNot(B9, B5));                                     \
+    A9 = K12MultiXor(B9, K12MultiAndNot(B5, B6));                                     \
+    A10 = K12MultiXor(B10, K12MultiAndNot(B11, B12));                                 \
+    A11 = K12MultiXor(B11, K12MultiAndNot(B12, B13));                                 \
+    A12 = K12MultiXor(B12, K12MultiAndNot(B13, B14));                                 \
+    A13 = K12MultiXor(B13, K12MultiAndNot(B14, B10));                                 \
+    A14 = K12MultiXor(B14, K12MultiAndNot(B10, B11));                                 \
+    A15 = K12MultiXor(B15, K12MultiAndNot(B16, B17));                                 \
+    A16 = K12MultiXor(B16, K12MultiAndNot(B17, B18));                                 \
+    A17 = K12MultiXor(B17, K12MultiAndNot(B18, B19));                                 \
+    A18 = K12MultiXor(B18, K12MultiAndNot(B19, B15));                                 \
+    A19 = K12MultiXor(B19, K12MultiAndNot(B15, B16));                                 \
+    A20 = K12MultiXor(B20, K12MultiAndNot(B21, B22));                                 \
+    A21 = K12MultiXor(B21, K12MultiAndNot(B22, B23));                                 \
+    A22 = K12MultiXor(B22, K12MultiAndNot(B23, B24));                                 \
+    A23 = K12MultiXor(B23, K12MultiAndNot(B24, B20));                                 \
+    A24 = K12MultiXor(B24, K12MultiAndNot(B20, B21));                                 \
+    A0 = K12MultiXor(A0, K12MultiConst(roundConstant));
+#endif
+
+// Hash count consecutive 64-byte inputs to count consecutive 32-byte digests
+static void KangarooTwelve64To32Multi(const void* inputs, void* outputs, unsigned int count)
+{
+    const unsigned long long* input = (const unsigned long long*)inputs;
+    unsigned long long* output = (unsigned long long*)outputs;
+
+#ifdef K12_MULTI_WIDTH
+    for (; count >= K12_MULTI_WIDTH; count -= K12_MULTI_WIDTH, input += 8 * K12_MULTI_WIDTH, output += 4 * K12_MULTI_WIDTH)
+    {
+        K12MultiLanes A0, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15, A16, A17, A18, A19, A20, A21, A22, A23, A24;
+        K12MultiLanes B0, B1, B2, B3, B4, B5, B6, B7, B8, B9, B10, B11, B12, B13, B14, B15, B16, B17, B18, B19, B20, B21, B22, B23, B24;
+        K12MultiLanes C0, C1, C2, C3, C4, D0, D1, D2, D3, D4;
+
+        // The 8 input lanes of each instance are the first 8 lanes of its state, suffix and padding as in KangarooTwelve64To32
+#if K12_MULTI_WIDTH == 8
+        const __m512i inputOffsets = _mm512_set_epi64(56, 48, 40, 32, 24, 16, 8, 0);
+        A0 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 0), 8);
+        A1 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 1), 8);
+        A2 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 2), 8);
+        A3 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 3), 8);
+        A4 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 4), 8);
+        A5 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 5), 8);
+        A6 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 6), 8);
+        A7 = _mm512_i64gather_epi64(inputOffsets, (const long long*)(input + 7), 8);
+#else
+        __m256i t0 = _mm256_unpacklo_epi64(_mm256_loadu_si256((const __m256i*)input), _mm256_loadu_si256((const __m256i*)(input + 8)));
+        __m256i t1 = _mm256_unpackhi_epi64(_mm256_loadu_si256((const __m256i*)input), _mm256_loadu_si256((const __m256i*)(input + 8)));
+        __m256i t2 = _mm256_unpacklo_epi64(_mm256_loadu_si256((const __m256i*)(input + 16)), _mm256_loadu_si256((const __m256i*)(input + 24)));
+        __m256i t3 = _mm256_unpackhi_epi64(_mm256_loadu_si256((const __m256i*)(input + 16)), _mm256_loadu_si256((const __m256i*)(input + 24)));
+        A0 = _mm256_permute2x128_si256(t0, t2, 0x20);
+        A1 = _mm256_permute2x128_si256(t1, t3, 0x20);
+        A2 = _mm256_permute2x128_si256(t0, t2, 0x31);
+        A3 = _mm256_permute2x128_si256(t1, t3, 0x31);
+        t0 = _mm256_unpacklo_epi64(_mm256_loadu_si256((const __m256i*)(input + 4)), _mm256_loadu_si256((const __m256i*)(input + 12)));
+        t1 = _mm256_unpackhi_epi64(_mm256_loadu_si256((const __m256i*)(input + 4)), _mm256_loadu_si256((const __m256i*)(input + 12)));
+        t2 = _mm256_unpacklo_epi64(_mm256_loadu_si256((const __m256i*)(input + 20)), _mm256_loadu_si256((const __m256i*)(input + 28)));
+        t3 = _mm256_unpackhi_epi64(_mm256_loadu_si256((const __m256i*)(input + 20)), _mm256_loadu_si256((const __m256i*)(input + 28)));
+        A4 = _mm256_permute2x128_si256(t0, t2, 0x20);
+        A5 = _mm256_permute2x128_si256(t1, t3, 0x20);
+        A6 = _mm256_permute2x128_si256(t0, t2, 0x31);
+        A7 = _mm256_permute2x128_si256(t1, t3, 0x31);
+#endif
+        A8 = K12MultiConst(0x0700);
+        A9 = A10 = A11 = A12 = A13 = A14 = A15 = A16 = A17 = A18 = A19 = A21 = A22 = A23 = A24 = K12MultiConst(0);
+        A20 = K12MultiConst(0x8000000000000000ULL);
+
+        K12MultiRound(KeccakF1600RoundConstant0);
+        K12MultiRound(KeccakF1600RoundConstant1);
+        K12MultiRound(KeccakF1600RoundConstant2);
+        K12MultiRound(KeccakF1600RoundConstant3);
+        K12MultiRound(KeccakF1600RoundConstant4);
+        K12MultiRound(KeccakF1600RoundConstant5);
+        K12MultiRound(KeccakF1600RoundConstant6);
+        K12MultiRound(KeccakF1600RoundConstant7);
+        K12MultiRound(KeccakF1600RoundConstant8);
+        K12MultiRound(KeccakF1600RoundConstant9);
+        K12MultiRound(KeccakF1600RoundConstant10);
+        K12MultiRound(0x8000000080008008ULL);
+
+        // The first 4 lanes of each state are its digest
+#if K12_MULTI_WIDTH == 8
+        const __m512i outputOffsets = _mm512_set_epi64(28, 24, 20, 16, 12, 8, 4, 0);
+        _mm512_i64scatter_epi64((long long*)(output + 0), outputOffsets, A0, 8);
+        _mm512_i64scatter_epi64((long long*)(output + 1), outputOffsets, A1, 8);
+        _mm512_i64scatter_epi64((long long*)(output + 2), outputOffsets, A2, 8);
+        _mm512_i64scatter_epi64((long long*)(output + 3), outputOffsets, A3, 8);
+#else
+        t0 = _mm256_unpacklo_epi64(A0, A1);
+        t1 = _mm256_unpackhi_epi64(A0, A1);
+        t2 = _mm256_unpacklo_epi64(A2, A3);
+        t3 = _mm256_unpackhi_epi64(A2, A3);
+        _mm256_storeu_si256((__m256i*)output, _mm256_permute2x128_si256(t0, t2, 0x20));
+        _mm256_storeu_si256((__m256i*)(output + 4), _mm256_permute2x128_si256(t1, t3, 0x20));
+        _mm256_storeu_si256((__m256i*)(output + 8), _mm256_permute2x128_si256(t0, t2, 0x31));
+        _mm256_storeu_si256((__m256i*)(output + 12), _mm256_permute2x128_si256(t1, t3, 0x31));
+#endif
+    }
+#endif
+
+    for (; count; count--, input += 8, output += 4)
+    {
+        KangarooTwelve64To32(input, output);
+    }
+}
+
 static void random(const unsigned char* publicKey, const unsigned char* nonce, unsigned char* output, unsigned long long outputSize)
 {
     unsigned char state[200];
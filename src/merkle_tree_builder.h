@@ -0,0 +1,131 @@
+#pragma once
+
+#include "platform/global_var.h"
+#include "platform/m256.h"
+#include "platform/concurrency.h"
+#include "platform/profiling.h"
+
+#include "kangaroo_twelve.h"
+
+// Builds a complete Merkle tree on several processors at once. The digests are stored level by level as in
+// spectrumDigests and assetDigests: the leaves in [0, capacity), followed by each upper level up to the root at
+// (capacity * 2 - 1) - 1.
+//
+// The leaves are split into subtrees that are hashed independently up to their roots. The processor calling build()
+// works on the subtrees itself and idle processors join by calling help(), which returns immediately if no build is
+// running. When all subtrees are done, the calling processor hashes the few levels above them. The digests are the
+// same as when hashing the whole tree on one processor.
+class MerkleTreeBuilder
+{
+public:
+    // Compute the digests of count leaves starting at firstIndex from the array of records
+    typedef void (*LeafHashFunction)(const void* records, unsigned int firstIndex, unsigned int count, m256i* digests);
+
+    static constexpr unsigned int maxNumberOfSubtrees = 256;
+
+    // Hash all records and build the tree in digests. capacity must be a power of 2. Builds don't run in parallel,
+    // a second call waits until the first one is finished.
+    void build(const void* records, unsigned int capacity, LeafHashFunction hashLeaf, m256i* digests)
+    {
+        PROFILE_SCOPE();
+
+        ACQUIRE(buildLock);
+
+        ACQUIRE(subtreeLock);
+        this->records = records;
+        this->capacity = capacity;
+        this->hashLeaf = hashLeaf;
+        this->digests = digests;
+        numberOfSubtrees = (capacity >= maxNumberOfSubtrees * 2) ? maxNumberOfSubtrees : 1;
+        nextSubtree = 0;
+        numberOfFinishedSubtrees = 0;
+        isBuilding = true;
+        RELEASE(subtreeLock);
+
+        while (help())
+        {
+        }
+        while (numberOfFinishedSubtrees < numberOfSubtrees)
+        {
+            _mm_pause();
+        }
+        isBuilding = false;
+
+        // Hash the levels above the roots of the subtrees
+        unsigned int levelBeginning = 0;
+        unsigned int numberOfNodes = capacity;
+        while (numberOfNodes > numberOfSubtrees)
+        {
+            levelBeginning += numberOfNodes;
+            numberOfNodes >>= 1;
+        }
+        while (numberOfNodes > 1)
+        {
+            KangarooTwelve64To32Multi(&digests[levelBeginning], &digests[levelBeginning + numberOfNodes], numberOfNodes >> 1);
+            levelBeginning += numberOfNodes;
+            numberOfNodes >>= 1;
+        }
+
+        RELEASE(buildLock);
+    }
+
+    // Hash one subtree of the running build, if there is any left. Can be called by any processor.
+    bool help()
+    {
+        if (!isBuilding)
+        {
+            return false;
+        }
+
+        ACQUIRE(subtreeLock);
+        if (!isBuilding || nextSubtree >= numberOfSubtrees)
+        {
+            RELEASE(subtreeLock);
+            return false;
+        }
+        const unsigned int subtree = nextSubtree++;
+        RELEASE(subtreeLock);
+
+        // The build cannot finish before this subtree is done, so its parameters stay valid until then
+        hashSubtree(subtree);
+
+        _InterlockedIncrement(&numberOfFinishedSubtrees);
+
+        return true;
+    }
+
+private:
+    void hashSubtree(unsigned int subtree)
+    {
+        unsigned int numberOfSubtreeNodes = capacity / numberOfSubtrees;
+        unsigned int firstNode = subtree * numberOfSubtreeNodes;
+        hashLeaf(records, firstNode, numberOfSubtreeNodes, &digests[firstNode]);
+
+        // The pairs of a level are consecutive, so each level of the subtree is one multi-buffer call
+        unsigned int levelBeginning = 0;
+        unsigned int numberOfNodes = capacity;
+        while (numberOfSubtreeNodes > 1)
+        {
+            KangarooTwelve64To32Multi(&digests[levelBeginning + firstNode], &digests[levelBeginning + numberOfNodes + (firstNode >> 1)], numberOfSubtreeNodes >> 1);
+            levelBeginning += numberOfNodes;
+            numberOfNodes >>= 1;
+            firstNode >>= 1;
+            numberOfSubtreeNodes >>= 1;
+        }
+    }
+
+    volatile char buildLock = 0;
+    volatile char subtreeLock = 0;
+    volatile bool isBuilding = false;
+
+    const void* records = nullptr;
+    unsigned int capacity = 0;
+    LeafHashFunction hashLeaf = nullptr;
+    m256i* digests = nullptr;
+
+    unsigned int numberOfSubtrees = 0;
+    unsigned int nextSubtree = 0;
+    volatile long numberOfFinishedSubtrees = 0;
+};
+
+GLOBAL_VAR_DECL MerkleTreeBuilder merkleTreeBuilder;
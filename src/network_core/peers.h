@@ -8,10 +8,9 @@
 #include "platform/random.h"
 #include "platform/concurrency.h"
 #include "platform/profiling.h"
+#include "platform/wait_on_address.h"
 
-#include "network_messages/common_def.h"
-#include "network_messages/header.h"
-#include "network_messages/common_response.h"
+#include "network_messages/all.h"
 
 #include "tcp4.h"
 #include "kangaroo_twelve.h"
@@ -36,6 +35,10 @@
 #define MAX_NUMBER_OF_PUBLIC_PEERS 1024
 #define REQUEST_QUEUE_BUFFER_SIZE (1073741824 / NETWORK_QUEUEUE_REDUCED_TIME)
 #define REQUEST_QUEUE_LENGTH 65536 // Must be 65536
+#define NUMBER_OF_REQUEST_QUEUE_LANES 3
+#define REQUEST_QUEUE_LANE_CONSENSUS 0 // ticks, votes, computors, tick data and peer exchange
+#define REQUEST_QUEUE_LANE_TRANSACTIONS 1 // broadcast transactions and messages
+#define REQUEST_QUEUE_LANE_QUERIES 2 // everything else (entities, assets, contract functions, logs, ...)
 #define RESPONSE_QUEUE_BUFFER_SIZE (1073741824 / NETWORK_QUEUEUE_REDUCED_TIME)
 #define RESPONSE_QUEUE_LENGTH 65536 // Must be 65536
 #define NUMBER_OF_PUBLIC_PEERS_TO_KEEP 10
@@ -156,11 +159,41 @@ static volatile long long numberOfDisseminatedRequests = 0, prevNumberOfDissemin
 static unsigned char* requestQueueBuffer = NULL;
 static unsigned char* responseQueueBuffer = NULL;
 
-static struct Request
+struct Request
 {
     Peer* peer;
-    unsigned int offset;
-} requestQueueElements[REQUEST_QUEUE_LENGTH];
+    unsigned int offset; // in requestQueueBuffer
+    unsigned int size;
+    volatile char isProcessed;
+};
+
+// The request queue is split into lanes by message class, each with its own part of requestQueueBuffer and its own
+// element ring, so a flood of queries can neither fill the space of consensus traffic nor delay its processing.
+static struct RequestQueueLane
+{
+    // Part of requestQueueBuffer owned by the lane, bufferHead and bufferTail are relative to bufferBegin
+    unsigned int bufferBegin, bufferSize;
+    volatile unsigned int bufferHead, bufferTail;
+
+    // Positions are free-running counters (element index is position % REQUEST_QUEUE_LENGTH), so the compare-and-swap
+    // claiming an element cannot suffer from ABA when the ring wraps around.
+    // Elements in [released, tail) are claimed by request processors, elements in [tail, head) wait to be claimed.
+    volatile long long elementHead, elementTail, elementReleased;
+
+    volatile long long numberOfDiscardedRequests, prevNumberOfDiscardedRequests;
+
+    Request elements[REQUEST_QUEUE_LENGTH];
+} requestQueueLanes[NUMBER_OF_REQUEST_QUEUE_LANES];
+
+// Bounds of the lane parts of requestQueueBuffer, in eighths of REQUEST_QUEUE_BUFFER_SIZE
+static constexpr unsigned int requestQueueLaneBufferBounds[NUMBER_OF_REQUEST_QUEUE_LANES + 1] = { 0, 2, 4, 8 };
+static_assert(REQUEST_QUEUE_BUFFER_SIZE / 8 * 2 >= 2 * BUFFER_SIZE, "Each request queue lane must fit at least two maximum size messages");
+
+// Weighted round-robin order in which request processors serve the lanes (consensus 4, transactions 3, queries 1)
+static constexpr unsigned char requestQueueLaneSchedule[8] = {
+    REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_TRANSACTIONS, REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_QUERIES,
+    REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_TRANSACTIONS, REQUEST_QUEUE_LANE_CONSENSUS, REQUEST_QUEUE_LANE_TRANSACTIONS
+};
 
 static struct Response
 {
@@ -168,11 +201,10 @@ static struct Response
     unsigned int offset;
 } responseQueueElements[RESPONSE_QUEUE_LENGTH];
 
-static volatile unsigned int requestQueueBufferHead = 0, requestQueueBufferTail = 0;
 static volatile unsigned int responseQueueBufferHead = 0, responseQueueBufferTail = 0;
-static volatile unsigned short requestQueueElementHead = 0, requestQueueElementTail = 0;
 static volatile unsigned short responseQueueElementHead = 0, responseQueueElementTail = 0;
-static volatile char requestQueueTailLock = 0;
+static volatile int requestQueueWakeSequence = 0;
+static volatile long requestQueueNumberOfWaitingProcessors = 0;
 static volatile char responseQueueHeadLock = 0;
 static volatile unsigned long long queueProcessingNumerator = 0, queueProcessingDenominator = 0;
 static volatile unsigned long long tickerLoopNumerator = 0, tickerLoopDenominator = 0;
@@ -673,9 +705,194 @@ static bool peerConnectionNewlyEstablished(unsigned int i)
     return false;
 }
 
+// Set up the lane parts of requestQueueBuffer, called once after allocating the buffer.
+static void initRequestQueueLanes()
+{
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        RequestQueueLane& lane = requestQueueLanes[laneIndex];
+        lane.bufferBegin = REQUEST_QUEUE_BUFFER_SIZE / 8 * requestQueueLaneBufferBounds[laneIndex];
+        lane.bufferSize = REQUEST_QUEUE_BUFFER_SIZE / 8 * (requestQueueLaneBufferBounds[laneIndex + 1] - requestQueueLaneBufferBounds[laneIndex]);
+        lane.bufferHead = lane.bufferTail = 0;
+        lane.elementHead = lane.elementTail = lane.elementReleased = 0;
+    }
+}
+
+// Lane that a request of the given type is queued in.
+static unsigned int requestQueueLaneOf(unsigned char type)
+{
+    switch (type)
+    {
+    case ExchangePublicPeers::type():
+    case BroadcastComputors::type():
+    case BroadcastTick::type():
+    case BroadcastFutureTickData::type():
+    case RequestComputors::type():
+    case RequestQuorumTick::type():
+    case RequestTickData::type():
+    case RequestTickTransactions::type():
+    case RespondCurrentTickInfo::type():
+    case SpecialCommand::type():
+        return REQUEST_QUEUE_LANE_CONSENSUS;
+
+    case BroadcastMessage::type():
+    case BROADCAST_TRANSACTION:
+        return REQUEST_QUEUE_LANE_TRANSACTIONS;
+
+    default:
+        return REQUEST_QUEUE_LANE_QUERIES;
+    }
+}
+
+// Advance the released position of a lane over the processed prefix of its claimed requests. Only called by the
+// main thread, which is the single producer of the request queue.
+static void reclaimProcessedRequests(RequestQueueLane& lane)
+{
+    while (lane.elementReleased != lane.elementTail)
+    {
+        Request& request = lane.elements[lane.elementReleased & (REQUEST_QUEUE_LENGTH - 1)];
+        if (!request.isProcessed)
+        {
+            break;
+        }
+        request.isProcessed = 0;
+        lane.bufferTail += request.size;
+        if (lane.bufferTail > lane.bufferSize - BUFFER_SIZE)
+        {
+            lane.bufferTail = 0;
+        }
+        lane.elementReleased++;
+    }
+}
+
+// Copy a received message into the lane of its type and wake up a waiting request processor. Only called by the
+// main thread. Returns false (and counts the drop for the lane) if the lane is full.
+static bool enqueueRequest(Peer* peer, const RequestResponseHeader* requestResponseHeader)
+{
+    RequestQueueLane& lane = requestQueueLanes[requestQueueLaneOf(requestResponseHeader->type())];
+    const unsigned int size = requestResponseHeader->size();
+
+    reclaimProcessedRequests(lane);
+    const unsigned int nextBufferHead = (lane.bufferHead + size > lane.bufferSize - BUFFER_SIZE) ? 0 : lane.bufferHead + size;
+    if ((lane.bufferHead < lane.bufferTail && lane.bufferHead + size >= lane.bufferTail)
+        || (lane.bufferHead >= lane.bufferTail && nextBufferHead == lane.bufferTail) // wrapping onto the tail would look like an empty lane
+        || lane.elementHead - lane.elementReleased >= REQUEST_QUEUE_LENGTH - 1)
+    {
+        _InterlockedIncrement64(&lane.numberOfDiscardedRequests);
+        return false;
+    }
+
+    ASSERT(lane.bufferHead < lane.bufferSize);
+    ASSERT(lane.bufferHead + size < lane.bufferSize);
+
+    Request& request = lane.elements[lane.elementHead & (REQUEST_QUEUE_LENGTH - 1)];
+    request.peer = peer;
+    request.offset = lane.bufferBegin + lane.bufferHead;
+    request.size = size;
+    copyMem(&requestQueueBuffer[request.offset], requestResponseHeader, size);
+    lane.bufferHead = nextBufferHead;
+
+    // Publish the element (full fence, orders the writes above and the waiter check below)
+    ATOMIC_STORE64(lane.elementHead, lane.elementHead + 1);
+    if (requestQueueNumberOfWaitingProcessors)
+    {
+        requestQueueWakeSequence++;
+        wakeByAddressSingle(&requestQueueWakeSequence);
+    }
+
+    return true;
+}
+
+// Claim the oldest unclaimed request of a lane. May be called concurrently by all request processors.
+// Returns NULL if the lane is empty.
+static Request* claimRequest(RequestQueueLane& lane)
+{
+    long long tail = lane.elementTail;
+    while (tail != lane.elementHead)
+    {
+        const long long observedTail = _InterlockedCompareExchange64(&lane.elementTail, tail + 1, tail);
+        if (observedTail == tail)
+        {
+            return &lane.elements[tail & (REQUEST_QUEUE_LENGTH - 1)];
+        }
+        tail = observedTail;
+    }
+    return NULL;
+}
+
+// Claim the oldest unclaimed request of a lane only if it has the given message type. Returns NULL otherwise.
+static Request* claimRequest(RequestQueueLane& lane, unsigned char type)
+{
+    long long tail = lane.elementTail;
+    while (tail != lane.elementHead)
+    {
+        Request& request = lane.elements[tail & (REQUEST_QUEUE_LENGTH - 1)];
+        // The peeked type is only relied on if the claim succeeds, that is, if nobody claimed the element in between
+        if (((RequestResponseHeader*)&requestQueueBuffer[request.offset])->type() != type)
+        {
+            return NULL;
+        }
+        const long long observedTail = _InterlockedCompareExchange64(&lane.elementTail, tail + 1, tail);
+        if (observedTail == tail)
+        {
+            return &request;
+        }
+        tail = observedTail;
+    }
+    return NULL;
+}
+
+// Claim the next request following the weighted lane schedule. If the scheduled lane is empty, the other lanes are
+// tried in order of priority. The message is processed in place in requestQueueBuffer and has to be handed back with
+// releaseRequest() afterwards. Returns NULL if all lanes are empty.
+static Request* claimRequest(unsigned int& scheduleSlot)
+{
+    const unsigned int scheduledLane = requestQueueLaneSchedule[scheduleSlot++ % (sizeof(requestQueueLaneSchedule) / sizeof(requestQueueLaneSchedule[0]))];
+    Request* request = claimRequest(requestQueueLanes[scheduledLane]);
+    for (unsigned int laneIndex = 0; !request && laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        if (laneIndex != scheduledLane)
+        {
+            request = claimRequest(requestQueueLanes[laneIndex]);
+        }
+    }
+    return request;
+}
+
+// Mark a claimed request as processed, allowing the main thread to reuse its space in the queue.
+static void releaseRequest(Request* request)
+{
+    ATOMIC_STORE8(request->isProcessed, 1);
+}
+
+static bool isRequestQueueEmpty()
+{
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        if (requestQueueLanes[laneIndex].elementTail != requestQueueLanes[laneIndex].elementHead)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Park a request processor until a new request is enqueued or the timeout elapses.
+static void waitForRequests(unsigned int timeoutMilliseconds)
+{
+    const int wakeSequence = requestQueueWakeSequence;
+    _InterlockedIncrement(&requestQueueNumberOfWaitingProcessors);
+    // Re-check after announcing the waiter, the producer checks the number of waiters after publishing the head
+    if (isRequestQueueEmpty())
+    {
+        waitOnAddress(&requestQueueWakeSequence, wakeSequence, timeoutMilliseconds);
+    }
+    _InterlockedDecrement(&requestQueueNumberOfWaitingProcessors);
+}
+
 // This function process all data that arrive in FragmentBuffer.
 // based on RequestResponseHeader to determine whether the received packet is completed or not
-// if it receives a completed packet, it will copy the packet to requestQueueElements to process later in requestProcessors
+// if it receives a completed packet, it will copy the packet to requestQueueLanes to process later in requestProcessors
 static void processReceivedData(unsigned int i, unsigned int salt)
 {
     PROFILE_SCOPE();
@@ -737,26 +954,10 @@ static void processReceivedData(unsigned int i, unsigned int salt)
                                 // (or drop it without processing if Dejavu filter tells to ignore it)
                                 if (!((dejavu0[saltedId >> 6] | dejavu1[saltedId >> 6]) & (1ULL << (saltedId & 63))))
                                 {
-                                    if ((requestQueueBufferHead >= requestQueueBufferTail || requestQueueBufferHead + requestResponseHeader->size() < requestQueueBufferTail)
-                                        && (unsigned short)(requestQueueElementHead + 1) != requestQueueElementTail)
+                                    if (enqueueRequest(&peers[i], requestResponseHeader))
                                     {
                                         dejavu0[saltedId >> 6] |= (1ULL << (saltedId & 63));
 
-                                        ASSERT(requestQueueElementHead < REQUEST_QUEUE_LENGTH);
-                                        ASSERT(requestQueueBufferHead < REQUEST_QUEUE_BUFFER_SIZE);
-                                        ASSERT(requestQueueBufferHead + requestResponseHeader->size() < REQUEST_QUEUE_BUFFER_SIZE);
-
-                                        requestQueueElements[requestQueueElementHead].offset = requestQueueBufferHead;
-                                        copyMem(&requestQueueBuffer[requestQueueBufferHead], peers[i].receiveBuffer, requestResponseHeader->size());
-                                        requestQueueBufferHead += requestResponseHeader->size();
-                                        requestQueueElements[requestQueueElementHead].peer = &peers[i];
-                                        if (requestQueueBufferHead > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                                        {
-                                            requestQueueBufferHead = 0;
-                                        }
-                                        // TODO: Place a fence
-                                        requestQueueElementHead++;
-
                                         if (!(--dejavuSwapCounter))
                                         {
                                             unsigned long long* tmp = dejavu1;
@@ -890,8 +1091,12 @@ static void transmitData(unsigned int i, unsigned int salt)
             }
             else
             {
-                // initiate transmission
-                copyMem(peers[i].transmitData.FragmentTable[0].FragmentBuffer, peers[i].dataToTransmit, peers[i].transmitData.DataLength = peers[i].transmitData.FragmentTable[0].FragmentLength = peers[i].dataToTransmitSize);
+                // initiate transmission: both buffers have BUFFER_SIZE, so instead of copying the batched messages
+                // into the fragment buffer they are swapped and the old fragment buffer collects the next batch
+                char* batchedData = peers[i].dataToTransmit;
+                peers[i].dataToTransmit = (char*)peers[i].transmitData.FragmentTable[0].FragmentBuffer;
+                peers[i].transmitData.FragmentTable[0].FragmentBuffer = batchedData;
+                peers[i].transmitData.DataLength = peers[i].transmitData.FragmentTable[0].FragmentLength = peers[i].dataToTransmitSize;
                 peers[i].dataToTransmitSize = 0;
                 if (status = peers[i].tcp4Protocol->Transmit(peers[i].tcp4Protocol, &peers[i].transmitToken))
                 {
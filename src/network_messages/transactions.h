@@ -49,6 +49,12 @@ struct Transaction
     {
         return ((unsigned char*)this) + sizeof(Transaction) + inputSize;
     }
+
+    // Return pointer to signature (CAUTION: This is behind the memory reserved for this struct!)
+    const unsigned char* signaturePtr() const
+    {
+        return ((const unsigned char*)this) + sizeof(Transaction) + inputSize;
+    }
 };
 
 static_assert(sizeof(Transaction) == 32 + 32 + 8 + 4 + 2 + 2, "Something is wrong with the struct size.");
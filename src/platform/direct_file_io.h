@@ -0,0 +1,617 @@
+#pragma once
+
+// File reads and writes that any thread can submit and that complete without the main processor, for Linux.
+// Requests are executed by io_uring if the kernel allows it, otherwise by a pool of worker threads doing
+// pread()/pwrite(). With io_uring, large buffers that are read and written often (like the spectrum and the universe)
+// can be registered, so the kernel doesn't need to map their pages for every request.
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "concurrency.h"
+#include "memory.h"
+
+struct FileIORequest
+{
+    // Set by the caller before submitting
+    int fd = -1;
+    bool isWrite = false;
+    unsigned char* buffer = nullptr;
+    unsigned long long size = 0;
+    unsigned long long offset = 0; // position in the file
+
+    // Set when the request is done: result is size on success and a negative errno on failure
+    volatile char isDone = 0;
+    long long result = 0;
+    unsigned long long latencyMicroseconds = 0;
+
+    // Internal state of DirectFileIO
+    unsigned long long transferred = 0;
+    std::chrono::steady_clock::time_point submitTime;
+};
+
+class DirectFileIO
+{
+public:
+    enum Backend
+    {
+        kThreadPool = 0,
+        kIoUring = 1,
+    };
+
+    struct Stats
+    {
+        unsigned long long reads;
+        unsigned long long writes;
+        unsigned long long failures;
+        unsigned long long bytesRead;
+        unsigned long long bytesWritten;
+        unsigned long long fixedBufferTransfers; // io_uring operations on registered buffers
+        unsigned long long totalLatencyMicroseconds;
+        unsigned long long maxLatencyMicroseconds;
+        unsigned int inFlight;
+    };
+
+    virtual ~DirectFileIO() = default;
+
+    // Start io_uring (unless isThreadPoolForced) or the worker threads if io_uring is not available
+    bool init(bool isThreadPoolForced = false)
+    {
+        setMem(&stats, sizeof(stats), 0);
+        fixedBufferTransfers = 0;
+        isStopping = false;
+        if (!isThreadPoolForced && initIoUring())
+        {
+            backend = kIoUring;
+            completionThread = std::thread(&DirectFileIO::reapCompletions, this);
+            return true;
+        }
+        backend = kThreadPool;
+        maxInFlight = maxInFlightOfThreadPool;
+        for (unsigned int i = 0; i < numberOfWorkerThreads; i++)
+        {
+            workerThreads.emplace_back(&DirectFileIO::processRequests, this);
+        }
+        return true;
+    }
+
+    // Wait for all requests and stop the backend
+    void deinit()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            completionCondition.wait(lock, [this]() { return stats.inFlight == 0; });
+            isStopping = true;
+        }
+        if (backend == kIoUring)
+        {
+            // wake up the completion thread with an operation without FileIORequest
+            std::lock_guard<std::mutex> submitLock(submitMutex);
+            pushSqe(IORING_OP_NOP, -1, 0, 0, 0, -1, 0);
+        }
+        workCondition.notify_all();
+        if (completionThread.joinable())
+        {
+            completionThread.join();
+        }
+        for (auto& thread : workerThreads)
+        {
+            thread.join();
+        }
+        workerThreads.clear();
+        if (backend == kIoUring)
+        {
+            deinitIoUring();
+        }
+    }
+
+    Backend getBackend() const
+    {
+        return backend;
+    }
+
+    // Whether a probe result of IORING_REGISTER_PROBE has all operations that requests are executed with
+    static bool areRequestOpcodesSupported(const io_uring_probe* probe)
+    {
+        for (unsigned char opcode : { IORING_OP_NOP, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED })
+        {
+            if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Start reading or writing request.size bytes of request.buffer, can be called from any thread. The request and
+    // its buffer must stay valid until wait() returns. Blocks only if too many requests are in flight.
+    void submit(FileIORequest& request)
+    {
+        request.isDone = 0;
+        request.result = 0;
+        request.transferred = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            completionCondition.wait(lock, [this]() { return stats.inFlight < maxInFlight; });
+            stats.inFlight++;
+            request.submitTime = std::chrono::steady_clock::now();
+            if (request.size == 0 || request.fd < 0)
+            {
+                finish(request, (request.fd < 0) ? -EBADF : 0);
+                lock.unlock();
+                completionCondition.notify_all();
+                return;
+            }
+            if (backend == kThreadPool)
+            {
+                workQueue.push_back(&request);
+                lock.unlock();
+                workCondition.notify_one();
+                return;
+            }
+        }
+        submitPiece(request);
+    }
+
+    // Wait until request is done and return its result
+    long long wait(FileIORequest& request)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        completionCondition.wait(lock, [&request]() { return request.isDone != 0; });
+        return request.result;
+    }
+
+    // Read size bytes of the file at path into buffer, return size or -1 on failure
+    long long read(const char* path, unsigned char* buffer, unsigned long long size)
+    {
+        return transfer(path, false, buffer, size);
+    }
+
+    // Replace the file at path with size bytes of buffer, return size or -1 on failure
+    long long write(const char* path, const unsigned char* buffer, unsigned long long size)
+    {
+        return transfer(path, true, const_cast<unsigned char*>(buffer), size);
+    }
+
+    static int openFile(const char* path, bool isWrite)
+    {
+        return (isWrite) ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    // Register a buffer for io_uring, return false if it is not used (thread pool or the kernel refused to pin it).
+    // Waits until no request is in flight, so better call it at startup.
+    bool registerBuffer(const void* buffer, unsigned long long size)
+    {
+        if (backend != kIoUring || !buffer || !size)
+        {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        // operations in flight may use the current buffer indices
+        completionCondition.wait(lock, [this]() { return stats.inFlight == 0; });
+        std::lock_guard<std::mutex> submitLock(submitMutex);
+        std::vector<iovec> buffers = registeredBuffers;
+        for (unsigned long long offset = 0; offset < size; offset += maxPieceSize)
+        {
+            buffers.push_back({ (unsigned char*)buffer + offset, (size_t)((size - offset < maxPieceSize) ? size - offset : maxPieceSize) });
+        }
+        return replaceRegisteredBuffers(buffers);
+    }
+
+    // Remove the registered parts of the buffer, before it is freed
+    void unregisterBuffer(const void* buffer, unsigned long long size)
+    {
+        if (backend != kIoUring)
+        {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        completionCondition.wait(lock, [this]() { return stats.inFlight == 0; });
+        std::lock_guard<std::mutex> submitLock(submitMutex);
+        std::vector<iovec> buffers;
+        for (const iovec& registered : registeredBuffers)
+        {
+            if ((unsigned char*)registered.iov_base < (unsigned char*)buffer || (unsigned char*)registered.iov_base >= (unsigned char*)buffer + size)
+            {
+                buffers.push_back(registered);
+            }
+        }
+        if (buffers.size() != registeredBuffers.size())
+        {
+            replaceRegisteredBuffers(buffers);
+        }
+    }
+
+    Stats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::lock_guard<std::mutex> submitLock(submitMutex);
+        Stats copy = stats;
+        copy.fixedBufferTransfers = fixedBufferTransfers;
+        return copy;
+    }
+
+protected:
+    // Check the operations of the ring with IORING_REGISTER_PROBE. io_uring_setup() works since Linux 5.1, but
+    // IORING_OP_READ and IORING_OP_WRITE (and the probe) only exist since 5.6, so older kernels would fail every
+    // request with -EINVAL. Virtual, so tests can simulate such a kernel.
+    virtual bool probeRequestOpcodes()
+    {
+        constexpr unsigned int numberOfOps = 256;
+        std::vector<unsigned char> probe(sizeof(io_uring_probe) + numberOfOps * sizeof(io_uring_probe_op), 0);
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe.data(), numberOfOps) < 0)
+        {
+            return false;
+        }
+        return areRequestOpcodesSupported((const io_uring_probe*)probe.data());
+    }
+
+private:
+    static constexpr unsigned long long maxPieceSize = 1ULL << 30; // per io_uring operation and registered buffer
+    static constexpr unsigned int ringEntries = 64;
+    static constexpr unsigned int numberOfWorkerThreads = 4;
+    static constexpr unsigned int maxInFlightOfThreadPool = 1024;
+
+    long long transfer(const char* path, bool isWrite, unsigned char* buffer, unsigned long long size)
+    {
+        FileIORequest request;
+        request.fd = openFile(path, isWrite);
+        if (request.fd < 0)
+        {
+            return -1;
+        }
+        request.isWrite = isWrite;
+        request.buffer = buffer;
+        request.size = size;
+        submit(request);
+        const long long result = wait(request);
+        close(request.fd);
+        return (result == (long long)size) ? result : -1;
+    }
+
+    // Complete request, mutex must be locked. Waiters must be notified after unlocking.
+    void finish(FileIORequest& request, long long result)
+    {
+        request.result = result;
+        request.latencyMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request.submitTime).count();
+        if (result < 0)
+        {
+            stats.failures++;
+        }
+        else if (request.isWrite)
+        {
+            stats.writes++;
+            stats.bytesWritten += request.size;
+        }
+        else
+        {
+            stats.reads++;
+            stats.bytesRead += request.size;
+        }
+        stats.totalLatencyMicroseconds += request.latencyMicroseconds;
+        if (request.latencyMicroseconds > stats.maxLatencyMicroseconds)
+        {
+            stats.maxLatencyMicroseconds = request.latencyMicroseconds;
+        }
+        stats.inFlight--;
+        ATOMIC_STORE8(request.isDone, 1);
+    }
+
+    // Account a transfer of result bytes (or an error) of request, mutex must be locked
+    // return true if the rest of the request has to be submitted
+    bool completePiece(FileIORequest& request, long long result)
+    {
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            return true;
+        }
+        if (result <= 0)
+        {
+            finish(request, (result < 0) ? result : -EIO); // 0: file is shorter than the request
+            return false;
+        }
+        request.transferred += result;
+        if (request.transferred < request.size)
+        {
+            return true;
+        }
+        finish(request, request.size);
+        return false;
+    }
+
+    //////////////// thread pool
+
+    void processRequests()
+    {
+        while (true)
+        {
+            FileIORequest* request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workCondition.wait(lock, [this]() { return isStopping || !workQueue.empty(); });
+                if (workQueue.empty())
+                {
+                    return;
+                }
+                request = workQueue.front();
+                workQueue.pop_front();
+            }
+
+            long long result = 0;
+            while (result >= 0 && request->transferred < request->size)
+            {
+                const unsigned long long remaining = request->size - request->transferred;
+                const size_t length = (size_t)((remaining < maxPieceSize) ? remaining : maxPieceSize);
+                const ssize_t sz = (request->isWrite)
+                    ? pwrite(request->fd, request->buffer + request->transferred, length, request->offset + request->transferred)
+                    : pread(request->fd, request->buffer + request->transferred, length, request->offset + request->transferred);
+                if (sz < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                result = (sz < 0) ? -errno : (sz == 0) ? -EIO : 0;
+                if (sz > 0)
+                {
+                    request->transferred += sz;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finish(*request, (result < 0) ? result : request->size);
+            }
+            completionCondition.notify_all();
+        }
+    }
+
+    //////////////// io_uring
+
+    bool initIoUring()
+    {
+        io_uring_params params;
+        setMem(&params, sizeof(params), 0);
+        ringFd = (int)syscall(__NR_io_uring_setup, ringEntries, &params);
+        if (ringFd < 0)
+        {
+            return false;
+        }
+        if (!probeRequestOpcodes())
+        {
+            deinitIoUring();
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool isSingleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (isSingleMmap)
+        {
+            sqRingSize = cqRingSize = (sqRingSize > cqRingSize) ? sqRingSize : cqRingSize;
+        }
+        sqRing = (unsigned char*)mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = (isSingleMmap) ? sqRing : (unsigned char*)mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            deinitIoUring();
+            return false;
+        }
+
+        sqTail = (unsigned int*)(sqRing + params.sq_off.tail);
+        sqMask = *(unsigned int*)(sqRing + params.sq_off.ring_mask);
+        sqArray = (unsigned int*)(sqRing + params.sq_off.array);
+        cqHead = (unsigned int*)(cqRing + params.cq_off.head);
+        cqTail = (unsigned int*)(cqRing + params.cq_off.tail);
+        cqMask = *(unsigned int*)(cqRing + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cqRing + params.cq_off.cqes);
+
+        // each request has at most one operation in the ring, so the completion queue cannot overflow
+        maxInFlight = params.cq_entries;
+        return true;
+    }
+
+    void deinitIoUring()
+    {
+        if (sqes && sqes != MAP_FAILED)
+        {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing && cqRing != MAP_FAILED && cqRing != sqRing)
+        {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing && sqRing != MAP_FAILED)
+        {
+            munmap(sqRing, sqRingSize);
+        }
+        sqes = nullptr;
+        cqRing = sqRing = nullptr;
+        registeredBuffers.clear();
+        close(ringFd);
+        ringFd = -1;
+    }
+
+    // Queue one operation and submit it, submitMutex must be locked. Return false if the kernel refused it.
+    bool pushSqe(unsigned char opcode, int fd, unsigned long long address, unsigned int length, unsigned long long offset, int bufferIndex, unsigned long long userData)
+    {
+        // the kernel consumes all entries in io_uring_enter() (no polling thread), so the queue is empty here
+        const unsigned int tail = *sqTail;
+        const unsigned int index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        setMem(&sqe, sizeof(sqe), 0);
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = address;
+        sqe.len = length;
+        sqe.off = offset;
+        if (bufferIndex >= 0)
+        {
+            sqe.buf_index = (unsigned short)bufferIndex;
+        }
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        while (syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0) < 0)
+        {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                // not consumed, take the entry back
+                __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Submit the next part of request, locks submitMutex (and mutex if it fails)
+    void submitPiece(FileIORequest& request)
+    {
+        std::unique_lock<std::mutex> submitLock(submitMutex);
+        unsigned char* address = request.buffer + request.transferred;
+        const unsigned long long remaining = request.size - request.transferred;
+        unsigned int length = (unsigned int)((remaining < maxPieceSize) ? remaining : maxPieceSize);
+        int bufferIndex = -1;
+        for (unsigned int i = 0; i < registeredBuffers.size(); i++)
+        {
+            unsigned char* begin = (unsigned char*)registeredBuffers[i].iov_base;
+            unsigned char* end = begin + registeredBuffers[i].iov_len;
+            if (address >= begin && address < end)
+            {
+                bufferIndex = i;
+                if (address + length > end)
+                {
+                    length = (unsigned int)(end - address);
+                }
+                fixedBufferTransfers++;
+                break;
+            }
+        }
+        unsigned char opcode;
+        if (bufferIndex >= 0)
+        {
+            opcode = (request.isWrite) ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        }
+        else
+        {
+            opcode = (request.isWrite) ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        if (!pushSqe(opcode, request.fd, (unsigned long long)address, length, request.offset + request.transferred, bufferIndex, (unsigned long long)&request))
+        {
+            const int error = errno;
+            submitLock.unlock();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finish(request, -error);
+            }
+            completionCondition.notify_all();
+        }
+    }
+
+    void reapCompletions()
+    {
+        while (true)
+        {
+            unsigned int head = *cqHead;
+            const unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail)
+            {
+                syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                continue;
+            }
+
+            bool isStopRequested = false;
+            resubmittedRequests.clear();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (; head != tail; head++)
+                {
+                    const io_uring_cqe& cqe = cqes[head & cqMask];
+                    if (!cqe.user_data)
+                    {
+                        isStopRequested = true;
+                    }
+                    else if (completePiece(*(FileIORequest*)cqe.user_data, cqe.res))
+                    {
+                        resubmittedRequests.push_back((FileIORequest*)cqe.user_data);
+                    }
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            completionCondition.notify_all();
+            for (FileIORequest* request : resubmittedRequests)
+            {
+                submitPiece(*request);
+            }
+            if (isStopRequested)
+            {
+                return;
+            }
+        }
+    }
+
+    // Register buffers instead of the current ones, mutex and submitMutex must be locked and no request in flight
+    bool replaceRegisteredBuffers(const std::vector<iovec>& buffers)
+    {
+        if (!registeredBuffers.empty())
+        {
+            syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        }
+        if (buffers.empty() || syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, buffers.data(), (unsigned int)buffers.size()) == 0)
+        {
+            registeredBuffers = buffers;
+            return true;
+        }
+        // keep the previous buffers
+        if (!registeredBuffers.empty()
+            && syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, registeredBuffers.data(), (unsigned int)registeredBuffers.size()) != 0)
+        {
+            registeredBuffers.clear();
+        }
+        return false;
+    }
+
+    Backend backend = kThreadPool;
+    bool isStopping = false;
+    unsigned int maxInFlight = 0;
+    Stats stats;
+
+    std::mutex mutex; // protects everything above, the work queue and the state of the requests
+    std::condition_variable completionCondition; // requests done or in-flight count decreased
+    std::condition_variable workCondition; // requests for the worker threads
+
+    std::deque<FileIORequest*> workQueue;
+    std::vector<std::thread> workerThreads;
+
+    std::mutex submitMutex; // protects the submission queue, the registered buffers and fixedBufferTransfers
+    unsigned long long fixedBufferTransfers = 0;
+    std::vector<FileIORequest*> resubmittedRequests; // only used by the completion thread
+
+    int ringFd = -1;
+    unsigned char* sqRing = nullptr;
+    unsigned char* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    unsigned long long sqRingSize = 0;
+    unsigned long long cqRingSize = 0;
+    unsigned long long sqesSize = 0;
+    unsigned int* sqTail = nullptr;
+    unsigned int sqMask = 0;
+    unsigned int* sqArray = nullptr;
+    unsigned int* cqHead = nullptr;
+    unsigned int* cqTail = nullptr;
+    unsigned int cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    std::vector<iovec> registeredBuffers;
+    std::thread completionThread;
+};
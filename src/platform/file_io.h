@@ -15,6 +15,13 @@
 #include "concurrency.h"
 #include "memory.h"
 
+// On Linux, files are read and written with io_uring (or a thread pool if it isn't available) directly from the
+// calling thread, instead of through the queues flushed by the main processor. Define NO_DIRECT_FILE_IO to disable.
+#if defined(NO_UEFI) && defined(__linux__) && !defined(NO_DIRECT_FILE_IO)
+#define USE_DIRECT_FILE_IO
+#include "direct_file_io.h"
+#endif
+
 // If you get an error reading and writing files, set the chunk sizes below to
 // the cluster size set for formatting you disk. If you have no idea about the
 // cluster size, try 16384.
@@ -35,6 +42,9 @@ static constexpr int ASYNC_FILE_IO_MAX_QUEUE_ITEMS = (1ULL << ASYNC_FILE_IO_MAX_
 static EFI_FILE_PROTOCOL* root = NULL;
 class AsyncFileIO;
 static AsyncFileIO* gAsyncFileIO = NULL;
+#ifdef USE_DIRECT_FILE_IO
+static DirectFileIO* gDirectFileIO = NULL;
+#endif
 
 static bool q_wfopen_s(FILE **file, const CHAR16 *fileName, const CHAR16 *directory, const CHAR16 *mode, bool createFileIfNotExist = false) {
     if (!file) return (bool)EINVAL;
@@ -67,6 +77,15 @@ static bool q_wfopen_s(FILE **file, const CHAR16 *fileName, const CHAR16 *direct
     return 0;
 }
 
+#ifdef USE_DIRECT_FILE_IO
+// Path of the file as opened by q_wfopen_s()
+static std::string getFilePath(const CHAR16* fileName, const CHAR16* directory)
+{
+    std::string fileNameUtf8 = wchar_to_string(fileName);
+    return directory ? (wchar_to_string(directory) + "/" + fileNameUtf8) : fileNameUtf8;
+}
+#endif
+
 static void addDebugMessage(const CHAR16* msg);
 static long long getFileSize(CHAR16* fileName, CHAR16* directory = NULL)
 {
@@ -309,6 +328,17 @@ static long long load(const CHAR16* fileName, unsigned long long totalSize, unsi
     {
         createDir(directory);
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        if (gDirectFileIO->read(getFilePath(fileName, directory).c_str(), buffer, totalSize) != (long long)totalSize)
+        {
+            print_wstr(L"Error reading %llu bytes from %s!\n", totalSize, wchar_to_string((fileName)).c_str());
+            return -1;
+        }
+        return totalSize;
+    }
+#endif
     if (q_wfopen_s(&file, fileName, directory, L"rb") != 0 || !file)
     {
 #ifdef _MSC_VER
@@ -400,6 +430,17 @@ static long long save(const CHAR16* fileName, unsigned long long totalSize, cons
     {
         createDir(directory);
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        if (gDirectFileIO->write(getFilePath(fileName, directory).c_str(), buffer, totalSize) != (long long)totalSize)
+        {
+            print_wstr(L"Error writting %llu bytes from %s!\n", totalSize, wchar_to_string((fileName)).c_str());
+            return -1;
+        }
+        return totalSize;
+    }
+#endif
     if (q_wfopen_s(&file, fileName, directory, L"wb", true) != 0 || !file)
     {
 #ifdef _MSC_VER
@@ -960,6 +1001,13 @@ public:
         {
             return kStop;
         }
+#ifdef USE_DIRECT_FILE_IO
+        // Any thread can write directly, no need to wait for the main thread
+        if (gDirectFileIO)
+        {
+            return save(fileName, totalSize, buffer, directory);
+        }
+#endif
 
         FileItem* pFileItem = mFileBlockingWriteQueue.requestFreeSlot(totalSize);
 
@@ -997,6 +1045,12 @@ public:
         {
             return kStop;
         }
+#ifdef USE_DIRECT_FILE_IO
+        if (gDirectFileIO)
+        {
+            return load(fileName, totalSize, buffer, directory);
+        }
+#endif
 
         int sts = kUnknown;
         bool mainThread = isMainThread();
@@ -1235,6 +1289,13 @@ static long long asyncCreateDir(const CHAR16* directory)
 static bool initFilesystem()
 {
 #ifdef NO_UEFI
+#ifdef USE_DIRECT_FILE_IO
+    if (!gDirectFileIO)
+    {
+        gDirectFileIO = new DirectFileIO();
+        gDirectFileIO->init();
+    }
+#endif
     return true;
 #else
     EFI_SIMPLE_FILE_SYSTEM_PROTOCOL* simpleFileSystemProtocol = NULL;
@@ -1364,6 +1425,14 @@ static void deInitFileSystem()
         freePool(gAsyncFileIO);
         gAsyncFileIO = NULL;
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        gDirectFileIO->deinit();
+        delete gDirectFileIO;
+        gDirectFileIO = NULL;
+    }
+#endif
 }
 
 static int flushAsyncFileIOBuffer(int numberOfItemsPerQueue = 0)
@@ -1376,6 +1445,29 @@ static int flushAsyncFileIOBuffer(int numberOfItemsPerQueue = 0)
 }
 OPTIMIZE_ON()
 
+// Register a large buffer that is saved and loaded often, so io_uring doesn't need to map its pages for every request.
+// Does nothing if files aren't read and written with io_uring. Call it at startup, before requests are in flight.
+static void registerFileIOBuffer(const void* buffer, unsigned long long size)
+{
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        gDirectFileIO->registerBuffer(buffer, size);
+    }
+#endif
+}
+
+// Unregister a buffer registered with registerFileIOBuffer(), before it is freed
+static void unregisterFileIOBuffer(const void* buffer, unsigned long long size)
+{
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        gDirectFileIO->unregisterBuffer(buffer, size);
+    }
+#endif
+}
+
 // add epoch number as an extension to a filename
 #ifdef __linux__
 static void addEpochToFileName(wchar_t* filename, int nameSize, short epoch)
@@ -1401,6 +1493,56 @@ static unsigned int getTextSize(CHAR16* text, int maximumSize)
     return result;
 }
 
+#ifdef USE_DIRECT_FILE_IO
+// Read or write all chunks of a large file at the same time with gDirectFileIO. Return the size of the chunks before
+// the first one that failed, like saveLargeFile() and loadLargeFile().
+static long long transferLargeFileChunks(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory, bool isWrite, bool skipWriteEqualChunkSize)
+{
+    if (directory != NULL)
+    {
+        createDir(directory);
+    }
+    const unsigned long long numberOfChunks = (totalSize + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE;
+    std::vector<FileIORequest> requests(numberOfChunks);
+    for (unsigned long long chunkId = 0; chunkId < numberOfChunks; chunkId++)
+    {
+        CHAR16 fileNameWithChunkId[64];
+        setText(fileNameWithChunkId, fileName);
+        appendText(fileNameWithChunkId, L".XXX");
+        addEpochToFileName(fileNameWithChunkId, getTextSize(fileNameWithChunkId, 64) + 1, (short)chunkId);
+        FileIORequest& request = requests[chunkId];
+        request.isWrite = isWrite;
+        request.buffer = buffer + chunkId * FILE_CHUNK_SIZE;
+        request.size = (chunkId + 1 < numberOfChunks) ? FILE_CHUNK_SIZE : totalSize - chunkId * FILE_CHUNK_SIZE;
+        if (isWrite && skipWriteEqualChunkSize && getFileSize(fileNameWithChunkId, directory) == (long long)request.size)
+        {
+            request.isDone = 1;
+            request.result = request.size;
+            continue;
+        }
+        request.fd = DirectFileIO::openFile(getFilePath(fileNameWithChunkId, directory).c_str(), isWrite);
+        gDirectFileIO->submit(request); // fails with -EBADF if the file couldn't be opened
+    }
+
+    unsigned long long totalTransferSize = 0;
+    bool isFailed = false;
+    for (FileIORequest& request : requests)
+    {
+        gDirectFileIO->wait(request);
+        if (request.fd >= 0)
+        {
+            close(request.fd);
+        }
+        isFailed = isFailed || (request.result != (long long)request.size);
+        if (!isFailed)
+        {
+            totalTransferSize += request.size;
+        }
+    }
+    return totalTransferSize;
+}
+#endif
+
 // Break the large file to many chunks to write if the size is greater or equal FILE_CHUNK_SIZE
 // - skipWriteEqualChunkSize: skip write the chunk file if the size of existed file match with buffer data. Set false if need the write always happens
 static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, unsigned char* buffer, CHAR16* directory = NULL, bool skipWriteEqualChunkSize = true)
@@ -1410,6 +1552,12 @@ static long long saveLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     {
         return save(fileName, totalSize, buffer, directory);
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        return transferLargeFileChunks(fileName, totalSize, buffer, directory, true, skipWriteEqualChunkSize);
+    }
+#endif
     int chunkId = 0;
     unsigned long long totalWriteSize = 0;
     while (totalSize)
@@ -1442,6 +1590,12 @@ static long long loadLargeFile(CHAR16* fileName, unsigned long long totalSize, u
     {
         return load(fileName, totalSize, buffer, directory);
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        return transferLargeFileChunks(fileName, totalSize, buffer, directory, false, false);
+    }
+#endif
     int chunkId = 0;
     unsigned long long totalReadSize = 0;
     while (totalSize)
@@ -1483,6 +1637,12 @@ static long long asyncSaveLargeFile(
     {
         return asyncSave(fileName, totalSize, buffer, directory, blocking);
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO && blocking)
+    {
+        return transferLargeFileChunks(fileName, totalSize, buffer, directory, true, false);
+    }
+#endif
     int chunkId = 0;
     unsigned long long totalWriteSize = 0;
     while (totalSize)
@@ -1517,6 +1677,12 @@ static long long asyncLoadLargeFile(CHAR16* fileName, unsigned long long totalSi
     {
         return asyncLoad(fileName, totalSize, buffer, directory);
     }
+#ifdef USE_DIRECT_FILE_IO
+    if (gDirectFileIO)
+    {
+        return transferLargeFileChunks(fileName, totalSize, buffer, directory, false, false);
+    }
+#endif
     int chunkId = 0;
     unsigned long long totalReadSize = 0;
     while (totalSize)
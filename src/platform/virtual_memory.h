@@ -6,6 +6,21 @@
 #include "platform/memory_util.h"
 #include "platform/debugging.h"
 #include "platform/file_io.h"
+#include "platform/time_stamp_counter.h"
+
+#ifdef NO_UEFI
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "four_q.h"
 #include "kangaroo_twelve.h"
@@ -28,6 +43,12 @@ inline constexpr const T& min(const T& left, const T& right)
 // prefixName is used for generating page file names on disk, it must be unique if there are multiple VirtualMemory instances
 // pageCapacity is number of items (T) inside a page
 // it stores (numCachePage) pages on RAM for faster loading (the strategy mimics CPU cache lines)
+// cached pages are found with a page table (page id -> cache slot) and replaced with a CLOCK-Pro like policy: a loaded page
+// is cold and only becomes hot if it is accessed again after other pages have been accessed. Only cold pages are evicted,
+// hot pages are demoted to cold when other pages become hot. So one long sequential read (which accesses each page
+// repeatedly, but only in a row) doesn't evict the hot pages.
+// reading pages that are in the cache doesn't acquire the lock (see tryCopyFromCache()), so concurrent readers don't
+// serialize. The lock is only needed for appending and for loading pages from disk.
 // this class can be used to debug illegal memory access issue
 template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long pageCapacity = 100000, unsigned long long numCachePage = 128>
 class VirtualMemory
@@ -41,11 +62,207 @@ protected:
     CHAR16* pageDir = NULL;
 
     unsigned long long cachePageId[numCachePage + 1];
-    unsigned long long lastAccessedTimestamp[numCachePage + 1]; // in millisecond
+    unsigned long long lastAccessedTimestamp[numCachePage + 1]; // in millisecond, only used by SwapVirtualMemory
     unsigned long long currentId; // total items in this array, aka: latest item index + 1
     unsigned long long currentPageId; // current page index that's written on
 
-    volatile char memLock; // every read/write needs a memory lock, can optimize later
+    volatile char memLock; // needed for writing and for loading pages, not for reading pages in the cache
+
+    // seqlock of the cache for lock-free readers: odd while a writer (holding memLock) changes cache slots, the page
+    // table or the items of the current page that are already published in currentId
+    volatile long cacheSequence;
+
+    static constexpr unsigned long long INVALID_CACHE_PAGE_ID = 0xffffffffffffffffULL;
+
+    // page table: open addressing with linear probing, the key of an entry is cachePageId[slot]
+    static constexpr unsigned int computePageTableBits()
+    {
+        unsigned int bits = 1;
+        while ((1ULL << bits) < 2 * (numCachePage + 1))
+        {
+            bits++;
+        }
+        return bits;
+    }
+    static constexpr unsigned int pageTableBits = computePageTableBits();
+    static constexpr unsigned int pageTableSize = 1U << pageTableBits;
+    int pageTable[pageTableSize]; // cache slot, -1 if empty
+
+    // replacement of cache slots 1..numCachePage (slot 0 is the current page)
+    static constexpr unsigned int maxNumberOfHotSlots = (unsigned int)(numCachePage - (numCachePage + 3) / 4); // at least a quarter is left for new pages
+    bool slotReferenced[numCachePage + 1]; // accessed again since loaded or since the clock hand passed
+    bool slotIsHot[numCachePage + 1];
+    unsigned int numberOfHotSlots;
+    unsigned int clockHand;
+    unsigned int hotClockHand;
+    int lastAccessedSlot;
+
+    static unsigned int pageTableIndex(unsigned long long pageId)
+    {
+        return (unsigned int)((pageId * 0x9E3779B97F4A7C15ULL) >> (64 - pageTableBits));
+    }
+
+    // return cache slot of pageId without counting it as access, -1 if not in cache
+    int lookUpCachePage(unsigned long long pageId)
+    {
+        for (unsigned int i = pageTableIndex(pageId);; i = (i + 1) & (pageTableSize - 1))
+        {
+            const int slot = pageTable[i];
+            if (slot == -1)
+            {
+                return -1;
+            }
+            if (cachePageId[slot] == pageId)
+            {
+                return slot;
+            }
+        }
+    }
+
+    // set the page in cache slot and update the page table, the same page must not be in another slot
+    // (except for the current page while it is copied to the cache, which is replaced in the page table)
+    void setCachePageId(int slot, unsigned long long pageId)
+    {
+        if (cachePageId[slot] != INVALID_CACHE_PAGE_ID)
+        {
+            for (unsigned int i = pageTableIndex(cachePageId[slot]); pageTable[i] != -1; i = (i + 1) & (pageTableSize - 1))
+            {
+                if (pageTable[i] == slot)
+                {
+                    erasePageTableEntry(i);
+                    break;
+                }
+            }
+        }
+        cachePageId[slot] = pageId;
+        if (pageId != INVALID_CACHE_PAGE_ID)
+        {
+            unsigned int i = pageTableIndex(pageId);
+            while (pageTable[i] != -1 && cachePageId[pageTable[i]] != pageId)
+            {
+                i = (i + 1) & (pageTableSize - 1);
+            }
+            pageTable[i] = slot;
+        }
+    }
+
+    // remove entry i and move the following entries of the probe sequence to close the gap
+    void erasePageTableEntry(unsigned int i)
+    {
+        for (unsigned int j = (i + 1) & (pageTableSize - 1); pageTable[j] != -1; j = (j + 1) & (pageTableSize - 1))
+        {
+            const unsigned int home = pageTableIndex(cachePageId[pageTable[j]]);
+            const bool isHomeBetween = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!isHomeBetween)
+            {
+                pageTable[i] = pageTable[j];
+                i = j;
+            }
+        }
+        pageTable[i] = -1;
+    }
+
+    // rebuild page table after cachePageId has been changed directly
+    void rebuildPageTable()
+    {
+        setMem(pageTable, sizeof(pageTable), 0xff);
+        for (int slot = 0; slot <= numCachePage; slot++)
+        {
+            const unsigned long long pageId = cachePageId[slot];
+            cachePageId[slot] = INVALID_CACHE_PAGE_ID;
+            setCachePageId(slot, pageId);
+        }
+    }
+
+    // count an access to cache slot, accesses in a row to the same slot only count once
+    void markCacheSlotAccessed(int slot)
+    {
+        if (slot != lastAccessedSlot)
+        {
+            slotReferenced[slot] = true;
+            lastAccessedSlot = slot;
+        }
+    }
+
+    // start tracking a page that has been put into cache slot
+    void initCacheSlot(int slot, bool isReferenced)
+    {
+        if (slotIsHot[slot])
+        {
+            slotIsHot[slot] = false;
+            numberOfHotSlots--;
+        }
+        slotReferenced[slot] = isReferenced;
+        lastAccessedSlot = slot;
+    }
+
+    void beginCacheChange()
+    {
+        _InterlockedIncrement(&cacheSequence);
+    }
+
+    void endCacheChange()
+    {
+        _InterlockedIncrement(&cacheSequence);
+    }
+
+    long readCacheSequence()
+    {
+        // full barrier, so the copy cannot be moved before or after reading the sequence number
+        return _InterlockedCompareExchange(&cacheSequence, 0, 0);
+    }
+
+    // make appended items visible to lock-free readers, after the items have been written
+    void publishCurrentId(unsigned long long newCurrentId)
+    {
+        _InterlockedExchange64((volatile long long*)&currentId, (long long)newCurrentId);
+    }
+
+    // copy numItems items starting at index (within one page) without acquiring memLock
+    // return false if the page isn't in the cache or the cache has been changed while copying
+    bool tryCopyFromCache(T* dst, unsigned long long index, unsigned long long numItems)
+    {
+        const long sequenceBefore = readCacheSequence();
+        if (sequenceBefore & 1)
+        {
+            return false;
+        }
+        const int slot = lookUpCachePage(index / pageCapacity);
+        if (slot == -1)
+        {
+            return false;
+        }
+        copyMem(dst, cache[slot] + (index % pageCapacity), numItems * sizeof(T));
+        if (readCacheSequence() != sequenceBefore)
+        {
+            return false;
+        }
+        markCacheSlotAccessed(slot); // races with other readers only lose hints for the replacement
+        return true;
+    }
+
+    // copy numItems items starting at index (within one page), acquiring memLock only if the page has to be loaded
+    // return false if the page cannot be loaded
+    bool copyFromPage(T* dst, unsigned long long index, unsigned long long numItems)
+    {
+        if (tryCopyFromCache(dst, index, numItems))
+        {
+            return true;
+        }
+        ACQUIRE(memLock);
+        const int cache_page_idx = loadPageToCache(index / pageCapacity);
+        if (cache_page_idx == -1)
+        {
+#if !defined(NDEBUG)
+            addDebugMessage(L"Invalid cache page index, return zeroes array");
+#endif
+            RELEASE(memLock);
+            return false;
+        }
+        copyMem(dst, cache[cache_page_idx] + (index % pageCapacity), numItems * sizeof(T));
+        RELEASE(memLock);
+        return true;
+    }
 
     void generatePageName(CHAR16 pageName[64], unsigned long long page_id)
     {
@@ -94,31 +311,68 @@ protected:
 #endif
     }
 
-    // return the most outdated cache page
-    int getMostOutdatedCachePage()
+    // return the cache slot to reuse, moving the cold clock hand over slots 1..numCachePage (0 is used for current page)
+    // the first unreferenced cold page is evicted, referenced cold pages are promoted to hot on the way
+    int getCacheSlotToEvict()
     {
-        // i = 1 because 0 is used for current page
-        int min_index = 1;
-        for (int i = 1; i <= numCachePage; i++)
+        while (true)
         {
-            if (lastAccessedTimestamp[i] == 0)
+            const int slot = clockHand;
+            clockHand = (clockHand < numCachePage) ? clockHand + 1 : 1;
+            if (cachePageId[slot] == INVALID_CACHE_PAGE_ID)
             {
-                return i;
+                return slot;
             }
-            if ((lastAccessedTimestamp[i] < lastAccessedTimestamp[min_index]) || (lastAccessedTimestamp[i] == lastAccessedTimestamp[min_index] && cachePageId[i] < cachePageId[min_index]))
+            if (slotIsHot[slot])
             {
-                min_index = i;
+                continue;
+            }
+            if (!slotReferenced[slot])
+            {
+                return slot;
+            }
+            slotReferenced[slot] = false;
+            if (numberOfHotSlots == maxNumberOfHotSlots)
+            {
+                demoteHotSlot();
+            }
+            if (numberOfHotSlots < maxNumberOfHotSlots)
+            {
+                slotIsHot[slot] = true;
+                numberOfHotSlots++;
             }
         }
-        return min_index;
+    }
+
+    // make room for a hot page, moving the hot clock hand to the first hot page that hasn't been referenced since the
+    // hand passed the last time and demoting it to cold
+    void demoteHotSlot()
+    {
+        while (numberOfHotSlots)
+        {
+            const int slot = hotClockHand;
+            hotClockHand = (hotClockHand < numCachePage) ? hotClockHand + 1 : 1;
+            if (!slotIsHot[slot])
+            {
+                continue;
+            }
+            if (slotReferenced[slot])
+            {
+                slotReferenced[slot] = false;
+                continue;
+            }
+            slotIsHot[slot] = false;
+            numberOfHotSlots--;
+            return;
+        }
     }
 
     void copyCurrentPageToCache()
     {
-        int cache_slot_idx = getMostOutdatedCachePage();
+        int cache_slot_idx = getCacheSlotToEvict();
         copyMem(cache[cache_slot_idx], currentPage, pageSize);
-        lastAccessedTimestamp[cache_slot_idx] = now_ms();
-        cachePageId[cache_slot_idx] = currentPageId;
+        setCachePageId(cache_slot_idx, currentPageId);
+        initCacheSlot(cache_slot_idx, true); // latest data is likely to be read again soon
 #ifndef NDEBUG
         {
             CHAR16 debugMsg[128];
@@ -145,16 +399,12 @@ protected:
     // return cache id given cache_page_id
     int findCachePage(unsigned long long requested_page_id)
     {
-        // TODO: consider implementing a tree here for faster search
-        for (int i = 0; i <= numCachePage; i++)
+        const int slot = lookUpCachePage(requested_page_id);
+        if (slot != -1)
         {
-            if (cachePageId[i] == requested_page_id)
-            {
-                lastAccessedTimestamp[i] = now_ms();
-                return i;
-            }
+            markCacheSlotAccessed(slot);
         }
-        return -1;
+        return slot;
     }
 
     // load a page from disk to cache
@@ -170,10 +420,10 @@ protected:
         }
         CHAR16 pageName[64];
         generatePageName(pageName, pageId);
-        cache_page_id = getMostOutdatedCachePage();
+        cache_page_id = getCacheSlotToEvict();
+        beginCacheChange();
 #if defined(NO_UEFI) && !defined(REAL_NODE)
         auto sz = load(pageName, pageSize, (unsigned char*)cache[cache_page_id], pageDir);
-        lastAccessedTimestamp[cache_page_id] = now_ms();
 #else
 #if !defined(NDEBUG)
         {
@@ -189,11 +439,14 @@ protected:
 #if !defined(NDEBUG)
             addDebugMessage(L"Failed to load virtualMemory from disk");
 #endif
+            setCachePageId(cache_page_id, INVALID_CACHE_PAGE_ID);
+            endCacheChange();
             return -1;
         }
-        lastAccessedTimestamp[cache_page_id] = now_ms();
 #endif
-        cachePageId[cache_page_id] = pageId;
+        setCachePageId(cache_page_id, pageId);
+        endCacheChange();
+        initCacheSlot(cache_page_id, false);
 #if !defined(NDEBUG)
         {
             CHAR16 debugMsg[128];
@@ -222,21 +475,32 @@ protected:
         if (currentId % pageCapacity == 0)
         {
             writeCurrentPageToDisk();
+            beginCacheChange();
             copyCurrentPageToCache();
             cleanCurrentPage();
-            cachePageId[0] = currentId / pageCapacity;
+            setCachePageId(0, currentId / pageCapacity);
+            endCacheChange();
             currentPageId++;
         }
     }
 
     void reset()
     {
+        beginCacheChange();
         setMem(currentPage, pageSize * (numCachePage + 1), 0);
         setMem(cachePageId, sizeof(cachePageId), 0xff);
         setMem(lastAccessedTimestamp, sizeof(lastAccessedTimestamp), 0);
         cachePageId[0] = 0;
+        rebuildPageTable();
+        setMem(slotReferenced, sizeof(slotReferenced), 0);
+        setMem(slotIsHot, sizeof(slotIsHot), 0);
+        numberOfHotSlots = 0;
+        clockHand = 1;
+        hotClockHand = 1;
+        lastAccessedSlot = -1;
         currentId = 0;
         currentPageId = 0;
+        endCacheChange();
         memLock = 0;
     }
 
@@ -244,6 +508,7 @@ public:
     VirtualMemory()
     {
         memLock = 0;
+        cacheSequence = 0;
     }
 
     bool init()
@@ -322,16 +587,14 @@ public:
     // return number of items has been copied
     unsigned long long getMany(T* dst, unsigned long long offset, unsigned long long numItems)
     {
-        ACQUIRE(memLock);
         ASSERT(offset + numItems - 1 < currentId);
         if (offset + numItems - 1 >= currentId)
         {
-            RELEASE(memLock);
             return 0;
         }
-        RELEASE(memLock);
 
         // processing
+        T* dst_start = dst;
         unsigned long long c_bytes = 0;
         unsigned long long p_start = offset;
         unsigned long long p_end = offset + numItems;
@@ -344,68 +607,41 @@ public:
         // HEAD
         unsigned long long hs = offset; // head start
         unsigned long long rhs = (hs / pageCapacity) * pageCapacity; // rounded hs
-        unsigned long long r_page_id = rhs / pageCapacity;
         unsigned long long he = min(rhs + pageCapacity, offset + numItems); // head end
         unsigned long long n_item = he - hs; // copy [hs, he)
-        ACQUIRE(memLock);
-        int cache_page_idx = loadPageToCache(r_page_id);
-        if (cache_page_idx == -1)
+        if (!copyFromPage(dst, hs, n_item))
         {
-#if !defined(NDEBUG)
-            addDebugMessage(L"Invalid cache page index, return zeroes array");
-#endif
-            setMem(dst, numItems * sizeof(T), 0);
-            RELEASE(memLock);
+            setMem(dst_start, numItems * sizeof(T), 0);
             return 0;
         }
-        copyMem(dst, cache[cache_page_idx] + (hs % pageCapacity), n_item * sizeof(T));
         dst += n_item;
         c_bytes += n_item * sizeof(T);
-        RELEASE(memLock);
         // BODY
         unsigned long long bs = he; //bodystart
         if (he < p_end && (p_end - he) >= pageCapacity) // need to copy fullpage in the "middle"
         {
             for (bs = he; bs + pageCapacity <= p_end; bs += pageCapacity)
             {
-                r_page_id = bs / pageCapacity;
-                ACQUIRE(memLock);
-                cache_page_idx = loadPageToCache(r_page_id);
-                if (cache_page_idx == -1)
+                if (!copyFromPage(dst, bs, pageCapacity))
                 {
-#if !defined(NDEBUG)
-                    addDebugMessage(L"Invalid cache page index, return zeroes array");
-#endif
-                    setMem(dst, numItems * sizeof(T), 0);
-                    RELEASE(memLock);
+                    setMem(dst_start, numItems * sizeof(T), 0);
                     return 0;
                 }
-                copyMem(dst, cache[cache_page_idx], pageSize);
                 dst += pageCapacity;
                 c_bytes += pageSize;
-                RELEASE(memLock);
             }
         }
         // TAIL
         if (bs < p_end)
         {
-            r_page_id = bs / pageCapacity;
             n_item = p_end - bs; // copy [bs, p_end)
-            ACQUIRE(memLock);
-            int cache_page_idx = loadPageToCache(r_page_id);
-            if (cache_page_idx == -1)
+            if (!copyFromPage(dst, bs, n_item))
             {
-#if !defined(NDEBUG)
-                addDebugMessage(L"Invalid cache page index, return zeroes array");
-#endif
-                setMem(dst, numItems * sizeof(T), 0);
-                RELEASE(memLock);
+                setMem(dst_start, numItems * sizeof(T), 0);
                 return 0;
             }
-            copyMem(dst, cache[cache_page_idx], n_item * sizeof(T));
             dst += n_item;
             c_bytes += n_item * sizeof(T);
-            RELEASE(memLock);
         }
         return c_bytes;
     }
@@ -427,7 +663,7 @@ public:
         unsigned long long he = min(rhs + pageCapacity, p_end); // head end
         unsigned long long n_item = he - hs; // copy [hs, he)
         copyMem(currentPage + (currentId % pageCapacity), src, n_item * sizeof(T));
-        currentId += n_item;
+        publishCurrentId(currentId + n_item);
         src += n_item;
         c_bytes += n_item * sizeof(T);
         tryPersistingPage();
@@ -438,7 +674,7 @@ public:
             for (bs = he; bs + pageCapacity <= p_end; bs += pageCapacity)
             {
                 copyMem(currentPage, src, pageSize);
-                currentId += pageCapacity;
+                publishCurrentId(currentId + pageCapacity);
                 src += pageCapacity;
                 c_bytes += pageSize;
                 tryPersistingPage();
@@ -449,7 +685,7 @@ public:
         {
             n_item = p_end - bs; // copy [bs, p_end)
             copyMem(currentPage, src, n_item * sizeof(T));
-            currentId += n_item;
+            publishCurrentId(currentId + n_item);
             src += n_item;
             c_bytes += n_item * sizeof(T);
             tryPersistingPage();
@@ -460,59 +696,23 @@ public:
 
     // return array[index]
     // if index is not in current page it will try to find it in cache
-    // if index is not in cache it will load the page to most outdated cache
+    // if index is not in cache it will load the page to a cache slot of a cold page
     T get(unsigned long long index)
     {
         T result;
-        ACQUIRE(memLock);
-        if (index >= currentId) // out of bound
-        {
-            setMem(&result, sizeof(T), 0);
-            RELEASE(memLock);
-            return result;
-        }
-        unsigned long long requested_page_id = index / pageCapacity;
-        int cache_page_idx = loadPageToCache(requested_page_id);
-        if (cache_page_idx == -1)
-        {
-#if !defined(NDEBUG)
-            addDebugMessage(L"Invalid cache page index, return zeroes array");
-#endif
-            setMem(&result, sizeof(T), 0);
-            RELEASE(memLock);
-            return result;
-        }
-        result = cache[cache_page_idx][index % pageCapacity];
-        RELEASE(memLock);
+        getOne(index, &result);
         return result;
     }
 
     // return array[index]
     // if index is not in current page it will try to find it in cache
-    // if index is not in cache it will load the page to most outdated cache
+    // if index is not in cache it will load the page to a cache slot of a cold page
     void getOne(unsigned long long index, T* result)
     {
-        ACQUIRE(memLock);
-        if (index >= currentId) // out of bound
+        if (index >= currentId || !copyFromPage(result, index, 1)) // out of bound or failed to load
         {
             setMem(result, sizeof(T), 0);
-            RELEASE(memLock);
-            return;
-        }
-        unsigned long long requested_page_id = index / pageCapacity;
-        int cache_page_idx = loadPageToCache(requested_page_id);
-        if (cache_page_idx == -1)
-        {
-#if !defined(NDEBUG)
-            addDebugMessage(L"Invalid cache page index, return zeroes array");
-#endif
-            setMem(result, sizeof(T), 0);
-            RELEASE(memLock);
-            return;
         }
-        copyMem(result, &(cache[cache_page_idx][index % pageCapacity]), sizeof(T));
-        RELEASE(memLock);
-        return;
     }
 
     T operator[](unsigned long long index)
@@ -530,7 +730,7 @@ public:
         ASSERT(currentPage != NULL);
         ACQUIRE(memLock);
         copyMem(&currentPage[currentId % pageCapacity], &data, sizeof(T));
-        currentId++;
+        publishCurrentId(currentId + 1);
         tryPersistingPage();
         RELEASE(memLock);
     }
@@ -644,6 +844,7 @@ public:
     unsigned long long loadVMState(unsigned char* buffer)
     {
         ACQUIRE(memLock);
+        beginCacheChange();
         unsigned long long ret = 0;
         copyMem(currentPage, buffer, pageSize);
         ret += pageSize;
@@ -657,8 +858,8 @@ public:
         buffer += 8;
         ret += 8;
 
-        cachePageId[0] = currentPageId;
-        lastAccessedTimestamp[0] = now_ms();
+        setCachePageId(0, currentPageId);
+        endCacheChange();
         RELEASE(memLock);
         return ret;
     }
@@ -670,9 +871,110 @@ enum SwapMode
     OFFSET_MODE = 1 // for random access pattern using offset (ideally for Transaction)
 };
 
+// Paging statistics of a SwapVirtualMemory
+struct SwapStats
+{
+    unsigned long long hits; // accesses to pages in the cache
+    unsigned long long misses; // accesses that waited for a page to be loaded (and the evicted page to be written)
+    unsigned long long stallMicroseconds; // time spent waiting in misses
+    unsigned long long readAheadPages; // pages loaded in the background
+    unsigned long long readAheadHits; // first accesses to pages loaded in the background
+    unsigned long long writtenBehindPages; // pages written back in the background, so they can be evicted without waiting
+};
+
+#ifdef NO_UEFI
+// Threads doing the disk I/O of all SwapVirtualMemory instances ahead of time: writing back pages before they are
+// evicted and loading pages before they are accessed. Urgent tasks (loading) are run before the other tasks.
+class SwapIOWorker
+{
+public:
+    static SwapIOWorker& instance()
+    {
+        static SwapIOWorker worker;
+        return worker;
+    }
+
+    // Queue task, returns false if the queue is full (then the task is not run)
+    bool enqueue(std::function<void()> task, bool isUrgent)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || tasks.size() >= maxNumberOfTasks)
+        {
+            return false;
+        }
+        if (!threads[0].joinable())
+        {
+            for (auto& thread : threads)
+            {
+                thread = std::thread([this]() { run(); });
+            }
+        }
+        if (isUrgent)
+        {
+            tasks.push_front(std::move(task));
+        }
+        else
+        {
+            tasks.push_back(std::move(task));
+        }
+        condition.notify_one();
+        return true;
+    }
+
+    ~SwapIOWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto& thread : threads)
+        {
+            if (thread.joinable())
+            {
+                thread.join();
+            }
+        }
+    }
+
+private:
+    static constexpr size_t maxNumberOfTasks = 64;
+    static constexpr int numberOfThreads = 2;
+
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::function<void()>> tasks;
+    std::thread threads[numberOfThreads];
+    bool stopping = false;
+};
+#endif
+
 // SwapVirtualMemory don't use append operations, it acts like a continuous chunk of memory that can be read and written randomly
 // it will try to persist pages that are not written to disk when loading a page to cache (when there is no empty cache slot)
 // NOTE: pages in cache may not be written to disk yet
+// After each miss, the least recently used pages are written back in the background (SwapIOWorker), so they can be
+// evicted without waiting for the disk, and in INDEX_MODE the following page of sequential access is loaded ahead.
+// A page is clean if it hasn't been accessed since it was written back or loaded ahead. Because the caller may write
+// through the returned pointer until its next access, the most recently accessed page is never written back early.
 // NOTE: DO NOT CREATE INSTANCE IN FUNCTION STACK, IT WILL CAUSE STACK OVERFLOW
 template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long pageCapacity = 100000, unsigned long long numCachePage = 128, SwapMode mode = INDEX_MODE, long long extraBytesPerElement = 0>
 class SwapVirtualMemory : private VirtualMemory<T, prefixName, pageDirectory, pageCapacity, numCachePage>
@@ -689,7 +991,9 @@ class SwapVirtualMemory : private VirtualMemory<T, prefixName, pageDirectory, pa
     using VMBase::generatePageName;
     using VMBase::findCachePage;
     using VMBase::loadPageToCache;
-    using VMBase::getMostOutdatedCachePage;
+    using VMBase::lookUpCachePage;
+    using VMBase::setCachePageId;
+    using VMBase::rebuildPageTable;
 
     static constexpr unsigned long long MAX_PAGE = 1024 * 1024; // max 1 million pages, can be adjusted later
 
@@ -697,6 +1001,7 @@ private:
     bool* isPageWrittenToDisk; // if current page is written to disk
     static constexpr unsigned long long INVALID_PAGE_ID = -1;
     static constexpr unsigned long long isPageWrittenToDiskSize = sizeof(bool) * MAX_PAGE;
+    static constexpr unsigned long long pageVersionSize = sizeof(unsigned int) * MAX_PAGE;
 
     // used for offset mode
     T* pageExtraBytesBuffer;
@@ -709,6 +1014,29 @@ private:
     static constexpr unsigned long long pageHasExtraBytesBufferSize = sizeof(bool) * MAX_PAGE;
     static constexpr unsigned long long lastestPageExtraBytesOffsetAccessedBufferSize = sizeof(unsigned long long) * MAX_PAGE;
 
+    // background I/O
+    static constexpr int writeBehindPages = 2; // number of pages written back after each miss
+    static constexpr unsigned long long readAheadPages = 2; // number of pages loaded ahead of sequential access (INDEX_MODE)
+    static constexpr long maxPendingIO = (numCachePage / 4 < 4) ? numCachePage / 4 : 4; // slots used by background I/O at most
+    unsigned int* pageVersion; // incremented whenever a page is written or loaded, to detect outdated read-ahead
+    unsigned long long accessSeq;
+    unsigned long long lastAccessedPageId;
+    unsigned long long slotAccessSeq[numCachePage + 1]; // accessSeq of the last access of the slot
+    unsigned long long slotCleanSeq[numCachePage + 1]; // slot is clean if equal to slotAccessSeq
+    bool slotLoadedAhead[numCachePage + 1]; // slot has been loaded ahead and not been accessed yet
+    enum : char { IO_NONE = 0, IO_PENDING, IO_DONE, IO_FAILED };
+    volatile char slotIOState[numCachePage + 1]; // background I/O of the slot, set to IO_DONE or IO_FAILED by the worker
+    bool slotIOIsRead[numCachePage + 1];
+    unsigned long long slotIOPageId[numCachePage + 1];
+    unsigned long long slotIOSeq[numCachePage + 1]; // slotAccessSeq when the write-back was queued
+    unsigned int slotIOVersion[numCachePage + 1]; // pageVersion when the read-ahead was queued
+    volatile long pendingIO;
+    unsigned int numberOfSlotsInIO; // slots with slotIOState != IO_NONE
+    bool isBackgroundIOPaused;
+    bool isReadAheadEnabled;
+    SwapStats stats;
+    unsigned long long stallTicks;
+
     void writePageToDisk(unsigned long long pageId)
     {
         CHAR16 pageName[64];
@@ -727,6 +1055,7 @@ private:
 #else
         auto sz = save(pageName, pageSize, (unsigned char*)pageBuffer, pageDir);
 #endif
+        pageVersion[pageId]++;
 
 #if !defined(NDEBUG)
         if (sz != pageSize)
@@ -754,16 +1083,54 @@ private:
 
     int loadPageToCacheAndTryToPersist(unsigned long long pageId)
     {
+        const unsigned long long stallBegin = __rdtsc();
+        int loading_slot = -1;
+        if (numberOfSlotsInIO)
+        {
+            completeBackgroundIO();
+            loading_slot = findLoadingSlot(pageId);
+        }
+        if (loading_slot != -1)
+        {
+            // the page is being loaded ahead, waiting for it is faster than loading it again
+            while (slotIOState[loading_slot] == IO_PENDING)
+            {
+                _mm_pause();
+            }
+            completeBackgroundIO();
+        }
         int cache_page_id = findCachePage(pageId);
 
         if (cache_page_id != -1)
         {
+            if (loading_slot != -1)
+            {
+                stallTicks += __rdtsc() - stallBegin;
+            }
+            lastAccessedTimestamp[cache_page_id] = now_ms();
+            stats.hits++;
+            const bool wasLoadedAhead = slotLoadedAhead[cache_page_id];
+            if (wasLoadedAhead)
+            {
+                stats.readAheadHits++;
+            }
+            markSlotAccessed(cache_page_id);
+            if (wasLoadedAhead)
+            {
+                // keep reading ahead of sequential access
+                scheduleBackgroundIO(pageId, true);
+            }
+            lastAccessedPageId = pageId;
             return cache_page_id;
         }
         CHAR16 pageName[64];
         generatePageName(pageName, pageId);
         cache_page_id = getMostOutdatedCachePageExceptCurrentPage();
-        if (cachePageId[cache_page_id] != INVALID_PAGE_ID)
+        if (cache_page_id == -1)
+        {
+            return -1;
+        }
+        if (cachePageId[cache_page_id] != INVALID_PAGE_ID && !isSlotClean(cache_page_id))
         {
             writePageToDisk(cachePageId[cache_page_id]);
         }
@@ -780,6 +1147,7 @@ private:
         }
 #endif
         unsigned long long sz = 0;
+        pageVersion[pageId]++;
         if (isPageWrittenToDisk[pageId])
         {
             sz = load(pageName, pageSize, (unsigned char*)cache[cache_page_id], pageDir);
@@ -797,7 +1165,7 @@ private:
         }
         lastAccessedTimestamp[cache_page_id] = now_ms();
 #endif
-        cachePageId[cache_page_id] = pageId;
+        setCachePageId(cache_page_id, pageId);
 #if !defined(NDEBUG)
         {
             CHAR16 debugMsg[128];
@@ -814,38 +1182,277 @@ private:
             addDebugMessage(debugMsg);
         }
 #endif
+        markSlotAccessed(cache_page_id);
+        stats.misses++;
+        stallTicks += __rdtsc() - stallBegin;
+        scheduleBackgroundIO(pageId, pageId == lastAccessedPageId + 1);
+        lastAccessedPageId = pageId;
         return cache_page_id;
     }
 
-    // return the most outdated cache page
+    // return the slot to evict, -1 if all slots are in use
+    // Slots written back in the background are preferred, because they can be reused without writing. They are
+    // never newer than the dirty slots, as only the least recently used slots are written back.
     int getMostOutdatedCachePageExceptCurrentPage()
     {
-        int min_index = 0;
+        int min_index = -1;
+        int min_clean_index = -1;
         for (int i = 0; i <= numCachePage; i++)
         {
-            if (lastAccessedTimestamp[i] == 0 && cachePageId[i] != currentPageId)
+            if (cachePageId[i] == currentPageId || slotIOState[i] != IO_NONE) // skip current page and slots used by background I/O
+            {
+                continue;
+            }
+            if (lastAccessedTimestamp[i] == 0)
             {
                 return i;
             }
-            if ((lastAccessedTimestamp[i] < lastAccessedTimestamp[min_index]) || (lastAccessedTimestamp[i] == lastAccessedTimestamp[min_index] && cachePageId[i] < cachePageId[min_index]))
+            if (min_index == -1 || (lastAccessedTimestamp[i] < lastAccessedTimestamp[min_index]) || (lastAccessedTimestamp[i] == lastAccessedTimestamp[min_index] && cachePageId[i] < cachePageId[min_index]))
             {
-                if (cachePageId[i] != currentPageId) // skip current page
+                min_index = i;
+            }
+            if (isSlotClean(i) && !slotLoadedAhead[i] && (min_clean_index == -1 || slotAccessSeq[i] < slotAccessSeq[min_clean_index]))
+            {
+                min_clean_index = i;
+            }
+        }
+        return (min_clean_index != -1) ? min_clean_index : min_index;
+    }
+
+    void markSlotAccessed(int slot)
+    {
+        slotAccessSeq[slot] = ++accessSeq;
+        slotLoadedAhead[slot] = false;
+    }
+
+    bool isSlotClean(int slot)
+    {
+        return slotCleanSeq[slot] == slotAccessSeq[slot];
+    }
+
+    // return the slot pageId is being loaded into in the background, -1 if none
+    int findLoadingSlot(unsigned long long pageId)
+    {
+        for (int i = 0; i <= numCachePage; i++)
+        {
+            if (slotIOState[i] != IO_NONE && slotIOIsRead[i] && slotIOPageId[i] == pageId)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // return the least recently used slot that can be written back (isClean = false) or reused for reading ahead
+    // (isClean = true), -1 if there is none
+    int getOldestSlotForBackgroundIO(bool isClean)
+    {
+        int min_index = -1;
+        for (int i = 0; i <= numCachePage; i++)
+        {
+            if (cachePageId[i] == currentPageId || slotIOState[i] != IO_NONE)
+            {
+                continue;
+            }
+            if (isClean)
+            {
+                if (cachePageId[i] != INVALID_PAGE_ID && (!isSlotClean(i) || slotLoadedAhead[i]))
                 {
-                    min_index = i;
+                    continue;
                 }
             }
+            else if (cachePageId[i] == INVALID_PAGE_ID || isSlotClean(i) || slotAccessSeq[i] == accessSeq)
+            {
+                continue;
+            }
+            if (min_index == -1 || slotAccessSeq[i] < slotAccessSeq[min_index])
+            {
+                min_index = i;
+            }
         }
         return min_index;
     }
+
+    // Queue background I/O after pageId has been accessed (following the previously accessed page if isSequential),
+    // caller must hold memLock
+    void scheduleBackgroundIO(unsigned long long pageId, bool isSequential)
+    {
+#ifdef NO_UEFI
+        if (isBackgroundIOPaused)
+        {
+            return;
+        }
+
+        // load the following pages of sequential access into clean slots first, as they are needed soonest
+        if (mode == SwapMode::INDEX_MODE && isReadAheadEnabled && isSequential)
+        {
+            for (unsigned long long nextPageId = pageId + 1; nextPageId <= pageId + readAheadPages && nextPageId < MAX_PAGE && pendingIO < maxPendingIO; nextPageId++)
+            {
+                if (!isPageWrittenToDisk[nextPageId] || lookUpCachePage(nextPageId) != -1 || findLoadingSlot(nextPageId) != -1)
+                {
+                    continue;
+                }
+                const int slot = getOldestSlotForBackgroundIO(true);
+                if (slot == -1)
+                {
+                    break;
+                }
+                // the page in the slot is clean, so it can be loaded from disk again if it is needed before
+                setCachePageId(slot, INVALID_PAGE_ID);
+                lastAccessedTimestamp[slot] = 0;
+                if (!startBackgroundIO(slot, true, nextPageId))
+                {
+                    break;
+                }
+            }
+        }
+
+        // write back the least recently used pages, which would be evicted next
+        for (int i = 0; i < writeBehindPages && pendingIO < maxPendingIO; i++)
+        {
+            const int slot = getOldestSlotForBackgroundIO(false);
+            if (slot == -1 || !startBackgroundIO(slot, false, cachePageId[slot]))
+            {
+                break;
+            }
+        }
+#endif
+    }
+
+    // Queue writing slot to disk or loading pageId into slot. The worker only touches the page buffer of the slot and
+    // slotIOState, so it never waits for memLock. The result is applied by completeBackgroundIO().
+    bool startBackgroundIO(int slot, bool isRead, unsigned long long pageId)
+    {
+#ifdef NO_UEFI
+        slotIOIsRead[slot] = isRead;
+        slotIOPageId[slot] = pageId;
+        slotIOSeq[slot] = slotAccessSeq[slot];
+        slotIOVersion[slot] = pageVersion[pageId];
+        slotIOState[slot] = IO_PENDING;
+        numberOfSlotsInIO++;
+        _InterlockedIncrement(&pendingIO);
+        if (SwapIOWorker::instance().enqueue([this, slot, isRead, pageId]()
+            {
+                CHAR16 pageName[64];
+                generatePageName(pageName, pageId);
+                const long long size = (isRead) ? load(pageName, pageSize, (unsigned char*)cache[slot], pageDir)
+                                                : save(pageName, pageSize, (unsigned char*)cache[slot], pageDir);
+                ATOMIC_STORE8(slotIOState[slot], (size == (long long)pageSize) ? IO_DONE : IO_FAILED);
+                _InterlockedDecrement(&pendingIO);
+            }, isRead))
+        {
+            return true;
+        }
+        slotIOState[slot] = IO_NONE;
+        numberOfSlotsInIO--;
+        _InterlockedDecrement(&pendingIO);
+        if (isRead)
+        {
+            // slot has been cleared for reading ahead
+            slotCleanSeq[slot] = slotAccessSeq[slot];
+        }
+#endif
+        return false;
+    }
+
+    // Apply the results of finished background I/O, caller must hold memLock
+    void completeBackgroundIO()
+    {
+        for (int slot = 0; slot <= numCachePage; slot++)
+        {
+            const char state = slotIOState[slot];
+            if (state == IO_NONE || state == IO_PENDING)
+            {
+                continue;
+            }
+            const unsigned long long pageId = slotIOPageId[slot];
+            if (slotIOIsRead[slot])
+            {
+                // discard the page if it has been loaded or written since the read-ahead was queued
+                if (state == IO_DONE && pageVersion[pageId] == slotIOVersion[slot] && lookUpCachePage(pageId) == -1)
+                {
+                    setCachePageId(slot, pageId);
+                    lastAccessedTimestamp[slot] = now_ms();
+                    slotLoadedAhead[slot] = true;
+                    stats.readAheadPages++;
+                }
+                slotCleanSeq[slot] = slotAccessSeq[slot];
+            }
+            else if (state == IO_DONE)
+            {
+                isPageWrittenToDisk[pageId] = true;
+                pageVersion[pageId]++;
+                // the slot is only clean if it hasn't been accessed (and maybe changed) while it was written
+                if (slotAccessSeq[slot] == slotIOSeq[slot])
+                {
+                    slotCleanSeq[slot] = slotIOSeq[slot];
+                    stats.writtenBehindPages++;
+                }
+            }
+            slotIOState[slot] = IO_NONE;
+            numberOfSlotsInIO--;
+        }
+    }
+
+    // Stop queuing background I/O and wait until the queued I/O is done, for operations on the whole cache
+    void pauseBackgroundIO()
+    {
+        ACQUIRE(memLock);
+        isBackgroundIOPaused = true;
+        RELEASE(memLock);
+        while (pendingIO)
+        {
+            sleepMicroseconds(100);
+        }
+        ACQUIRE(memLock);
+        completeBackgroundIO();
+        RELEASE(memLock);
+    }
+
+    void resumeBackgroundIO()
+    {
+        isBackgroundIOPaused = false;
+    }
+
+    void resetBackgroundIO()
+    {
+        accessSeq = 0;
+        lastAccessedPageId = INVALID_PAGE_ID;
+        setMem(slotAccessSeq, sizeof(slotAccessSeq), 0);
+        setMem(slotCleanSeq, sizeof(slotCleanSeq), 0);
+        setMem(slotLoadedAhead, sizeof(slotLoadedAhead), 0);
+        setMem((void*)slotIOState, sizeof(slotIOState), IO_NONE);
+        numberOfSlotsInIO = 0;
+        setMem(&stats, sizeof(stats), 0);
+        stallTicks = 0;
+    }
 public:
     SwapVirtualMemory()
     {
         VMBase();
+        pendingIO = 0;
+        isBackgroundIOPaused = false;
+        isReadAheadEnabled = true;
+        resetBackgroundIO();
+    }
+
+    ~SwapVirtualMemory()
+    {
+        pauseBackgroundIO();
+    }
+
+    // Wait until the queued background I/O is done
+    void waitForBackgroundIO()
+    {
+        pauseBackgroundIO();
+        resumeBackgroundIO();
     }
 
     void reset() {
+        pauseBackgroundIO();
         VMBase::reset();
         setMem(isPageWrittenToDisk, isPageWrittenToDiskSize, 0);
+        setMem(pageVersion, pageVersionSize, 0);
         if (mode == SwapMode::OFFSET_MODE) {
             setMem(pageExtraBytesBuffer, pageExtraBytesBufferSize, 0);
             setMem(pageHasExtraBytes, pageHasExtraBytesBufferSize, 0);
@@ -853,6 +1460,8 @@ public:
         }
         VMBase::deinit();
         VMBase::init();
+        resetBackgroundIO();
+        resumeBackgroundIO();
     }
 
     bool init()
@@ -860,7 +1469,8 @@ public:
     {
         ASSERT(extraBytesPerElement >= 0);
         pageSize = maxBytesPerPage;
-        if (!allocPoolWithErrorLog(L"SwapVM.IsPageWrittenToDisk", isPageWrittenToDiskSize, (void**)&isPageWrittenToDisk, __LINE__))
+        if (!allocPoolWithErrorLog(L"SwapVM.IsPageWrittenToDisk", isPageWrittenToDiskSize, (void**)&isPageWrittenToDisk, __LINE__)
+            || !allocPoolWithErrorLog(L"SwapVM.PageVersion", pageVersionSize, (void**)&pageVersion, __LINE__))
         {
             return false;
         }
@@ -879,7 +1489,8 @@ public:
     bool init()
     requires (mode == SwapMode::INDEX_MODE)
     {
-        if (!allocPoolWithErrorLog(L"SwapVM.IsPageWrittenToDisk", isPageWrittenToDiskSize, (void**)&isPageWrittenToDisk, __LINE__))
+        if (!allocPoolWithErrorLog(L"SwapVM.IsPageWrittenToDisk", isPageWrittenToDiskSize, (void**)&isPageWrittenToDisk, __LINE__)
+            || !allocPoolWithErrorLog(L"SwapVM.PageVersion", pageVersionSize, (void**)&pageVersion, __LINE__))
         {
             return false;
         }
@@ -1023,6 +1634,7 @@ public:
 
     unsigned long long dumpVMState(unsigned char* buffer)
     {
+        pauseBackgroundIO();
         ACQUIRE(memLock);
         unsigned long long ret = 0;
         for (int i = 0; i <= numCachePage; i++)
@@ -1063,11 +1675,13 @@ public:
         buffer += 8;
         ret += 8;
         RELEASE(memLock);
+        resumeBackgroundIO();
         return ret;
     }
 
     unsigned long long loadVMState(unsigned char* buffer)
     {
+        pauseBackgroundIO();
         ACQUIRE(memLock);
         unsigned long long ret = 0;
         for (int i = 0; i <= numCachePage; i++)
@@ -1103,20 +1717,45 @@ public:
         copyMem(cachePageId, buffer, sizeof(cachePageId));
         buffer += sizeof(cachePageId);
         ret += sizeof(cachePageId);
+        rebuildPageTable();
 
         currentPageId = *((unsigned long long*)buffer);
         buffer += 8;
         ret += 8;
 
+        // the restored pages may not be on disk
+        resetBackgroundIO();
+        for (int i = 0; i <= numCachePage; i++)
+        {
+            markSlotAccessed(i);
+        }
+
         RELEASE(memLock);
+        resumeBackgroundIO();
         return ret;
     }
 
+    // Hint that the data is accessed randomly, so no pages are loaded ahead
+    void adviseRandomAccess()
+    {
+        isReadAheadEnabled = false;
+    }
+
+    SwapStats getStats()
+    {
+        ACQUIRE(memLock);
+        SwapStats result = stats;
+        result.stallMicroseconds = (frequency) ? stallTicks * 1000000 / frequency : 0;
+        RELEASE(memLock);
+        return result;
+    }
+
     T* getPageBuffer(unsigned long long pageId) {
         auto cacheIndex = findCachePage(pageId);
         if (cacheIndex == -1) {
             return nullptr;
         }
+        markSlotAccessed(cacheIndex); // the caller may write to the page
         return cache[cacheIndex];
     }
 
@@ -1140,4 +1779,243 @@ public:
     {
         return currentPage;
     }
-};
\ No newline at end of file
+};
+#ifdef __linux__
+// Linux alternative to SwapVirtualMemory with the same access functions (getRef, getPtr, operator[], operator()).
+// All data is stored in one sparse file per instance, which is mapped into memory. The kernel pages the data in and out
+// of the page cache, so there is no cache of page copies managed here, no page file is saved or loaded on the caller's
+// thread, and pointers stay valid until the storage is reset.
+// capacity is the number of items (INDEX_MODE) or bytes (OFFSET_MODE) that can be accessed. In OFFSET_MODE an element
+// is always contiguous, so there is no need for the extra buffers of SwapVirtualMemory.
+// The file keeps its data when the node is restarted, but it is only used again if the state is restored with
+// loadVMState(). Otherwise it is cleared before the first access.
+// NOTE: DO NOT CREATE INSTANCE IN FUNCTION STACK, ONLY ONE INSTANCE PER prefixName AND pageDirectory
+template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long capacity, SwapMode mode = INDEX_MODE, long long extraBytesPerElement = 0>
+class MappedSwapVirtualMemory
+{
+private:
+    static constexpr unsigned long long mappingSize = (mode == SwapMode::INDEX_MODE) ? capacity * sizeof(T) : capacity + sizeof(T) + extraBytesPerElement;
+
+    struct VMState
+    {
+        unsigned long long prefix;
+        unsigned long long mappingSize;
+    };
+
+    unsigned char* mapping = nullptr;
+    int fd = -1;
+    std::string path;
+    volatile bool hasUnrestoredData = false;
+    volatile char memLock = 0;
+
+    bool open()
+    {
+        if (mapping)
+        {
+            return true;
+        }
+
+        // Same directory as the page files of VirtualMemory
+        CHAR16 directory[16];
+        setMem(directory, sizeof(directory), 0);
+        unsigned long long tmp = prefixName;
+        copyMem(directory, &tmp, 8);
+        tmp = pageDirectory;
+        copyMem(directory + 4, &tmp, 8);
+#ifdef REAL_NODE
+        addEpochToFileName(directory, 12, max(EPOCH, int(system.epoch)));
+#else
+        addEpochToFileName(directory, 12, 0);
+#endif
+        asyncCreateDir(directory);
+
+        CHAR16 fileName[16];
+        setMem(fileName, sizeof(fileName), 0);
+        tmp = prefixName;
+        copyMem(fileName, &tmp, 8);
+        appendText(fileName, L".swap");
+        path = wchar_to_string(directory) + "/" + wchar_to_string(fileName);
+
+        // The file is sparse, disk space is only used for the pages written
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 || ftruncate(fd, mappingSize) != 0)
+        {
+            logToConsole(L"MappedSwapVirtualMemory: failed to create backing file");
+            close();
+            return false;
+        }
+        void* address = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+        if (address == MAP_FAILED)
+        {
+            logToConsole(L"MappedSwapVirtualMemory: failed to map backing file");
+            close();
+            return false;
+        }
+        mapping = (unsigned char*)address;
+        madvise(mapping, mappingSize, MADV_DONTDUMP);
+        hasUnrestoredData = true;
+        return true;
+    }
+
+    void close()
+    {
+        if (mapping)
+        {
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    // Zero all data and give the disk space back
+    bool clear()
+    {
+        return ftruncate(fd, 0) == 0 && ftruncate(fd, mappingSize) == 0;
+    }
+
+    void prepareAccess(unsigned long long position)
+    {
+        if (position >= capacity || !mapping)
+        {
+            setText(message, L"Fatal Error: Invalid MappedSwapVirtualMemory access | Line ");
+            appendNumber(message, __LINE__, true);
+            logToConsole(message);
+            // Exit program
+            exit(1);
+        }
+        if (hasUnrestoredData)
+        {
+            ACQUIRE(memLock);
+            if (hasUnrestoredData)
+            {
+                clear();
+                hasUnrestoredData = false;
+            }
+            RELEASE(memLock);
+        }
+    }
+
+public:
+    bool init()
+    {
+        ACQUIRE(memLock);
+        const bool ok = open();
+        RELEASE(memLock);
+        return ok;
+    }
+
+    void deinit()
+    {
+        ACQUIRE(memLock);
+        close();
+        RELEASE(memLock);
+    }
+
+    // Drop all data, the new file is created in the directory of the current epoch
+    void reset()
+    {
+        ACQUIRE(memLock);
+        close();
+        if (!path.empty())
+        {
+            unlink(path.c_str());
+        }
+        if (open())
+        {
+            hasUnrestoredData = false;
+        }
+        RELEASE(memLock);
+    }
+
+    // Hint that the data is accessed randomly, so the kernel doesn't read ahead on page faults
+    void adviseRandomAccess()
+    {
+        if (mapping)
+        {
+            madvise(mapping, mappingSize, MADV_RANDOM);
+        }
+    }
+
+    // Paging is done by the kernel, so there are no statistics of the storage itself
+    SwapStats getStats()
+    {
+        SwapStats stats;
+        setMem(&stats, sizeof(stats), 0);
+        return stats;
+    }
+
+    T& getRef(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return *getPtr(index);
+    }
+
+    T* getPtr(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        prepareAccess(index);
+        return (T*)mapping + index;
+    }
+
+    T* operator[](unsigned long long offset)
+    requires (mode == SwapMode::OFFSET_MODE)
+    {
+        prepareAccess(offset);
+        return (T*)(mapping + offset);
+    }
+
+    T* operator[](unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return getPtr(index);
+    }
+
+    T& operator()(unsigned long long index)
+    requires (mode == SwapMode::INDEX_MODE)
+    {
+        return getRef(index);
+    }
+
+    // The data is persisted in the backing file, so the state only identifies it
+    unsigned long long getVmStateSize()
+    {
+        return sizeof(VMState);
+    }
+
+    // Write all changed data to the backing file and return the state, 0 if writing failed
+    unsigned long long dumpVMState(unsigned char* buffer)
+    {
+        ACQUIRE(memLock);
+        if (!mapping || msync(mapping, mappingSize, MS_SYNC) != 0)
+        {
+            RELEASE(memLock);
+            return 0;
+        }
+        VMState state;
+        state.prefix = prefixName;
+        state.mappingSize = mappingSize;
+        copyMem(buffer, &state, sizeof(state));
+        RELEASE(memLock);
+        return sizeof(state);
+    }
+
+    // Keep using the data in the backing file, return 0 if the state doesn't belong to this storage
+    unsigned long long loadVMState(unsigned char* buffer)
+    {
+        VMState state;
+        copyMem(&state, buffer, sizeof(state));
+        if (state.prefix != prefixName || state.mappingSize != mappingSize)
+        {
+            return 0;
+        }
+        ACQUIRE(memLock);
+        hasUnrestoredData = false;
+        RELEASE(memLock);
+        return sizeof(state);
+    }
+};
+#endif
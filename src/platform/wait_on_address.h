@@ -0,0 +1,39 @@
+#pragma once
+
+// Blocking wait on a 32-bit value in memory, used to park idle worker threads instead of polling with a fixed sleep.
+// Maps to futex on Linux and to WaitOnAddress on Windows.
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Block while *address == expectedValue, until woken by wakeByAddressSingle() or until the timeout
+// elapses. May return spuriously, so the caller always has to re-check its condition.
+static void waitOnAddress(volatile int* address, int expectedValue, unsigned int timeoutMilliseconds)
+{
+#if defined(_WIN32)
+    WaitOnAddress(address, &expectedValue, sizeof(expectedValue), timeoutMilliseconds);
+#else
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMilliseconds / 1000;
+    timeout.tv_nsec = (timeoutMilliseconds % 1000) * 1000000L;
+    syscall(SYS_futex, (int*)address, FUTEX_WAIT_PRIVATE, expectedValue, &timeout, NULL, 0);
+#endif
+}
+
+// Wake one thread blocked in waitOnAddress() on address.
+static void wakeByAddressSingle(volatile int* address)
+{
+#if defined(_WIN32)
+    WakeByAddressSingle((void*)address);
+#else
+    syscall(SYS_futex, (int*)address, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
@@ -107,6 +107,8 @@
 #include "vote_counter.h"
 #include "ticking/execution_fee_report_collector.h"
 #include "ticking/stable_computor_index.h"
+#include "ticking/tick_vote_cache.h"
+#include "ticking/epoch_stats.h"
 #include "network_messages/execution_fees.h"
 
 #include "contract_core/ipo.h"
@@ -137,6 +139,7 @@ static volatile char enableBadBoySpammer = 0;
 #include "extensions/overload.h"
 
 TickStorage::TransactionsDigestAccess TickStorage::transactionsDigestAccess;
+TickStorage::IdentityTransactionsAccess TickStorage::identityTransactionsAccess;
 #ifdef _WIN32
 #undef system
 #define system qsystem
@@ -170,7 +173,6 @@ struct Processor : public CustomStack
     Type type;
     EFI_EVENT event;
     Peer* peer;
-    void* buffer;
 };
 
 
@@ -209,6 +211,7 @@ static std::vector<unsigned short> ownComputorIndicesMapping = {};
 static TickStorage ts;
 static VoteCounter voteCounter;
 static ExecutionFeeReportCollector executionFeeReportCollector;
+static TickVoteCache tickVoteCache;
 static TickData nextTickData;
 static PendingTxsPool pendingTxsPool;
 
@@ -221,8 +224,6 @@ static unsigned int resourceTestingDigest = 0;
 
 static unsigned int numberOfTransactions = 0;
 
-static unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
-
 static unsigned long long mainLoopNumerator = 0, mainLoopDenominator = 0;
 static unsigned char contractProcessorState = 0;
 static unsigned int contractProcessorPhase;
@@ -562,34 +563,8 @@ static void getComputerDigest(m256i& digest)
 
 static void getSpectrumDigest(m256i& digest)
 {
-    unsigned int digestIndex;
     ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    updateSpectrumDigests();
     digest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
     RELEASE(spectrumLock);
 }
@@ -924,10 +899,16 @@ static void processBroadcastComputors(Peer* peer, RequestResponseHeader* header)
     }
 }
 
-static bool verifyTickVoteSignature(const unsigned char* publicKey, const unsigned char* messageDigest, const unsigned char* signature, const bool curveVerify = true)
+// Tick vote signatures must additionally reach the target "score"
+static bool isTickVoteSignatureScoreReached(const unsigned char* signature)
 {
     unsigned int score = _byteswap_ulong(((unsigned int*)signature)[0]);
-    if (score > TARGET_TICK_VOTE_SIGNATURE) return false;
+    return score <= TARGET_TICK_VOTE_SIGNATURE;
+}
+
+static bool verifyTickVoteSignature(const unsigned char* publicKey, const unsigned char* messageDigest, const unsigned char* signature, const bool curveVerify = true)
+{
+    if (!isTickVoteSignatureScoreReached(signature)) return false;
     if (curveVerify)
     {
         if (!verify(publicKey, messageDigest, signature)) return false;
@@ -935,10 +916,9 @@ static bool verifyTickVoteSignature(const unsigned char* publicKey, const unsign
     return true;
 }
 
-static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
+static bool isBroadcastTickAcceptable(const BroadcastTick* request)
 {
-    BroadcastTick* request = header->getPayload<BroadcastTick>();
-    if (request->tick.computorIndex < NUMBER_OF_COMPUTORS
+    return request->tick.computorIndex < NUMBER_OF_COMPUTORS
         && request->tick.epoch == system.epoch
         && request->tick.tick >= system.tick
         && ts.tickInCurrentEpochStorage(request->tick.tick)
@@ -947,51 +927,139 @@ static void processBroadcastTick(Peer* peer, RequestResponseHeader* header)
         && request->tick.hour <= 23
         && request->tick.minute <= 59
         && request->tick.second <= 59
-        && request->tick.millisecond <= 999)
+        && request->tick.millisecond <= 999;
+}
+
+static void processVerifiedBroadcastTick(Peer* peer, RequestResponseHeader* header)
+{
+    BroadcastTick* request = header->getPayload<BroadcastTick>();
+
+    if (header->isDejavuZero())
     {
-        unsigned char digest[32];
+        enqueueResponse(NULL, header);
+    }
+
+    ts.ticks.acquireLock(request->tick.computorIndex);
+
+    // Find element in tick storage and check if contains data (epoch is set to 0 on init)
+    Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(request->tick.tick) + request->tick.computorIndex;
+    if (tsTick->epoch == system.epoch)
+    {
+        // Check if the sent tick matches the tick in tick storage
+        if (*((unsigned long long*)&request->tick.millisecond) != *((unsigned long long*)&tsTick->millisecond)
+            || request->tick.prevSpectrumDigest != tsTick->prevSpectrumDigest
+            || request->tick.prevUniverseDigest != tsTick->prevUniverseDigest
+            || request->tick.prevComputerDigest != tsTick->prevComputerDigest
+            || request->tick.saltedSpectrumDigest != tsTick->saltedSpectrumDigest
+            || request->tick.saltedUniverseDigest != tsTick->saltedUniverseDigest
+            || request->tick.saltedComputerDigest != tsTick->saltedComputerDigest
+            || request->tick.transactionDigest != tsTick->transactionDigest
+            || request->tick.saltedTransactionBodyDigest != tsTick->saltedTransactionBodyDigest
+            || request->tick.expectedNextTickTransactionDigest != tsTick->expectedNextTickTransactionDigest)
+        {
+            faultyComputorFlags[request->tick.computorIndex >> 6] |= (1ULL << (request->tick.computorIndex & 63));
+        }
+    }
+    else
+    {
+        // Copy the sent tick to the tick storage
+        copyMem(tsTick, &request->tick, sizeof(Tick));
+        peer->lastActiveTick = max(peer->lastActiveTick, peer->getDejavuTick(header->dejavu()));
+    }
+
+    ts.ticks.releaseLock(request->tick.computorIndex);
+}
+
+// Processes the tick vote together with the votes queued directly behind it (up to VERIFY_BATCH_MAX_SIZE in total).
+// Copies of votes verified before are dropped without checking the signature again, the others are verified in one batch.
+static void processBroadcastTicks(Peer* peer, RequestResponseHeader* header)
+{
+    Request* queuedRequests[VERIFY_BATCH_MAX_SIZE];
+    Peer* votePeers[VERIFY_BATCH_MAX_SIZE];
+    RequestResponseHeader* headers[VERIFY_BATCH_MAX_SIZE];
+    unsigned int numberOfVotes = 1;
+    votePeers[0] = peer;
+    headers[0] = header;
+    while (numberOfVotes < VERIFY_BATCH_MAX_SIZE
+        && (queuedRequests[numberOfVotes] = claimRequest(requestQueueLanes[REQUEST_QUEUE_LANE_CONSENSUS], BroadcastTick::type())))
+    {
+        votePeers[numberOfVotes] = queuedRequests[numberOfVotes]->peer;
+        headers[numberOfVotes] = (RequestResponseHeader*)&requestQueueBuffer[queuedRequests[numberOfVotes]->offset];
+        numberOfVotes++;
+    }
+
+    m256i digests[VERIFY_BATCH_MAX_SIZE];
+    const unsigned char* publicKeys[VERIFY_BATCH_MAX_SIZE];
+    const unsigned char* messageDigests[VERIFY_BATCH_MAX_SIZE];
+    const unsigned char* signatures[VERIFY_BATCH_MAX_SIZE];
+    unsigned int batchIndices[VERIFY_BATCH_MAX_SIZE];
+    bool validSignatures[VERIFY_BATCH_MAX_SIZE];
+    unsigned int batchSize = 0;
+    for (unsigned int i = 0; i < numberOfVotes; i++)
+    {
+        BroadcastTick* request = headers[i]->getPayload<BroadcastTick>();
+        if (!isBroadcastTickAcceptable(request))
+        {
+            continue;
+        }
+
         request->tick.computorIndex ^= BroadcastTick::type();
-        KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digest, sizeof(digest));
+        KangarooTwelve(&request->tick, sizeof(Tick) - SIGNATURE_SIZE, digests[batchSize].m256i_u8, sizeof(digests[batchSize]));
         request->tick.computorIndex ^= BroadcastTick::type();
-        const bool verifyFourQCurve = true;
-        if (verifyTickVoteSignature(broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8, digest, request->tick.signature, verifyFourQCurve))
+
+        if (!isTickVoteSignatureScoreReached(request->tick.signature))
         {
-            if (header->isDejavuZero())
-            {
-                enqueueResponse(NULL, header);
-            }
+            tickVoteCache.countRejected(request->tick.tick);
+            continue;
+        }
 
-            ts.ticks.acquireLock(request->tick.computorIndex);
+        // Drop copies of votes that have been verified before or that are already part of this batch
+        bool isDuplicate = tickVoteCache.isVerified(request->tick.computorIndex, request->tick.tick, digests[batchSize], request->tick.signature);
+        for (unsigned int j = 0; j < batchSize && !isDuplicate; j++)
+        {
+            const BroadcastTick* batchRequest = headers[batchIndices[j]]->getPayload<BroadcastTick>();
+            isDuplicate = batchRequest->tick.computorIndex == request->tick.computorIndex
+                && batchRequest->tick.tick == request->tick.tick
+                && digests[j] == digests[batchSize]
+                && *((const m256i*)batchRequest->tick.signature) == *((const m256i*)request->tick.signature)
+                && *((const m256i*)(batchRequest->tick.signature + 32)) == *((const m256i*)(request->tick.signature + 32));
+        }
+        if (isDuplicate)
+        {
+            tickVoteCache.countDeduplicated(request->tick.tick);
+            continue;
+        }
 
-            // Find element in tick storage and check if contains data (epoch is set to 0 on init)
-            Tick* tsTick = ts.ticks.getByTickInCurrentEpoch(request->tick.tick) + request->tick.computorIndex;
-            if (tsTick->epoch == system.epoch)
-            {
-                // Check if the sent tick matches the tick in tick storage
-                if (*((unsigned long long*)&request->tick.millisecond) != *((unsigned long long*)&tsTick->millisecond)
-                    || request->tick.prevSpectrumDigest != tsTick->prevSpectrumDigest
-                    || request->tick.prevUniverseDigest != tsTick->prevUniverseDigest
-                    || request->tick.prevComputerDigest != tsTick->prevComputerDigest
-                    || request->tick.saltedSpectrumDigest != tsTick->saltedSpectrumDigest
-                    || request->tick.saltedUniverseDigest != tsTick->saltedUniverseDigest
-                    || request->tick.saltedComputerDigest != tsTick->saltedComputerDigest
-                    || request->tick.transactionDigest != tsTick->transactionDigest
-                    || request->tick.saltedTransactionBodyDigest != tsTick->saltedTransactionBodyDigest
-                    || request->tick.expectedNextTickTransactionDigest != tsTick->expectedNextTickTransactionDigest)
-                {
-                    faultyComputorFlags[request->tick.computorIndex >> 6] |= (1ULL << (request->tick.computorIndex & 63));
-                }
-            }
-            else
-            {
-                // Copy the sent tick to the tick storage
-                copyMem(tsTick, &request->tick, sizeof(Tick));
-                peer->lastActiveTick = max(peer->lastActiveTick, peer->getDejavuTick(header->dejavu()));
-            }
+        publicKeys[batchSize] = broadcastedComputors.computors.publicKeys[request->tick.computorIndex].m256i_u8;
+        messageDigests[batchSize] = digests[batchSize].m256i_u8;
+        signatures[batchSize] = request->tick.signature;
+        batchIndices[batchSize++] = i;
+    }
+
+    verifyBatch(batchSize, publicKeys, messageDigests, signatures, validSignatures);
 
-            ts.ticks.releaseLock(request->tick.computorIndex);
+    for (unsigned int j = 0; j < batchSize; j++)
+    {
+        const unsigned int i = batchIndices[j];
+        BroadcastTick* request = headers[i]->getPayload<BroadcastTick>();
+        if (validSignatures[j])
+        {
+            tickVoteCache.addVerified(request->tick.computorIndex, request->tick.tick, digests[j], request->tick.signature);
+            tickVoteCache.countVerified(request->tick.tick);
+            processVerifiedBroadcastTick(votePeers[i], headers[i]);
+        }
+        else
+        {
+            tickVoteCache.countRejected(request->tick.tick);
         }
     }
+
+    // The first request is released by the caller
+    for (unsigned int i = 1; i < numberOfVotes; i++)
+    {
+        releaseRequest(queuedRequests[i]);
+    }
+    _InterlockedExchangeAdd64(&numberOfProcessedRequests, numberOfVotes - 1);
 }
 
 static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* header)
@@ -1100,52 +1168,100 @@ static void processBroadcastFutureTickData(Peer* peer, RequestResponseHeader* he
     }
 }
 
-static void processBroadcastTransaction(Peer* peer, RequestResponseHeader* header)
+static void processVerifiedBroadcastTransaction(RequestResponseHeader* header)
 {
     Transaction* request = header->getPayload<Transaction>();
     const unsigned int transactionSize = request->totalSize();
-    if (request->checkValidity() && transactionSize == header->size() - sizeof(RequestResponseHeader))
+
+    if (header->isDejavuZero())
     {
-        unsigned char digest[32];
-        KangarooTwelve(request, transactionSize - SIGNATURE_SIZE, digest, sizeof(digest));
-        if (verify(request->sourcePublicKey.m256i_u8, digest, request->signaturePtr()))
-        {
-            if (header->isDejavuZero())
-            {
-                enqueueResponse(NULL, header);
-            }
+        enqueueResponse(NULL, header);
+    }
 
-            pendingTxsPool.add(request);
+    pendingTxsPool.add(request);
 
-            unsigned int tickIndex = ts.tickToIndexCurrentEpoch(request->tick);
-            ts.tickData.acquireLock();
-            if (request->tick == system.tick + 1
-                && ts.tickData[tickIndex].epoch == system.epoch)
+    unsigned int tickIndex = ts.tickToIndexCurrentEpoch(request->tick);
+    ts.tickData.acquireLock();
+    if (request->tick == system.tick + 1
+        && ts.tickData[tickIndex].epoch == system.epoch)
+    {
+        unsigned char digest[32];
+        KangarooTwelve(request, transactionSize, digest, sizeof(digest));
+        auto* tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
+        for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+        {
+            if (digest == ts.tickData[tickIndex].transactionDigests[i])
             {
-                KangarooTwelve(request, transactionSize, digest, sizeof(digest));
-                auto* tsReqTickTransactionOffsets = ts.tickTransactionOffsets.getByTickIndex(tickIndex);
-                for (unsigned int i = 0; i < NUMBER_OF_TRANSACTIONS_PER_TICK; i++)
+                ts.tickTransactions.acquireLock();
+                if (!tsReqTickTransactionOffsets[i])
                 {
-                    if (digest == ts.tickData[tickIndex].transactionDigests[i])
+                    if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
                     {
-                        ts.tickTransactions.acquireLock();
-                        if (!tsReqTickTransactionOffsets[i])
-                        {
-                            if (ts.nextTickTransactionOffset + transactionSize <= ts.tickTransactions.storageSpaceCurrentEpoch)
-                            {
-                                tsReqTickTransactionOffsets[i] = ts.nextTickTransactionOffset;
-                                copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), request, transactionSize);
-                                ts.nextTickTransactionOffset += transactionSize;
-                            }
-                        }
-                        ts.tickTransactions.releaseLock();
-                        break;
+                        tsReqTickTransactionOffsets[i] = ts.nextTickTransactionOffset;
+                        copyMem(ts.tickTransactions(ts.nextTickTransactionOffset), request, transactionSize);
+                        ts.nextTickTransactionOffset += transactionSize;
                     }
                 }
+                ts.tickTransactions.releaseLock();
+                break;
             }
-            ts.tickData.releaseLock();
         }
     }
+    ts.tickData.releaseLock();
+}
+
+// Processes the broadcast transaction together with the transactions queued directly behind it (up to
+// VERIFY_BATCH_MAX_SIZE in total), so that their signatures are verified in one batch.
+static void processBroadcastTransactions(RequestResponseHeader* header)
+{
+    Request* queuedRequests[VERIFY_BATCH_MAX_SIZE];
+    RequestResponseHeader* headers[VERIFY_BATCH_MAX_SIZE];
+    unsigned int numberOfTransactions = 1;
+    headers[0] = header;
+    while (numberOfTransactions < VERIFY_BATCH_MAX_SIZE
+        && (queuedRequests[numberOfTransactions] = claimRequest(requestQueueLanes[REQUEST_QUEUE_LANE_TRANSACTIONS], BROADCAST_TRANSACTION)))
+    {
+        headers[numberOfTransactions] = (RequestResponseHeader*)&requestQueueBuffer[queuedRequests[numberOfTransactions]->offset];
+        numberOfTransactions++;
+    }
+
+    unsigned char digests[VERIFY_BATCH_MAX_SIZE][32];
+    const unsigned char* publicKeys[VERIFY_BATCH_MAX_SIZE];
+    const unsigned char* messageDigests[VERIFY_BATCH_MAX_SIZE];
+    const unsigned char* signatures[VERIFY_BATCH_MAX_SIZE];
+    unsigned int batchIndices[VERIFY_BATCH_MAX_SIZE];
+    bool validSignatures[VERIFY_BATCH_MAX_SIZE];
+    unsigned int batchSize = 0;
+    for (unsigned int i = 0; i < numberOfTransactions; i++)
+    {
+        Transaction* request = headers[i]->getPayload<Transaction>();
+        const unsigned int transactionSize = request->totalSize();
+        if (request->checkValidity() && transactionSize == headers[i]->size() - sizeof(RequestResponseHeader))
+        {
+            KangarooTwelve(request, transactionSize - SIGNATURE_SIZE, digests[batchSize], sizeof(digests[batchSize]));
+            publicKeys[batchSize] = request->sourcePublicKey.m256i_u8;
+            messageDigests[batchSize] = digests[batchSize];
+            signatures[batchSize] = request->signaturePtr();
+            batchIndices[batchSize++] = i;
+        }
+    }
+
+    verifyBatch(batchSize, publicKeys, messageDigests, signatures, validSignatures);
+
+    for (unsigned int j = 0; j < batchSize; j++)
+    {
+        if (validSignatures[j])
+        {
+            processVerifiedBroadcastTransaction(headers[batchIndices[j]]);
+        }
+    }
+
+    // The first request is released by the caller
+    for (unsigned int i = 1; i < numberOfTransactions; i++)
+    {
+        releaseRequest(queuedRequests[i]);
+    }
+    _InterlockedExchangeAdd64(&numberOfProcessedRequests, numberOfTransactions - 1);
 }
 
 static void processRequestComputors(Peer* peer, RequestResponseHeader* header)
@@ -2090,6 +2206,77 @@ static void checkAndSwitchMiningPhase(short tickEpoch, TimeDate tickDate, bool r
     RELEASE(gIsInCustomMiningStateLock);
 }
 
+// Add system.tick to the epoch statistics, called by the tick processor before moving on to the next tick
+static void addTickToEpochStats(unsigned int tickIndex)
+{
+    // tickTicks[last] is the start of the tick, unless the node has just been started
+    const unsigned long long tickStart = tickTicks[sizeof(tickTicks) / sizeof(tickTicks[0]) - 1];
+    const unsigned long long duration = (tickStart) ? (__rdtsc() - tickStart) * 1000 / frequency : EpochStats::unknownTickDuration;
+
+    unsigned int tickTransactions = 0;
+    ts.tickData.acquireLock();
+    const TickData& td = ts.tickData[tickIndex];
+    const bool isEmpty = (td.epoch == 0 || td.epoch == INVALIDATED_TICK_DATA);
+    if (!isEmpty)
+    {
+        for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+        {
+            if (!isZero(td.transactionDigests[transactionIndex]))
+            {
+                tickTransactions++;
+            }
+        }
+    }
+    ts.tickData.releaseLock();
+
+    epochStats.addTick(system.tick, isEmpty, tickTransactions, duration);
+}
+
+#if TICK_STORAGE_AUTOSAVE_MODE
+// Count the ticks of the current epoch up to system.tick from the tick storage, if the statistics couldn't be loaded
+// from the snapshot. The durations of these ticks are unknown.
+static void rebuildEpochStats()
+{
+    epochStats.beginEpoch(system.epoch, system.initialTick);
+    for (unsigned int tick = system.initialTick; tick < system.tick; tick++)
+    {
+        unsigned int tickTransactions = 0;
+        ts.tickData.acquireLock();
+        const TickData* td = ts.tickData.getByTickIfNotEmpty(tick);
+        if (td)
+        {
+            for (unsigned int transactionIndex = 0; transactionIndex < NUMBER_OF_TRANSACTIONS_PER_TICK; transactionIndex++)
+            {
+                if (!isZero(td->transactionDigests[transactionIndex]))
+                {
+                    tickTransactions++;
+                }
+            }
+        }
+        ts.tickData.releaseLock();
+
+        epochStats.addTick(tick, !td, tickTransactions, EpochStats::unknownTickDuration);
+    }
+}
+#endif
+
+// Publish the spectrum and universe at the start of system.tick for the HTTP handlers, if state snapshots are enabled.
+// Called by the tick processor after moving on to the next tick.
+static void publishStateSnapshot()
+{
+    if (!stateSnapshots.isEnabled())
+    {
+        return;
+    }
+
+    // universeLock before spectrumLock, as in distributing dividends
+    ACQUIRE(universeLock);
+    ACQUIRE(spectrumLock);
+    stateSnapshots.publish(system.epoch, system.tick, spectrum, assets, assetChangeFlags, as.indexLists);
+    RELEASE(spectrumLock);
+    RELEASE(universeLock);
+}
+
 // Updates the global numberTickTransactions based on the tick data in the tick storage.
 static void updateNumberOfTickTransactions()
 {
@@ -2126,42 +2313,24 @@ static void requestProcessor(void* ProcedureArgument, unsigned long long process
 
     //const unsigned long long processorNumber = getRunningProcessorID();
 
-    Processor* processor = (Processor*)ProcedureArgument;
-    RequestResponseHeader* header = (RequestResponseHeader*)processor->buffer;
+    unsigned int requestQueueScheduleSlot = 0;
     while (!shutDownNode)
     {
         checkinTime(processorNumber);
-        std::this_thread::sleep_for(std::chrono::microseconds(50));
         // in epoch transition, wait here
         if (epochTransitionState)
         {
             _InterlockedIncrement(&epochTransitionWaitingRequestProcessors);
             BEGIN_WAIT_WHILE(epochTransitionState)
             {
-                {
-                    // to avoid potential overflow: consume the queue without processing requests
-                    ACQUIRE(requestQueueTailLock);
-                    if (requestQueueElementTail == requestQueueElementHead)
-                    {
-                        RELEASE(requestQueueTailLock);
-                    }
-                    else
-                    {
-                        {
-                            RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                            copyMem(header, requestHeader, requestHeader->size());
-                            requestQueueBufferTail += requestHeader->size();
-                        }
-
-                        Peer* peer = requestQueueElements[requestQueueElementTail].peer;
+                // help hashing the spectrum and universe trees, which are rebuilt during the epoch transition
+                merkleTreeBuilder.help();
 
-                        if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                        {
-                            requestQueueBufferTail = 0;
-                        }
-                        requestQueueElementTail++;
-                        RELEASE(requestQueueTailLock);
-                    }
+                // to avoid potential overflow: consume the queue without processing requests
+                Request* request = claimRequest(requestQueueScheduleSlot);
+                if (request)
+                {
+                    releaseRequest(request);
                 }
             }
             END_WAIT_WHILE();
@@ -2175,234 +2344,222 @@ static void requestProcessor(void* ProcedureArgument, unsigned long long process
             score->tryProcessSolution(processorNumber);
         }
         
-        if (requestQueueElementTail == requestQueueElementHead)
+        Request* request = claimRequest(requestQueueScheduleSlot);
+        if (!request)
         {
-            _mm_pause();
+            // help with a running Merkle tree rebuild, otherwise sleep until the main thread enqueues a request
+            // (waking up regularly for check-in and solution processing)
+            if (!merkleTreeBuilder.help())
+            {
+                waitForRequests(1);
+            }
         }
         else
         {
-            ACQUIRE(requestQueueTailLock);
+            PROFILE_NAMED_SCOPE("requestProcessor(): request processing");
+            const unsigned long long beginningTick = __rdtsc();
+
+            // the message is processed in place, its space in the queue is reused after releaseRequest()
+            RequestResponseHeader* header = (RequestResponseHeader*)&requestQueueBuffer[request->offset];
+            Peer* peer = request->peer;
 
-            if (requestQueueElementTail == requestQueueElementHead)
+            switch (header->type())
             {
-                RELEASE(requestQueueTailLock);
-            }
-            else
+            case ExchangePublicPeers::type():
             {
-                PROFILE_NAMED_SCOPE("requestProcessor(): request processing");
-                const unsigned long long beginningTick = __rdtsc();
-
-                {
-                    RequestResponseHeader* requestHeader = (RequestResponseHeader*)&requestQueueBuffer[requestQueueElements[requestQueueElementTail].offset];
-                    copyMem(header, requestHeader, requestHeader->size());
-                    requestQueueBufferTail += requestHeader->size();
-                }
-
-                Peer* peer = requestQueueElements[requestQueueElementTail].peer;
-
-                if (requestQueueBufferTail > REQUEST_QUEUE_BUFFER_SIZE - BUFFER_SIZE)
-                {
-                    requestQueueBufferTail = 0;
-                }
-                requestQueueElementTail++;
-
-                RELEASE(requestQueueTailLock);
-                switch (header->type())
-                {
-                case ExchangePublicPeers::type():
-                {
-                    processExchangePublicPeers(peer, header);
-                }
-                break;
+                processExchangePublicPeers(peer, header);
+            }
+            break;
 
-                case BroadcastMessage::type():
-                {
-                    processBroadcastMessage(processorNumber, header);
-                }
-                break;
+            case BroadcastMessage::type():
+            {
+                processBroadcastMessage(processorNumber, header);
+            }
+            break;
 
-                case BroadcastComputors::type():
-                {
-                    processBroadcastComputors(peer, header);
-                }
-                break;
+            case BroadcastComputors::type():
+            {
+                processBroadcastComputors(peer, header);
+            }
+            break;
 
-                case BroadcastTick::type():
-                {
-                    processBroadcastTick(peer, header);
-                }
-                break;
+            case BroadcastTick::type():
+            {
+                processBroadcastTicks(peer, header);
+            }
+            break;
 
-                case BroadcastFutureTickData::type():
-                {
-                    processBroadcastFutureTickData(peer, header);
-                }
-                break;
+            case BroadcastFutureTickData::type():
+            {
+                processBroadcastFutureTickData(peer, header);
+            }
+            break;
 
-                case BROADCAST_TRANSACTION:
-                {
-                    processBroadcastTransaction(peer, header);
-                }
-                break;
+            case BROADCAST_TRANSACTION:
+            {
+                processBroadcastTransactions(header);
+            }
+            break;
 
-                case RequestComputors::type():
-                {
-                    processRequestComputors(peer, header);
-                }
-                break;
+            case RequestComputors::type():
+            {
+                processRequestComputors(peer, header);
+            }
+            break;
 
-                case RequestQuorumTick::type():
-                {
-                    processRequestQuorumTick(peer, header);
-                }
-                break;
+            case RequestQuorumTick::type():
+            {
+                processRequestQuorumTick(peer, header);
+            }
+            break;
 
-                case RequestTickData::type():
-                {
-                    processRequestTickData(peer, header);
-                }
-                break;
+            case RequestTickData::type():
+            {
+                processRequestTickData(peer, header);
+            }
+            break;
 
-                case RequestTickTransactions::type():
-                {
-                    processRequestTickTransactions(peer, header);
-                }
-                break;
+            case RequestTickTransactions::type():
+            {
+                processRequestTickTransactions(peer, header);
+            }
+            break;
 
-                case RequestTransactionInfo::type():
-                {
-                    processRequestTransactionInfo(peer, header);
-                }
-                break;
+            case RequestTransactionInfo::type():
+            {
+                processRequestTransactionInfo(peer, header);
+            }
+            break;
 
-                case RequestCurrentTickInfo::type():
-                {
-                    processRequestCurrentTickInfo(peer, header);
-                }
-                break;
+            case RequestCurrentTickInfo::type():
+            {
+                processRequestCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case RespondCurrentTickInfo::type():
-                {
-                    processResponseCurrentTickInfo(peer, header);
-                }
-                break;
+            case RespondCurrentTickInfo::type():
+            {
+                processResponseCurrentTickInfo(peer, header);
+            }
+            break;
 
-                case RequestEntity::type():
-                {
-                    processRequestEntity(peer, header);
-                }
-                break;
+            case RequestEntity::type():
+            {
+                processRequestEntity(peer, header);
+            }
+            break;
 
-                case RequestActiveIPOs::type():
-                {
-                    processRequestActiveIPOs(peer, header);
-                }
-                break;
+            case RequestActiveIPOs::type():
+            {
+                processRequestActiveIPOs(peer, header);
+            }
+            break;
 
-                case RequestContractIPO::type():
-                {
-                    processRequestContractIPO(peer, header);
-                }
-                break;
+            case RequestContractIPO::type():
+            {
+                processRequestContractIPO(peer, header);
+            }
+            break;
 
-                case RequestIssuedAssets::type():
-                {
-                    processRequestIssuedAssets(peer, header);
-                }
-                break;
+            case RequestIssuedAssets::type():
+            {
+                processRequestIssuedAssets(peer, header);
+            }
+            break;
 
-                case RequestOwnedAssets::type():
-                {
-                    processRequestOwnedAssets(peer, header);
-                }
-                break;
+            case RequestOwnedAssets::type():
+            {
+                processRequestOwnedAssets(peer, header);
+            }
+            break;
 
-                case RequestPossessedAssets::type():
-                {
-                    processRequestPossessedAssets(peer, header);
-                }
-                break;
+            case RequestPossessedAssets::type():
+            {
+                processRequestPossessedAssets(peer, header);
+            }
+            break;
 
-                case RequestContractFunction::type():
-                {
-                    processRequestContractFunction(peer, processorNumber, header);
-                }
-                break;
+            case RequestContractFunction::type():
+            {
+                processRequestContractFunction(peer, processorNumber, header);
+            }
+            break;
 
-                case RequestLog::type():
-                {
-                    logger.processRequestLog(processorNumber, peer, header);
-                }
-                break;
+            case RequestLog::type():
+            {
+                logger.processRequestLog(processorNumber, peer, header);
+            }
+            break;
 
-                case RequestLogIdRangeFromTx::type():
-                {
-                    logger.processRequestTxLogInfo(processorNumber, peer, header);
-                }
-                break;
+            case RequestLogIdRangeFromTx::type():
+            {
+                logger.processRequestTxLogInfo(processorNumber, peer, header);
+            }
+            break;
 
-                case RequestAllLogIdRangesFromTick::type():
-                {
-                    logger.processRequestTickTxLogInfo(processorNumber, peer, header);
-                }
-                break;
+            case RequestAllLogIdRangesFromTick::type():
+            {
+                logger.processRequestTickTxLogInfo(processorNumber, peer, header);
+            }
+            break;
 
-                case RequestPruningLog::type():
-                {
-                    logger.processRequestPrunePageFile(peer, header);
-                }
-                break;
+            case RequestPruningLog::type():
+            {
+                logger.processRequestPrunePageFile(peer, header);
+            }
+            break;
 
-                case RequestLogStateDigest::type():
-                {
-                    logger.processRequestGetLogDigest(peer, header);
-                }
-                break;
+            case RequestLogStateDigest::type():
+            {
+                logger.processRequestGetLogDigest(peer, header);
+            }
+            break;
 
-                case RequestSystemInfo::type():
-                {
-                    processRequestSystemInfo(peer, header);
-                }
-                break;
+            case RequestSystemInfo::type():
+            {
+                processRequestSystemInfo(peer, header);
+            }
+            break;
 
-                case RequestAssets::type():
-                {
-                    processRequestAssets(peer, header);
-                }
-                break;
-                case RequestCustomMiningSolutionVerification::type():
-                {
-                    processRequestedCustomMiningSolutionVerificationRequest(peer, header);
-                }
-                break;
-                case RequestCustomMiningData::type():
-                {
-                    processCustomMiningDataRequest(peer, processorNumber, header);
-                }
-                break;
+            case RequestAssets::type():
+            {
+                processRequestAssets(peer, header);
+            }
+            break;
+            case RequestCustomMiningSolutionVerification::type():
+            {
+                processRequestedCustomMiningSolutionVerificationRequest(peer, header);
+            }
+            break;
+            case RequestCustomMiningData::type():
+            {
+                processCustomMiningDataRequest(peer, processorNumber, header);
+            }
+            break;
 
-                case SpecialCommand::type():
-                {
-                    processSpecialCommand(peer, header);
-                }
-                break;
+            case SpecialCommand::type():
+            {
+                processSpecialCommand(peer, header);
+            }
+            break;
 
 #if ADDON_TX_STATUS_REQUEST
-                /* qli: process RequestTxStatus message */
-                case RequestTxStatus::type():
-                {
-                    processRequestConfirmedTx(processorNumber, peer, header);
-                }
-                break;
+            /* qli: process RequestTxStatus message */
+            case RequestTxStatus::type():
+            {
+                processRequestConfirmedTx(processorNumber, peer, header);
+            }
+            break;
 #endif
 
-                }
+            }
 
-                queueProcessingNumerator += __rdtsc() - beginningTick;
-                queueProcessingDenominator++;
+            releaseRequest(request);
 
-                _InterlockedIncrement64(&numberOfProcessedRequests);
-            }
+            queueProcessingNumerator += __rdtsc() - beginningTick;
+            queueProcessingDenominator++;
+
+            _InterlockedIncrement64(&numberOfProcessedRequests);
         }
     }
 }
@@ -2996,7 +3153,8 @@ static void processTickTransaction(const Transaction* transaction, unsigned int
 
     // Record the tx with digest
     ts.transactionsDigestAccess.acquireLock();
-    ts.transactionsDigestAccess.insertTransaction(transactionDigest, txOffset);
+    ts.transactionsDigestAccess.insertTransaction(transactionDigest, txOffset, transaction->tick, transactionIndex);
+    ts.identityTransactionsAccess.insertTransaction(transaction, transactionIndex);
     ts.transactionsDigestAccess.releaseLock();
 
     const int spectrumIndex = ::spectrumIndex(transaction->sourcePublicKey);
@@ -3514,34 +3672,8 @@ static void processTick(unsigned long long processorNumber)
     PROFILE_SCOPE_END();
 
     PROFILE_NAMED_SCOPE_BEGIN("processTick(): get spectrum digest");
-    unsigned int digestIndex;
     ACQUIRE(spectrumLock);
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-        {
-            KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-            spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-        }
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-            {
-                KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-            }
-            digestIndex++;
-        }
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
-    spectrumChangeFlags[0] = 0;
+    updateSpectrumDigests();
 
     etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
     RELEASE(spectrumLock);
@@ -3899,6 +4031,7 @@ static void beginEpoch()
 #endif
     ts.beginEpoch(system.initialTick);
     pendingTxsPool.beginEpoch(system.initialTick);
+    epochStats.beginEpoch(system.epoch, system.initialTick);
     voteCounter.init();
 #ifndef NDEBUG
     ts.checkStateConsistencyWithAssert();
@@ -4399,6 +4532,16 @@ static bool saveAllNodeStates()
         return false;
     }
 
+    CHAR16 EPOCH_STATS_FILE_NAME[] = L"snapshotEpochStats";
+    logToConsole(L"Saving epoch stats");
+    EpochStats::Data epochStatsData = epochStats.get();
+    savedSize = save(EPOCH_STATS_FILE_NAME, sizeof(epochStatsData), (unsigned char*)&epochStatsData, directory);
+    if (savedSize != sizeof(epochStatsData))
+    {
+        logToConsole(L"Failed to save epoch stats");
+        return false;
+    }
+
     setText(message, L"Saving tick storage ");
     logToConsole(message);
     if (ts.trySaveToFile(system.epoch, system.tick, directory) != 0)
@@ -4534,7 +4677,7 @@ static bool loadAllNodeStates()
     updateNumberOfTickTransactions();
 
     setMem(assetChangeFlags, sizeof(assetChangeFlags), 0);
-    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    discardSpectrumChanges();
     CHAR16 SPECTRUM_DIGEST_FILE_NAME[] = L"snapshotSpectrumDigest";
     loadedSize = load(SPECTRUM_DIGEST_FILE_NAME, spectrumDigestsSizeInByte, (unsigned char*)spectrumDigests, directory);
     logToConsole(L"Loading spectrum digests");
@@ -4571,6 +4714,22 @@ static bool loadAllNodeStates()
         return false;
     }
 
+    // Snapshots of older versions have no epoch stats, count them from the loaded tick storage in this case
+    CHAR16 EPOCH_STATS_FILE_NAME[] = L"snapshotEpochStats";
+    logToConsole(L"Loading epoch stats");
+    EpochStats::Data epochStatsData;
+    loadedSize = load(EPOCH_STATS_FILE_NAME, sizeof(epochStatsData), (unsigned char*)&epochStatsData, directory);
+    if (loadedSize == sizeof(epochStatsData) && epochStatsData.epoch == system.epoch && epochStatsData.initialTick == system.initialTick
+        && epochStatsData.initialTick + epochStatsData.numberOfTicks == system.tick)
+    {
+        epochStats.set(epochStatsData);
+    }
+    else
+    {
+        logToConsole(L"Epoch stats not found in snapshot, counting them from tick storage");
+        rebuildEpochStats();
+    }
+
 #if ADDON_TX_STATUS_REQUEST
     if (!loadStateTxStatus(numberOfTransactions, directory))
     {
@@ -5346,6 +5505,7 @@ void reprocessSolutionTransaction(unsigned long long processorNumber)
                         spectrum[spectrumIndex].incomingAmount -= transaction->amount;
                         spectrum[spectrumIndex].numberOfIncomingTransfers--;
                         spectrum[spectrumIndex].latestIncomingTransferTick = spectrumDataRollback[transactionIndex].latestIncomingTransferTick;
+                        markSpectrumEntityChanged(spectrumIndex);
 
                         spectrumInfo.totalAmount -= transaction->amount;
                         RELEASE(spectrumLock);
@@ -5654,34 +5814,8 @@ static void tickProcessor(void*, unsigned long long processorNumber)
                             etalonTick.saltedResourceTestingDigest = resourceTestingDigest;
 
                             // Update etalonTick.saltedSpectrumDigest
-                            unsigned int digestIndex;
                             ACQUIRE(spectrumLock);
-                            for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                            {
-                                if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
-                                {
-                                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                                    spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
-                                }
-                            }
-                            unsigned int previousLevelBeginning = 0;
-                            unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                            while (numberOfLeafs > 1)
-                            {
-                                for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                                {
-                                    if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
-                                    {
-                                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
-                                        spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
-                                        spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
-                                    }
-                                    digestIndex++;
-                                }
-                                previousLevelBeginning += numberOfLeafs;
-                                numberOfLeafs >>= 1;
-                            }
-                            spectrumChangeFlags[0] = 0;
+                            updateSpectrumDigests();
 
                             etalonTick.saltedSpectrumDigest = spectrumDigests[(SPECTRUM_CAPACITY * 2 - 1) - 1];
                             RELEASE(spectrumLock);
@@ -5994,8 +6128,11 @@ static void tickProcessor(void*, unsigned long long processorNumber)
                                     ts.tickData.releaseLock();
                                 }
 
+                                addTickToEpochStats(currentTickIndex);
+
                                 logger.updateTick(system.tick);
                                 system.tick++;
+                                publishStateSnapshot();
 
                                 updateNumberOfTickTransactions();
                                 pendingTxsPool.incrementFirstStoredTick();
@@ -6359,11 +6496,12 @@ static bool initialize()
         if (!pendingTxsPool.init())
             return false;
 
-        setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
-
         if (!initSpectrum())
             return false;
 
+        if (!richList.init())
+            return false;
+
         if (!commonBuffers.init(COMMON_BUFFERS_COUNT))
             return false;
 
@@ -6372,6 +6510,7 @@ static bool initialize()
 
         initContractExec();
         executionFeeReportCollector.init();
+        tickVoteCache.init();
         for (unsigned int contractIndex = 0; contractIndex < contractCount; contractIndex++)
         {
             unsigned long long size = contractDescriptions[contractIndex].stateSize;
@@ -6497,23 +6636,7 @@ static bool initialize()
             {
                 const unsigned long long beginningTick = __rdtsc();
 
-                unsigned int digestIndex;
-                for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-                {
-                    KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-                }
-                unsigned int previousLevelBeginning = 0;
-                unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-                while (numberOfLeafs > 1)
-                {
-                    for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-                    {
-                        KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-                    }
-
-                    previousLevelBeginning += numberOfLeafs;
-                    numberOfLeafs >>= 1;
-                }
+                rebuildSpectrumDigests();
 
                 setNumber(message, SPECTRUM_CAPACITY * sizeof(EntityRecord), TRUE);
                 appendText(message, L" bytes of the spectrum data are hashed (");
@@ -6648,6 +6771,7 @@ static bool initialize()
     {
         return false;
     }
+    initRequestQueueLanes();
 
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
@@ -6771,6 +6895,7 @@ static void deinitialize()
     }
 
     deinitAssets();
+    richList.deinit();
     deinitSpectrum();
     commonBuffers.deinit();
 
@@ -6822,14 +6947,6 @@ static void deinitialize()
         freePool(responseQueueBuffer);
     }
 
-    for (unsigned int processorIndex = 0; processorIndex < MAX_NUMBER_OF_PROCESSORS; processorIndex++)
-    {
-        if (processors[processorIndex].buffer)
-        {
-            freePool(processors[processorIndex].buffer);
-        }
-    }
-
     for (unsigned int i = 0; i < NUMBER_OF_OUTGOING_CONNECTIONS + NUMBER_OF_INCOMING_CONNECTIONS; i++)
     {
         if (peers[i].receiveBuffer)
@@ -7036,9 +7153,18 @@ static void logInfo()
     appendText(message, L" pending transactions.");
     logToConsole(message);
 
-    unsigned int filledRequestQueueBufferSize = (requestQueueBufferHead >= requestQueueBufferTail) ? (requestQueueBufferHead - requestQueueBufferTail) : (REQUEST_QUEUE_BUFFER_SIZE - (requestQueueBufferTail - requestQueueBufferHead));
+    unsigned int filledRequestQueueBufferSize = 0;
+    unsigned int filledRequestQueueLength = 0;
+    unsigned int filledRequestQueueLaneLengths[NUMBER_OF_REQUEST_QUEUE_LANES];
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        RequestQueueLane& lane = requestQueueLanes[laneIndex];
+        reclaimProcessedRequests(lane);
+        filledRequestQueueBufferSize += (lane.bufferHead >= lane.bufferTail) ? (lane.bufferHead - lane.bufferTail) : (lane.bufferSize - (lane.bufferTail - lane.bufferHead));
+        filledRequestQueueLaneLengths[laneIndex] = (unsigned int)(lane.elementHead - lane.elementReleased);
+        filledRequestQueueLength += filledRequestQueueLaneLengths[laneIndex];
+    }
     unsigned int filledResponseQueueBufferSize = (responseQueueBufferHead >= responseQueueBufferTail) ? (responseQueueBufferHead - responseQueueBufferTail) : (RESPONSE_QUEUE_BUFFER_SIZE - (responseQueueBufferTail - responseQueueBufferHead));
-    unsigned int filledRequestQueueLength = (requestQueueElementHead >= requestQueueElementTail) ? (requestQueueElementHead - requestQueueElementTail) : (REQUEST_QUEUE_LENGTH - (requestQueueElementTail - requestQueueElementHead));
     unsigned int filledResponseQueueLength = (responseQueueElementHead >= responseQueueElementTail) ? (responseQueueElementHead - responseQueueElementTail) : (RESPONSE_QUEUE_LENGTH - (responseQueueElementTail - responseQueueElementHead));
     setNumber(message, filledRequestQueueBufferSize, TRUE);
     appendText(message, L" (");
@@ -7065,6 +7191,36 @@ static void logInfo()
     appendText(message, L" ms.");
     logToConsole(message);
 
+    const CHAR16* requestQueueLaneNames[NUMBER_OF_REQUEST_QUEUE_LANES] = { L"consensus", L"transactions", L"queries" };
+    setText(message, L"Request queue lanes:");
+    for (unsigned int laneIndex = 0; laneIndex < NUMBER_OF_REQUEST_QUEUE_LANES; laneIndex++)
+    {
+        RequestQueueLane& lane = requestQueueLanes[laneIndex];
+        const long long numberOfDiscardedLaneRequests = lane.numberOfDiscardedRequests;
+        appendText(message, L" ");
+        appendText(message, requestQueueLaneNames[laneIndex]);
+        appendText(message, L" ");
+        appendNumber(message, filledRequestQueueLaneLengths[laneIndex], TRUE);
+        appendText(message, L" queued -");
+        appendNumber(message, numberOfDiscardedLaneRequests - lane.prevNumberOfDiscardedRequests, TRUE);
+        appendText(message, (laneIndex + 1 < NUMBER_OF_REQUEST_QUEUE_LANES) ? L" |" : L".");
+        lane.prevNumberOfDiscardedRequests = numberOfDiscardedLaneRequests;
+    }
+    logToConsole(message);
+
+    long long verifiedTickVotes, deduplicatedTickVotes, rejectedTickVotes;
+    tickVoteCache.getCounters(system.tick, verifiedTickVotes, deduplicatedTickVotes, rejectedTickVotes);
+    setText(message, L"Tick votes of tick ");
+    appendNumber(message, system.tick, FALSE);
+    appendText(message, L": ");
+    appendNumber(message, verifiedTickVotes, TRUE);
+    appendText(message, L" verified | ");
+    appendNumber(message, deduplicatedTickVotes, TRUE);
+    appendText(message, L" deduplicated | ");
+    appendNumber(message, rejectedTickVotes, TRUE);
+    appendText(message, L" rejected.");
+    logToConsole(message);
+
     // Log infomation about custom mining
     setText(message, L"CustomMining: ");
 
@@ -7752,12 +7908,6 @@ EFI_STATUS efi_main(EFI_HANDLE imageHandle, EFI_SYSTEM_TABLE* systemTable)
             mpServicesProtocol->GetProcessorInfo(mpServicesProtocol, i, &processorInformation);
             if (processorInformation.StatusFlag == (PROCESSOR_ENABLED_BIT | PROCESSOR_HEALTH_STATUS_BIT))
             {
-                if (!allocPoolWithErrorLog(L"processor[i]", BUFFER_SIZE, &processors[numberOfProcessors].buffer, __LINE__))
-                {
-                    numberOfProcessors = 0;
-
-                    break;
-                }
                 if (!processors[numberOfProcessors].alloc(STACK_SIZE))
                 {
                     logToConsole(L"Failed to allocate stack for processor!");
@@ -8450,6 +8600,7 @@ void processArgs(int argc, const char* argv[]) {
         ("t,threads", "Total Threads will be used by the core", cxxopts::value<int>())
         ("d,ticking-delay", "Delay ticking process by milliseconds", cxxopts::value<int>())
         ("l,solution-threads", "Threads that will be used by the core to process solution", cxxopts::value<int>())
+        ("io-threads", "Threads that will be used by the network reactor to serve peer sockets (Linux only)", cxxopts::value<int>())
         ("sm, node-mode", "Set start mode to Main&aux,....", cxxopts::value<int>())
         ("seeds", "Set seeds (IDs) to run on this node (only apply for main node)", cxxopts::value<std::string>())
         ("rp, reader-passcode", "Passcode to access log reader", cxxopts::value<std::string>())
@@ -8457,6 +8608,7 @@ void processArgs(int argc, const char* argv[]) {
         ("o, operator", "Operator id", cxxopts::value<std::string>())
         ("op, operator-seed", "Lite node seed", cxxopts::value<std::string>())
 		("oa,operator-alias", "Operator alias for RPC tick-info", cxxopts::value<std::string>())
+        ("state-snapshots", "Serve HTTP queries of spectrum and universe from per-tick snapshots (needs up to 2 GB more RAM)", cxxopts::value<bool>())
         ("s,security-tick", "Core will verify state after x tick, to reduce computational to the node", cxxopts::value<int>()->default_value("1"));
     auto result = options.parse(argc, argv);
 
@@ -8513,6 +8665,11 @@ void processArgs(int argc, const char* argv[]) {
         NUMBER_OF_SOLUTION_PROCESSORS_DYNAMIC = result["solution-threads"].as<int>();
     }
 
+    if (result.count("io-threads")) {
+        numberOfNetworkIoThreads = result["io-threads"].as<int>();
+        logColorToScreen("INFO", "Network I/O threads set to " + std::to_string(numberOfNetworkIoThreads));
+    }
+
     if (result.count("security-tick")) {
         securityTick = result["security-tick"].as<int>();
         logColorToScreen("INFO", "Security tick set to " + std::to_string(securityTick));
@@ -8534,6 +8691,12 @@ void processArgs(int argc, const char* argv[]) {
         rebuildTxHashmap = true;
     }
 
+    if (result.count("state-snapshots"))
+    {
+        stateSnapshots.enable();
+        logColorToScreen("INFO", "State snapshots for HTTP queries enabled");
+    }
+
 	if (result.count("operator-alias"))
     {
         nodeAlias = result["operator-alias"].as<std::string>();
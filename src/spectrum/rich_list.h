@@ -0,0 +1,294 @@
+#pragma once
+
+#include "platform/global_var.h"
+#include "platform/assert.h"
+#include "platform/concurrency.h"
+#include "platform/memory_util.h"
+#include "platform/profiling.h"
+
+#include "network_messages/entity.h"
+
+#include "public_settings.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Entities with positive balance ordered by balance (descending, ties by spectrum index), for serving the rich list
+// without sorting the spectrum per request. It is a treap whose nodes are the spectrum slots: node i + 1 belongs to
+// spectrum[i] and node 0 is the empty tree. The priority of a node is derived from its number, so no random
+// generator is needed.
+//
+// The tree is updated from the entities changed in a tick (see updateSpectrumDigests()) and rebuilt if the spectrum
+// is replaced as a whole. Reading a page costs O(log n + page size).
+class RichList
+{
+public:
+    bool init()
+    {
+        if (!allocPoolWithErrorLog(L"richList", (SPECTRUM_CAPACITY + 1) * sizeof(Node), (void**)&nodes, __LINE__))
+        {
+            return false;
+        }
+        lock = 0;
+        root = 0;
+        return true;
+    }
+
+    void deinit()
+    {
+        if (nodes)
+        {
+            freePool(nodes);
+            nodes = nullptr;
+        }
+    }
+
+    // Insert all entities of the spectrum with positive balance, dropping the previous content
+    void rebuild(const EntityRecord* spectrum)
+    {
+        PROFILE_SCOPE();
+        if (!nodes)
+        {
+            return;
+        }
+
+        ACQUIRE(lock);
+        setMem(nodes, (SPECTRUM_CAPACITY + 1) * sizeof(Node), 0);
+        root = 0;
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+        {
+            const long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+            if (balance > 0)
+            {
+                insert(i + 1, balance);
+            }
+        }
+        RELEASE(lock);
+    }
+
+    // Move the entities at the given spectrum indices to the position matching their current balance
+    void update(const EntityRecord* spectrum, const unsigned int* indices, unsigned int count)
+    {
+        PROFILE_SCOPE();
+        if (!nodes)
+        {
+            return;
+        }
+
+        ACQUIRE(lock);
+        for (unsigned int k = 0; k < count; k++)
+        {
+            updateEntity(spectrum, indices[k]);
+        }
+        RELEASE(lock);
+    }
+
+    // Same as update(), but for the entities flagged in changeFlags (one bit per spectrum index), which is used if
+    // the list of changed indices has overflown. Scanning the flags is much cheaper than a rebuild.
+    void update(const EntityRecord* spectrum, const unsigned long long* changeFlags)
+    {
+        PROFILE_SCOPE();
+        if (!nodes)
+        {
+            return;
+        }
+
+        ACQUIRE(lock);
+        for (unsigned int i = 0; i < SPECTRUM_CAPACITY / 64; i++)
+        {
+            for (unsigned long long flags = changeFlags[i]; flags; flags &= flags - 1)
+            {
+                updateEntity(spectrum, i * 64 + (unsigned int)_tzcnt_u64(flags));
+            }
+        }
+        RELEASE(lock);
+    }
+
+    // Number of entities with positive balance
+    unsigned int size() const
+    {
+        return (nodes) ? nodes[root].size : 0;
+    }
+
+    // Call callback(unsigned int spectrumIndex, long long balance) for at most count entities, starting with the
+    // entity at position first (0 is the richest). Returns the number of entities with positive balance. The page is
+    // copied under the lock and the callback runs after releasing it, so it doesn't hold up the tick processor.
+    template <typename CallbackT>
+    unsigned int getPage(unsigned long long first, unsigned int count, CallbackT callback)
+    {
+        if (!nodes)
+        {
+            return 0;
+        }
+
+        std::vector<std::pair<unsigned int, long long>> page;
+        ACQUIRE(lock);
+        const unsigned int numberOfEntities = nodes[root].size;
+        page.reserve((first < numberOfEntities) ? std::min<unsigned long long>(count, numberOfEntities - first) : 0);
+        auto append = [&page](unsigned int spectrumIndex, long long balance)
+        {
+            page.emplace_back(spectrumIndex, balance);
+        };
+        visit(root, first, count, append);
+        RELEASE(lock);
+
+        for (const auto& entry : page)
+        {
+            callback(entry.first, entry.second);
+        }
+        return numberOfEntities;
+    }
+
+private:
+    struct Node
+    {
+        long long balance; // 0 if the entity is not in the tree
+        unsigned int left;
+        unsigned int right;
+        unsigned int size; // number of nodes in subtree
+    };
+
+    static unsigned int priority(unsigned int node)
+    {
+        // Multiplying with an odd constant is a bijection, so all priorities are different
+        return node * 2654435761U;
+    }
+
+    static bool isBefore(long long balanceA, unsigned int nodeA, long long balanceB, unsigned int nodeB)
+    {
+        return balanceA > balanceB || (balanceA == balanceB && nodeA < nodeB);
+    }
+
+    // Move the entity at spectrum index to the position matching its current balance, caller must hold lock
+    void updateEntity(const EntityRecord* spectrum, unsigned int index)
+    {
+        const unsigned int node = index + 1;
+        const long long balance = spectrum[index].incomingAmount - spectrum[index].outgoingAmount;
+        if (nodes[node].balance == balance)
+        {
+            return;
+        }
+        if (nodes[node].balance > 0)
+        {
+            erase(node);
+        }
+        if (balance > 0)
+        {
+            insert(node, balance);
+        }
+    }
+
+    void updateSize(unsigned int t)
+    {
+        nodes[t].size = 1 + nodes[nodes[t].left].size + nodes[nodes[t].right].size;
+    }
+
+    // Split tree t into l with the nodes before key (balance, node) and r with the others
+    void split(unsigned int t, long long balance, unsigned int node, unsigned int& l, unsigned int& r)
+    {
+        if (!t)
+        {
+            l = r = 0;
+            return;
+        }
+        if (isBefore(nodes[t].balance, t, balance, node))
+        {
+            split(nodes[t].right, balance, node, nodes[t].right, r);
+            l = t;
+        }
+        else
+        {
+            split(nodes[t].left, balance, node, l, nodes[t].left);
+            r = t;
+        }
+        updateSize(t);
+    }
+
+    // Join trees l and r, all nodes of l must be before the nodes of r
+    unsigned int merge(unsigned int l, unsigned int r)
+    {
+        if (!l || !r)
+        {
+            return (l) ? l : r;
+        }
+        if (priority(l) > priority(r))
+        {
+            nodes[l].right = merge(nodes[l].right, r);
+            updateSize(l);
+            return l;
+        }
+        nodes[r].left = merge(l, nodes[r].left);
+        updateSize(r);
+        return r;
+    }
+
+    void insert(unsigned int node, long long balance)
+    {
+        nodes[node].balance = balance;
+        nodes[node].left = 0;
+        nodes[node].right = 0;
+        nodes[node].size = 1;
+        unsigned int l, r;
+        split(root, balance, node, l, r);
+        root = merge(merge(l, node), r);
+    }
+
+    void erase(unsigned int node)
+    {
+        // Cut out the range [key of node, key of node + 1), which only contains node
+        unsigned int l, middle, r;
+        split(root, nodes[node].balance, node, l, r);
+        split(r, nodes[node].balance, node + 1, middle, r);
+        ASSERT(middle == node);
+        root = merge(l, r);
+        nodes[node].balance = 0;
+        nodes[node].left = 0;
+        nodes[node].right = 0;
+        nodes[node].size = 0;
+    }
+
+    // In-order traversal that skips whole subtrees before the first requested position
+    template <typename CallbackT>
+    void visit(unsigned int t, unsigned long long& skip, unsigned int& count, CallbackT& callback)
+    {
+        if (!t || !count)
+        {
+            return;
+        }
+        const unsigned int leftSize = nodes[nodes[t].left].size;
+        if (skip >= leftSize)
+        {
+            skip -= leftSize;
+        }
+        else
+        {
+            visit(nodes[t].left, skip, count, callback);
+            if (!count)
+            {
+                return;
+            }
+        }
+        if (skip)
+        {
+            skip--;
+        }
+        else
+        {
+            callback(t - 1, nodes[t].balance);
+            count--;
+        }
+        if (skip >= nodes[nodes[t].right].size)
+        {
+            skip -= nodes[nodes[t].right].size;
+            return;
+        }
+        visit(nodes[t].right, skip, count, callback);
+    }
+
+    Node* nodes = nullptr;
+    unsigned int root = 0;
+    volatile char lock = 0;
+};
+
+GLOBAL_VAR_DECL RichList richList;
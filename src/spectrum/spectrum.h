@@ -15,7 +15,10 @@
 #include "public_settings.h"
 #include "system.h"
 #include "kangaroo_twelve.h"
+#include "merkle_tree_builder.h"
 #include "common_buffers.h"
+#include "spectrum/rich_list.h"
+#include "state_snapshot.h"
 
 GLOBAL_VAR_DECL volatile char spectrumLock GLOBAL_VAR_INIT(0);
 GLOBAL_VAR_DECL EntityRecord* spectrum GLOBAL_VAR_INIT(nullptr);
@@ -31,9 +34,147 @@ GLOBAL_VAR_DECL unsigned long long dustThresholdBurnAll GLOBAL_VAR_INIT(0), dust
 GLOBAL_VAR_DECL m256i* spectrumDigests GLOBAL_VAR_INIT(nullptr);
 static constexpr unsigned long long spectrumDigestsSizeInByte = (SPECTRUM_CAPACITY * 2 - 1) * 32ULL;
 
+// Entities changed since the last update of spectrumDigests. A changed entity is flagged in spectrumChangeFlags (which
+// also tracks the changed nodes of each level during the update) and listed once in spectrumChangedIndices. If more
+// entities change than the list can hold, the next update falls back to scanning the whole spectrum.
+static constexpr unsigned int spectrumChangedIndicesCapacity = 65536;
+GLOBAL_VAR_DECL unsigned long long spectrumChangeFlags[SPECTRUM_CAPACITY / (sizeof(unsigned long long) * 8)];
+GLOBAL_VAR_DECL unsigned int spectrumChangedIndices[spectrumChangedIndicesCapacity];
+GLOBAL_VAR_DECL unsigned int numberOfSpectrumChangedIndices GLOBAL_VAR_INIT(0);
+GLOBAL_VAR_DECL bool spectrumChangedIndicesOverflow GLOBAL_VAR_INIT(false);
+
 GLOBAL_VAR_DECL unsigned long long spectrumReorgTotalExecutionTicks GLOBAL_VAR_INIT(0);
 
 
+// Record that the entity at index has changed, acquire no lock (caller must hold spectrumLock)
+static void markSpectrumEntityChanged(unsigned int index)
+{
+    stateSnapshots.markEntityChanged(index);
+
+    const unsigned long long flag = 1ULL << (index & 63);
+    if (!(spectrumChangeFlags[index >> 6] & flag))
+    {
+        spectrumChangeFlags[index >> 6] |= flag;
+        if (numberOfSpectrumChangedIndices < spectrumChangedIndicesCapacity)
+        {
+            spectrumChangedIndices[numberOfSpectrumChangedIndices++] = index;
+        }
+        else
+        {
+            spectrumChangedIndicesOverflow = true;
+        }
+    }
+}
+
+// Forget all recorded changes, for example after spectrumDigests have been rebuilt or loaded, acquire no lock. The
+// next state snapshot copies the whole spectrum, because the changes aren't known anymore.
+static void discardSpectrumChanges()
+{
+    stateSnapshots.markAllEntitiesChanged();
+    setMem(spectrumChangeFlags, sizeof(spectrumChangeFlags), 0);
+    numberOfSpectrumChangedIndices = 0;
+    spectrumChangedIndicesOverflow = false;
+}
+
+static void hashSpectrumLeafs(const void* records, unsigned int firstIndex, unsigned int count, m256i* digests)
+{
+    static_assert(sizeof(EntityRecord) == 64, "Spectrum leaf hashing requires 64-byte records");
+    KangarooTwelve64To32Multi(&((const EntityRecord*)records)[firstIndex], digests, count);
+}
+
+// Hash the whole spectrum into spectrumDigests (expensive, idle processors help through merkleTreeBuilder), acquire no lock
+static void rebuildSpectrumDigests()
+{
+    PROFILE_SCOPE();
+    merkleTreeBuilder.build(spectrum, SPECTRUM_CAPACITY, hashSpectrumLeafs, spectrumDigests);
+    richList.rebuild(spectrum);
+
+    discardSpectrumChanges();
+}
+
+// Rehash the entities changed in the current tick and the nodes on their paths to the root, acquire no lock (caller
+// must hold spectrumLock). Costs O(changes * SPECTRUM_DEPTH) unless the change list has overflown. The rich list
+// is updated from the same changes.
+static void updateSpectrumDigests()
+{
+    PROFILE_SCOPE();
+    if (spectrumChangedIndicesOverflow)
+    {
+        // the leaf flags still mark all entities changed in this tick
+        richList.update(spectrum, spectrumChangeFlags);
+
+        unsigned int digestIndex;
+        for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
+        {
+            if (spectrum[digestIndex].latestIncomingTransferTick == system.tick || spectrum[digestIndex].latestOutgoingTransferTick == system.tick)
+            {
+                KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
+                spectrumChangeFlags[digestIndex >> 6] |= (1ULL << (digestIndex & 63));
+            }
+        }
+        unsigned int previousLevelBeginning = 0;
+        unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+        while (numberOfLeafs > 1)
+        {
+            for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+            {
+                if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+                {
+                    KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex]);
+                    spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                    spectrumChangeFlags[i >> 7] |= (1ULL << ((i >> 1) & 63));
+                }
+                digestIndex++;
+            }
+            previousLevelBeginning += numberOfLeafs;
+            numberOfLeafs >>= 1;
+        }
+    }
+    else
+    {
+        richList.update(spectrum, spectrumChangedIndices, numberOfSpectrumChangedIndices);
+
+        // Same leaf condition as the full scan, so that the digests do not depend on which path is taken
+        unsigned int numberOfIndices = numberOfSpectrumChangedIndices;
+        for (unsigned int k = 0; k < numberOfIndices; k++)
+        {
+            const unsigned int index = spectrumChangedIndices[k];
+            if (spectrum[index].latestIncomingTransferTick == system.tick || spectrum[index].latestOutgoingTransferTick == system.tick)
+            {
+                KangarooTwelve64To32(&spectrum[index], &spectrumDigests[index]);
+            }
+        }
+        unsigned int previousLevelBeginning = 0;
+        unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
+        while (numberOfLeafs > 1)
+        {
+            // Hash every changed pair once, collecting the parents in place of the processed indices. The parents are
+            // flagged only after the whole level is done, because the flags of both levels share spectrumChangeFlags.
+            unsigned int numberOfParents = 0;
+            for (unsigned int k = 0; k < numberOfIndices; k++)
+            {
+                const unsigned int i = spectrumChangedIndices[k] & ~1U;
+                if (spectrumChangeFlags[i >> 6] & (3ULL << (i & 63)))
+                {
+                    KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[previousLevelBeginning + numberOfLeafs + (i >> 1)]);
+                    spectrumChangeFlags[i >> 6] &= ~(3ULL << (i & 63));
+                    spectrumChangedIndices[numberOfParents++] = i >> 1;
+                }
+            }
+            for (unsigned int k = 0; k < numberOfParents; k++)
+            {
+                spectrumChangeFlags[spectrumChangedIndices[k] >> 6] |= (1ULL << (spectrumChangedIndices[k] & 63));
+            }
+            numberOfIndices = numberOfParents;
+            previousLevelBeginning += numberOfLeafs;
+            numberOfLeafs >>= 1;
+        }
+    }
+    spectrumChangeFlags[0] = 0;
+    numberOfSpectrumChangedIndices = 0;
+    spectrumChangedIndicesOverflow = false;
+}
+
 // Update SpectrumInfo data (exensive, because it iterates the whole spectrum), acquire no lock
 static void updateSpectrumInfo(SpectrumInfo& si = spectrumInfo)
 {
@@ -182,23 +323,8 @@ static void reorganizeSpectrum()
     copyMem(spectrum, reorgSpectrum, SPECTRUM_CAPACITY * sizeof(EntityRecord));
     commonBuffers.releaseBuffer(reorgSpectrum);
 
-    unsigned int digestIndex;
-    for (digestIndex = 0; digestIndex < SPECTRUM_CAPACITY; digestIndex++)
-    {
-        KangarooTwelve64To32(&spectrum[digestIndex], &spectrumDigests[digestIndex]);
-    }
-    unsigned int previousLevelBeginning = 0;
-    unsigned int numberOfLeafs = SPECTRUM_CAPACITY;
-    while (numberOfLeafs > 1)
-    {
-        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
-        {
-            KangarooTwelve64To32(&spectrumDigests[previousLevelBeginning + i], &spectrumDigests[digestIndex++]);
-        }
-
-        previousLevelBeginning += numberOfLeafs;
-        numberOfLeafs >>= 1;
-    }
+    // Entities have moved, so recorded changes are meaningless now
+    rebuildSpectrumDigests();
 
     updateSpectrumInfo();
 
@@ -343,6 +469,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount, bool isGene
             spectrum[index].incomingAmount += amount;
             spectrum[index].numberOfIncomingTransfers++;
             spectrum[index].latestIncomingTransferTick = system.tick;
+            markSpectrumEntityChanged(index);
 
             spectrumInfo.totalAmount += amount;
         }
@@ -354,6 +481,7 @@ static void increaseEnergy(const m256i& publicKey, long long amount, bool isGene
                 spectrum[index].incomingAmount = amount;
                 spectrum[index].numberOfIncomingTransfers = 1;
                 spectrum[index].latestIncomingTransferTick = system.tick;
+                markSpectrumEntityChanged(index);
 
                 spectrumInfo.numberOfEntities++;
                 spectrumInfo.totalAmount += amount;
@@ -395,6 +523,7 @@ static bool decreaseEnergy(const int index, long long amount)
             spectrum[index].outgoingAmount += amount;
             spectrum[index].numberOfOutgoingTransfers++;
             spectrum[index].latestOutgoingTransferTick = system.tick;
+            markSpectrumEntityChanged(index);
 
             spectrumInfo.totalAmount -= amount;
 
@@ -421,6 +550,8 @@ static bool loadSpectrum(const CHAR16* fileName = SPECTRUM_FILE_NAME, const CHAR
         return false;
     }
     updateSpectrumInfo();
+    richList.rebuild(spectrum);
+    stateSnapshots.markAllEntitiesChanged();
     return true;
 }
 
@@ -454,6 +585,8 @@ static bool initSpectrum()
         return false;
     }
     spectrumLock = 0;
+    discardSpectrumChanges();
+    registerFileIOBuffer(spectrum, spectrumSizeInBytes);
 
     return true;
 }
@@ -467,6 +600,7 @@ static void deinitSpectrum()
     }
     if (spectrum)
     {
+        unregisterFileIOBuffer(spectrum, spectrumSizeInBytes);
         freePool(spectrum);
         spectrum = nullptr;
     }
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <memory>
+
+#include "platform/global_var.h"
+#include "platform/concurrency.h"
+#include "platform/memory.h"
+
+#include "network_messages/entity.h"
+#include "network_messages/assets.h"
+
+// Records of a snapshot in reference-counted pages, which are never changed after the snapshot has been published.
+// A new snapshot shares all unchanged pages with the previous one and only copies the changed pages. Pages that are
+// completely zero share one page.
+template <typename RecordT, unsigned long long capacity>
+class SnapshotPages
+{
+public:
+    static constexpr unsigned int recordsPerPage = 1024;
+    static constexpr unsigned int numberOfPages = (unsigned int)(capacity / recordsPerPage);
+    static_assert(capacity % (recordsPerPage * 64) == 0, "Capacity must be a multiple of 64 pages");
+
+    SnapshotPages() : pages(new std::shared_ptr<const Page>[numberOfPages])
+    {
+    }
+
+    const RecordT& operator[](unsigned int index) const
+    {
+        return pages[index / recordsPerPage]->records[index % recordsPerPage];
+    }
+
+    // Share the pages of previous and copy the pages flagged in changedPageFlags from records. Without previous, all
+    // pages are copied.
+    void update(const SnapshotPages* previous, const RecordT* records, const unsigned long long* changedPageFlags)
+    {
+        static const std::shared_ptr<const Page> zeroPage = std::make_shared<const Page>();
+        for (unsigned int page = 0; page < numberOfPages; page++)
+        {
+            if (previous && !(changedPageFlags[page >> 6] & (1ULL << (page & 63))))
+            {
+                pages[page] = previous->pages[page];
+                continue;
+            }
+
+            const RecordT* source = records + (unsigned long long)page * recordsPerPage;
+            if (isZero(source, sizeof(Page)))
+            {
+                pages[page] = zeroPage;
+            }
+            else
+            {
+                std::shared_ptr<Page> copy = std::make_shared<Page>();
+                copyMem(copy->records, source, sizeof(Page));
+                pages[page] = std::move(copy);
+            }
+        }
+    }
+
+private:
+    struct Page
+    {
+        RecordT records[recordsPerPage];
+    };
+
+    std::unique_ptr<std::shared_ptr<const Page>[]> pages;
+};
+
+// Spectrum and universe as they were at the end of a tick
+struct StateSnapshot
+{
+    unsigned short epoch;
+    unsigned int tick;
+    SnapshotPages<EntityRecord, SPECTRUM_CAPACITY> entities;
+    SnapshotPages<AssetRecord, ASSETS_CAPACITY> universe;
+
+    // Index lists of the universe (see AssetStorage::IndexLists), which match the records of this snapshot
+    unsigned int issuancesFirstIdx;
+    SnapshotPages<unsigned int, ASSETS_CAPACITY> ownershipsPossessionsFirstIdx;
+    SnapshotPages<unsigned int, ASSETS_CAPACITY> ownershipsPossessionsCount;
+    SnapshotPages<unsigned int, ASSETS_CAPACITY> nextIdx;
+
+    // Same as spectrumIndex(), but looking up the entity in this snapshot
+    int spectrumIndex(const m256i& publicKey) const
+    {
+        if (isZero(publicKey))
+        {
+            return -1;
+        }
+
+        unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+        while (entities[index].publicKey != publicKey)
+        {
+            if (isZero(entities[index].publicKey))
+            {
+                return -1;
+            }
+            index = (index + 1) & (SPECTRUM_CAPACITY - 1);
+        }
+        return index;
+    }
+};
+
+// Consistent read snapshots for readers outside of the tick processor (the HTTP handlers), which then neither race
+// with the tick processor changing the spectrum and universe nor need to hold spectrumLock. The tick processor
+// publishes a snapshot after each tick, copying only the pages with records changed since the previous snapshot
+// (copy-on-write at page granularity). Readers keep their snapshot and its pages alive as long as they hold the
+// pointer, while newer snapshots are published.
+//
+// Snapshots need up to the memory of the spectrum, universe and asset index lists again, so they are only made if
+// enabled at startup.
+class StateSnapshots
+{
+public:
+    void enable()
+    {
+        enabled = true;
+    }
+
+    bool isEnabled() const
+    {
+        return enabled;
+    }
+
+    // Record that the entity at index has changed, acquire no lock (caller must hold spectrumLock)
+    void markEntityChanged(unsigned int index)
+    {
+        const unsigned int page = index / SnapshotPages<EntityRecord, SPECTRUM_CAPACITY>::recordsPerPage;
+        changedEntityPages[page >> 6] |= (1ULL << (page & 63));
+    }
+
+    // Record that the whole spectrum may have changed, for example after it has been loaded or reorganized
+    void markAllEntitiesChanged()
+    {
+        setMem(changedEntityPages, sizeof(changedEntityPages), 0xFF);
+    }
+
+    // Record the changes of the universe flagged in assetChangeFlags (one bit per record, as used for updating the
+    // digests), before the flags are cleared
+    void markAssetsChanged(const unsigned long long* assetChangeFlags)
+    {
+        constexpr unsigned int flagsPerPage = SnapshotPages<AssetRecord, ASSETS_CAPACITY>::recordsPerPage / 64;
+        for (unsigned int page = 0; page < SnapshotPages<AssetRecord, ASSETS_CAPACITY>::numberOfPages; page++)
+        {
+            if (changedAssetPages[page >> 6] & (1ULL << (page & 63)))
+            {
+                continue;
+            }
+            for (unsigned int i = 0; i < flagsPerPage; i++)
+            {
+                if (assetChangeFlags[page * flagsPerPage + i])
+                {
+                    changedAssetPages[page >> 6] |= (1ULL << (page & 63));
+                    break;
+                }
+            }
+        }
+    }
+
+    // Record that the whole universe may have changed, for example after it has been loaded
+    void markAllAssetsChanged()
+    {
+        setMem(changedAssetPages, sizeof(changedAssetPages), 0xFF);
+    }
+
+    // Record that the elements at index of the asset index lists have changed (caller must hold universeLock)
+    void markAssetListsChanged(unsigned int index)
+    {
+        const unsigned int page = index / SnapshotPages<unsigned int, ASSETS_CAPACITY>::recordsPerPage;
+        changedAssetListPages[page >> 6] |= (1ULL << (page & 63));
+    }
+
+    // Record that the asset index lists may have changed completely, for example after they have been rebuilt
+    void markAllAssetListsChanged()
+    {
+        setMem(changedAssetListPages, sizeof(changedAssetListPages), 0xFF);
+    }
+
+    // Publish the state at the end of tick, only called by the tick processor. Acquires no lock, the caller must hold
+    // spectrumLock and universeLock. IndexListsT is AssetStorage::IndexLists.
+    template <typename IndexListsT>
+    void publish(unsigned short epoch, unsigned int tick, const EntityRecord* spectrum, const AssetRecord* assets, const unsigned long long* assetChangeFlags,
+        const IndexListsT& assetIndexLists)
+    {
+        if (!enabled)
+        {
+            return;
+        }
+
+        markAssetsChanged(assetChangeFlags);
+        std::shared_ptr<const StateSnapshot> previous = get();
+        std::shared_ptr<StateSnapshot> snapshot = std::make_shared<StateSnapshot>();
+        snapshot->epoch = epoch;
+        snapshot->tick = tick;
+        snapshot->entities.update(previous ? &previous->entities : nullptr, spectrum, changedEntityPages);
+        snapshot->universe.update(previous ? &previous->universe : nullptr, assets, changedAssetPages);
+        snapshot->issuancesFirstIdx = assetIndexLists.issuancesFirstIdx;
+        snapshot->ownershipsPossessionsFirstIdx.update(previous ? &previous->ownershipsPossessionsFirstIdx : nullptr, assetIndexLists.ownershipsPossessionsFirstIdx, changedAssetListPages);
+        snapshot->ownershipsPossessionsCount.update(previous ? &previous->ownershipsPossessionsCount : nullptr, assetIndexLists.ownershipsPossessionsCount, changedAssetListPages);
+        snapshot->nextIdx.update(previous ? &previous->nextIdx : nullptr, assetIndexLists.nextIdx, changedAssetListPages);
+        setMem(changedEntityPages, sizeof(changedEntityPages), 0);
+        setMem(changedAssetPages, sizeof(changedAssetPages), 0);
+        setMem(changedAssetListPages, sizeof(changedAssetListPages), 0);
+
+        ACQUIRE(latestLock);
+        latest = std::move(snapshot);
+        RELEASE(latestLock);
+    }
+
+    // Latest published snapshot, nullptr if none has been published (yet). Can be called from any thread.
+    std::shared_ptr<const StateSnapshot> get()
+    {
+        ACQUIRE(latestLock);
+        std::shared_ptr<const StateSnapshot> snapshot = latest;
+        RELEASE(latestLock);
+        return snapshot;
+    }
+
+private:
+    bool enabled = false;
+    unsigned long long changedEntityPages[SnapshotPages<EntityRecord, SPECTRUM_CAPACITY>::numberOfPages / 64] = {};
+    unsigned long long changedAssetPages[SnapshotPages<AssetRecord, ASSETS_CAPACITY>::numberOfPages / 64] = {};
+    unsigned long long changedAssetListPages[SnapshotPages<unsigned int, ASSETS_CAPACITY>::numberOfPages / 64] = {};
+    std::shared_ptr<const StateSnapshot> latest;
+    volatile char latestLock = 0;
+};
+
+GLOBAL_VAR_DECL StateSnapshots stateSnapshots;
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "platform/global_var.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+
+// Running statistics of the ticks processed in the current epoch. The tick processor adds each tick once when it
+// moves on to the next one, so readers like the HTTP handlers don't need to walk the tick storage under its lock.
+//
+// Reading is lock-free: the writer makes the sequence number odd while changing the data and readers retry until
+// they got a copy made while the sequence number was even and unchanged. There is only one writer at a time (the
+// tick processor, or the main thread before ticking starts).
+class EpochStats
+{
+public:
+    static constexpr unsigned long long unknownTickDuration = 0xFFFFFFFFFFFFFFFFULL;
+
+    struct Data
+    {
+        unsigned int initialTick;
+        unsigned short epoch;
+        unsigned short _padding;
+
+        // Ticks in [initialTick, initialTick + numberOfTicks) have been processed
+        unsigned int numberOfTicks;
+        unsigned int numberOfEmptyTicks;
+        unsigned long long numberOfTransactions;
+
+        // Durations in milliseconds, only known for ticks that started while the node was running
+        unsigned int numberOfTimedTicks;
+        unsigned int maxTickDuration;
+        unsigned long long totalTickDuration;
+
+        // Ratio of non-empty ticks, 0 if no tick has been processed
+        double quality() const
+        {
+            return (numberOfTicks) ? (double)(numberOfTicks - numberOfEmptyTicks) / numberOfTicks : 0.0;
+        }
+    };
+
+    // Drop all statistics and start counting at initialTick
+    void beginEpoch(unsigned short epoch, unsigned int initialTick)
+    {
+        beginWrite();
+        setMem(&data, sizeof(data), 0);
+        data.epoch = epoch;
+        data.initialTick = initialTick;
+        endWrite();
+    }
+
+    // Add the processed tick, which must directly follow the ticks counted so far. Other ticks are ignored.
+    void addTick(unsigned int tick, bool isEmpty, unsigned int numberOfTransactions, unsigned long long duration)
+    {
+        if (tick != data.initialTick + data.numberOfTicks)
+        {
+            return;
+        }
+
+        beginWrite();
+        data.numberOfTicks++;
+        if (isEmpty)
+        {
+            data.numberOfEmptyTicks++;
+        }
+        data.numberOfTransactions += numberOfTransactions;
+        if (duration != unknownTickDuration)
+        {
+            data.numberOfTimedTicks++;
+            data.totalTickDuration += duration;
+            if (duration > data.maxTickDuration)
+            {
+                data.maxTickDuration = (duration < 0xFFFFFFFF) ? (unsigned int)duration : 0xFFFFFFFF;
+            }
+        }
+        endWrite();
+    }
+
+    // Get a consistent copy of the statistics, can be called from any thread
+    Data get() const
+    {
+        Data copy;
+        while (true)
+        {
+            const long sequenceBefore = readSequence();
+            if (!(sequenceBefore & 1))
+            {
+                copyMem(&copy, (const void*)&data, sizeof(copy));
+                if (readSequence() == sequenceBefore)
+                {
+                    return copy;
+                }
+            }
+            _mm_pause();
+        }
+    }
+
+    // Replace the statistics, for restoring them from a snapshot
+    void set(const Data& newData)
+    {
+        beginWrite();
+        copyMem(&data, &newData, sizeof(data));
+        endWrite();
+    }
+
+private:
+    void beginWrite()
+    {
+        _InterlockedIncrement(&sequence);
+    }
+
+    void endWrite()
+    {
+        _InterlockedIncrement(&sequence);
+    }
+
+    long readSequence() const
+    {
+        // Full barrier, so the copy of the data cannot be moved before or after reading the sequence number
+        return _InterlockedCompareExchange(const_cast<volatile long*>(&sequence), 0, 0);
+    }
+
+    Data data = {};
+    volatile long sequence = 0;
+};
+
+GLOBAL_VAR_DECL EpochStats epochStats;
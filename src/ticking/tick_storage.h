@@ -17,12 +17,21 @@
 #define TX00_AS_NUMBER 13511005048406132ULL
 #define TXDI_AS_NUMBER 29555302059212916ULL
 #define DATA_AS_NUMBER 27303570963497060ULL
+#define IDTH_AS_NUMBER 29273895800668265ULL
+#define IDTP_AS_NUMBER 31525695614353513ULL
 
 #define CACHE_PAGE 32
 #define TICK_DATA_PAGE_CAPACITY 128 // one page can hold data for 128 ticks
 #define TICKS_PAGE_CAPACITY (64 * NUMBER_OF_COMPUTORS) // one page can hold data for 64 ticks
 #define TRANSACTION_PAGE_CAPACITY (NUMBER_OF_TRANSACTIONS_PER_TICK * 16) // one page can hold data for AT LEAST 16 ticks
 #define TRANSACTION_DIGEST_HASHMAP_PAGE_CAPACITY (NUMBER_OF_TRANSACTIONS_PER_TICK * 64)
+#define IDENTITY_TRANSACTIONS_HEADS_PAGE_CAPACITY (NUMBER_OF_TRANSACTIONS_PER_TICK * 64)
+#define IDENTITY_TRANSACTIONS_POSTINGS_PAGE_CAPACITY (NUMBER_OF_TRANSACTIONS_PER_TICK * 128)
+
+// With SWAP_MMAP on Linux, the swap storage of each array is one memory-mapped file (see MappedSwapVirtualMemory)
+#if defined(USE_SWAP) && defined(SWAP_MMAP) && defined(__linux__)
+#define USE_MAPPED_SWAP
+#endif
 
 #if TICK_STORAGE_AUTOSAVE_MODE
 static wchar_t SNAPSHOT_METADATA_FILE_NAME[] = L"snapshotMetadata.???";
@@ -79,16 +88,28 @@ private:
     // Allocated tick data buffer with tickDataLength elements (includes current and previous epoch data)
     inline static TickData* tickDataPtr = nullptr;
     // SWAP: should reserve another tickData SwapVm instance for requestProcessor to avoid affect ticking process
+#ifdef USE_MAPPED_SWAP
+    inline static MappedSwapVirtualMemory<TickData, TD00_AS_NUMBER, DATA_AS_NUMBER, tickDataLength, SwapMode::INDEX_MODE, 0> tickDataSwapVM;
+#else
     inline static SwapVirtualMemory<TickData, TD00_AS_NUMBER, DATA_AS_NUMBER, TICK_DATA_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> tickDataSwapVM;
+#endif
 
     // Allocated ticks buffer with ticksLength elements (includes current and previous epoch data)
     inline static Tick* ticksPtr = nullptr;
     // SWAP: should reserve another ticks SwapVm instance for requestProcessor to avoid affect ticking process
+#ifdef USE_MAPPED_SWAP
+    inline static MappedSwapVirtualMemory<Tick, TICK_AS_NUMBER, DATA_AS_NUMBER, ticksLength, SwapMode::INDEX_MODE, 0> ticksSwapVM;
+#else
     inline static SwapVirtualMemory<Tick, TICK_AS_NUMBER, DATA_AS_NUMBER, TICKS_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> ticksSwapVM;
+#endif
 
     // Allocated tickTransactions buffer with tickTransactionsSize bytes (includes current and previous epoch data)
     inline static unsigned char* tickTransactionsPtr = nullptr;
+#ifdef USE_MAPPED_SWAP
+    inline static MappedSwapVirtualMemory<Transaction, TX00_AS_NUMBER, DATA_AS_NUMBER, tickTransactionsSizeCurrentEpoch, SwapMode::OFFSET_MODE, MAX_INPUT_SIZE + SIGNATURE_SIZE> tickTransactionsSwapVM;
+#else
     inline static SwapVirtualMemory<Transaction, TX00_AS_NUMBER, DATA_AS_NUMBER, TRANSACTION_PAGE_CAPACITY, CACHE_PAGE, SwapMode::OFFSET_MODE, MAX_INPUT_SIZE + SIGNATURE_SIZE> tickTransactionsSwapVM;
+#endif
 
     // Allocated tickTransactionOffsets buffer with tickTransactionOffsetsLength elements (includes current and previous epoch data)
     inline static unsigned long long* tickTransactionOffsetsPtr = nullptr;
@@ -109,9 +130,42 @@ private:
     struct TxHashMapEntry {
         m256i digest;
         unsigned long long offset;
+        unsigned int tick;
+        unsigned short transactionIndex;
     };
     inline static unsigned char* tickTransactionsDigestPtr = nullptr;
+#ifdef USE_MAPPED_SWAP
+    inline static MappedSwapVirtualMemory<TxHashMapEntry, TXDI_AS_NUMBER, DATA_AS_NUMBER, tickTransactionOffsetsLengthCurrentEpoch, SwapMode::INDEX_MODE, 0> tickTransactionsDigestSwapVM;
+#else
     inline static SwapVirtualMemory<TxHashMapEntry, TXDI_AS_NUMBER, DATA_AS_NUMBER, TRANSACTION_DIGEST_HASHMAP_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> tickTransactionsDigestSwapVM;
+#endif
+
+    // Allocated per-identity transaction index of current epoch (hash map of identities and list of their transactions).
+    // Like the digest hash map, it is swapped to disk with USE_SWAP, because lookups touch it at random.
+    struct IdentityTxHead {
+        m256i publicKey;
+        unsigned int firstPosting;
+        unsigned int lastPosting;
+    };
+    struct IdentityTxPosting {
+        unsigned int tick;
+        unsigned short transactionIndex;
+        unsigned short isSource;
+        unsigned int nextPosting;
+    };
+    static constexpr unsigned long long identityTransactionsHeadsLength = tickTransactionOffsetsLengthCurrentEpoch;
+    static constexpr unsigned long long identityTransactionsPostingsLength = tickTransactionOffsetsLengthCurrentEpoch * 2;
+    static_assert(identityTransactionsPostingsLength < 0xffffffffULL, "Posting index must fit into 32 bits");
+#ifdef USE_MAPPED_SWAP
+    inline static MappedSwapVirtualMemory<IdentityTxHead, IDTH_AS_NUMBER, DATA_AS_NUMBER, identityTransactionsHeadsLength, SwapMode::INDEX_MODE, 0> identityTransactionsHeadsSwapVM;
+    inline static MappedSwapVirtualMemory<IdentityTxPosting, IDTP_AS_NUMBER, DATA_AS_NUMBER, identityTransactionsPostingsLength, SwapMode::INDEX_MODE, 0> identityTransactionsPostingsSwapVM;
+#elif defined(USE_SWAP)
+    inline static SwapVirtualMemory<IdentityTxHead, IDTH_AS_NUMBER, DATA_AS_NUMBER, IDENTITY_TRANSACTIONS_HEADS_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> identityTransactionsHeadsSwapVM;
+    inline static SwapVirtualMemory<IdentityTxPosting, IDTP_AS_NUMBER, DATA_AS_NUMBER, IDENTITY_TRANSACTIONS_POSTINGS_PAGE_CAPACITY, CACHE_PAGE, SwapMode::INDEX_MODE, 0> identityTransactionsPostingsSwapVM;
+#else
+    inline static unsigned char* identityTransactionsHeadsPtr = nullptr;
+    inline static unsigned char* identityTransactionsPostingsPtr = nullptr;
+#endif
 
     // Lock for securing tickData
     inline static volatile char tickDataLock = 0;
@@ -122,7 +176,7 @@ private:
     // Lock for securing tickTransactions and tickTransactionOffsets
     inline static volatile char tickTransactionsLock = 0;
 
-    // Lock for securing tickTransactions and tickTransactionsDigestPtr
+    // Lock for securing tickTransactions, tickTransactionsDigestPtr and the identity transaction index
     inline static volatile char tickTransactionsDigestAccessLock = 0;
 
 #if TICK_STORAGE_AUTOSAVE_MODE
@@ -449,6 +503,27 @@ private:
     
 
 public:
+#ifdef USE_SWAP
+    struct SwapStorageStats
+    {
+        SwapStats tickData;
+        SwapStats ticks;
+        SwapStats transactions;
+        SwapStats transactionDigests;
+    };
+
+    // Paging statistics of the swap storage, can be called from any thread
+    SwapStorageStats getSwapStats()
+    {
+        SwapStorageStats stats;
+        stats.tickData = tickDataSwapVM.getStats();
+        stats.ticks = ticksSwapVM.getStats();
+        stats.transactions = tickTransactionsSwapVM.getStats();
+        stats.transactionDigests = tickTransactionsDigestSwapVM.getStats();
+        return stats;
+    }
+#endif
+
 #if TICK_STORAGE_AUTOSAVE_MODE
     unsigned int getPreloadTick() const
     {
@@ -592,7 +667,8 @@ public:
                 unsigned long long &offset = tickTransactionOffsets(i, j);
                 if (offset)
                 {
-                    transactionsDigestAccess.insertTransaction(tickData->transactionDigests[j], offset);
+                    transactionsDigestAccess.insertTransaction(tickData->transactionDigests[j], offset, i, j);
+                    identityTransactionsAccess.insertTransaction(tickTransactions(offset), j);
                 } else
                 {
                     break;
@@ -685,6 +761,14 @@ public:
             return false;
         }
 
+#ifndef USE_SWAP
+        if (!allocPoolWithErrorLog(L"identityTransactionsHeadsPtr", identityTransactionsHeadsLength * sizeof(IdentityTxHead), (void**)&identityTransactionsHeadsPtr, __LINE__, true, true)
+            || !allocPoolWithErrorLog(L"identityTransactionsPostingsPtr", identityTransactionsPostingsLength * sizeof(IdentityTxPosting), (void**)&identityTransactionsPostingsPtr, __LINE__, true, true))
+        {
+            return false;
+        }
+#endif
+
         // if we don't use swap, these memory will be commited on the fly while core is running (below is just reserve space, not physical memory allocation)
         if (!allocPoolWithErrorLog(L"tickDataPtr ", tickDataSize, (void**)&tickDataPtr, __LINE__, true, false)
             || !allocPoolWithErrorLog(L"tickPtr", ticksSize, (void**)&ticksPtr, __LINE__, true, false)
@@ -698,6 +782,12 @@ public:
         ticksSwapVM.init();
         tickTransactionsSwapVM.init();
         tickTransactionsDigestSwapVM.init();
+        identityTransactionsHeadsSwapVM.init();
+        identityTransactionsPostingsSwapVM.init();
+        // Hash map lookups have no locality, reading ahead would only evict useful pages
+        tickTransactionsDigestSwapVM.adviseRandomAccess();
+        identityTransactionsHeadsSwapVM.adviseRandomAccess();
+        identityTransactionsPostingsSwapVM.adviseRandomAccess();
 #endif
 
         ASSERT(tickDataLock == 0);
@@ -747,6 +837,18 @@ public:
         {
             freePool(tickTransactionsDigestPtr);
         }
+
+#ifndef USE_SWAP
+        if (identityTransactionsHeadsPtr)
+        {
+            freePool(identityTransactionsHeadsPtr);
+        }
+
+        if (identityTransactionsPostingsPtr)
+        {
+            freePool(identityTransactionsPostingsPtr);
+        }
+#endif
     }
 
     // Begin new epoch. If not called the first time (seamless transition), assume that the ticks to keep
@@ -942,6 +1044,14 @@ public:
         }
         // Transaction digest look up need to reset at the begining of epoch for pointing to valid current epoch transaction
 		qVirtualFreeAndRecommit(tickTransactionsDigestPtr, tickTransactionOffsetsLengthCurrentEpoch * sizeof(TransactionsDigestAccess::HashMapEntry));
+#ifdef USE_SWAP
+        identityTransactionsHeadsSwapVM.reset();
+        identityTransactionsPostingsSwapVM.reset();
+#else
+        qVirtualFreeAndRecommit(identityTransactionsHeadsPtr, identityTransactionsHeadsLength * sizeof(IdentityTxHead));
+        qVirtualFreeAndRecommit(identityTransactionsPostingsPtr, identityTransactionsPostingsLength * sizeof(IdentityTxPosting));
+#endif
+        identityTransactionsAccess.reset();
 
         tickBegin = newInitialTick;
         tickEnd = newInitialTick + MAX_NUMBER_OF_TICKS_PER_EPOCH;
@@ -1398,6 +1508,10 @@ public:
         {
             m256i digest; // isZero mean not occupied
             unsigned long long offset;
+            // Tick and slot of transaction in tick data. They grow the entry from 40 to 48 bytes, so the hash map
+            // (tickTransactionOffsetsLengthCurrentEpoch entries) takes 20% more memory and swap space.
+            unsigned int tick;
+            unsigned short transactionIndex;
         };
         unsigned long long hashFunc(const m256i& digest)
         {
@@ -1415,7 +1529,7 @@ public:
 #endif
         }
 
-        void insertTransaction(const m256i& digest, const unsigned long long offset)
+        void insertTransaction(const m256i& digest, const unsigned long long offset, unsigned int tick, unsigned int transactionIndex)
         {
             // Zero digest. No further process
             if (isZero(digest))
@@ -1436,15 +1550,18 @@ public:
                 }
             }
             getByIndex(index).offset = offset;
+            getByIndex(index).tick = tick;
+            getByIndex(index).transactionIndex = transactionIndex;
             getByIndex(index).digest = digest;
         }
 
-        const Transaction* findTransaction(const m256i& digest)
+        // Return index of digest in hash map or -1 if not found
+        long long findIndex(const m256i& digest)
         {
             // Zero digest. No further process
             if (isZero(digest))
             {
-                return NULL;
+                return -1;
             }
 
             unsigned long long index = hashFunc(digest);
@@ -1453,7 +1570,7 @@ public:
             {
                 if (getByIndex(index).digest == digest)
                 {
-                    return TickTransactionsAccess::ptr(getByIndex(index).offset);
+                    return index;
                 }
                 index = (index + 1) % tickTransactionOffsetsLengthCurrentEpoch;
                 if (index == original_index)
@@ -1461,7 +1578,192 @@ public:
                     break;
                 }
             }
-            return NULL;
+            return -1;
+        }
+
+        const Transaction* findTransaction(const m256i& digest)
+        {
+            const long long index = findIndex(digest);
+            if (index < 0)
+            {
+                return NULL;
+            }
+            return TickTransactionsAccess::ptr(getByIndex(index).offset);
+        }
+
+        // Get tick and slot in tick data of transaction with digest. Returns false if not found.
+        bool findTransactionLocation(const m256i& digest, unsigned int& tick, unsigned int& transactionIndex)
+        {
+            const long long index = findIndex(digest);
+            if (index < 0)
+            {
+                return false;
+            }
+            tick = getByIndex(index).tick;
+            transactionIndex = getByIndex(index).transactionIndex;
+            return true;
         }
     } transactionsDigestAccess;
+
+    // Struct for access the transactions of the current epoch that an identity is source or destination of, without
+    // scanning all ticks. It is filled together with transactionsDigestAccess and protected by the same lock.
+    static struct IdentityTransactionsAccess
+    {
+        // With SwapVirtualMemory, a reference is only valid until the next access to the same array, so the functions
+        // below access entries by index and don't keep references.
+        struct Head
+        {
+            m256i publicKey; // isZero mean not occupied
+            unsigned int firstPosting; // 1-based index in postings, 0 means none
+            unsigned int lastPosting;
+        };
+        static_assert(sizeof(Head) == sizeof(IdentityTxHead), "Head must match the swapped entry");
+
+        struct Posting
+        {
+            unsigned int tick;
+            unsigned short transactionIndex;
+            unsigned short isSource;
+            unsigned int nextPosting; // 1-based index in postings, 0 means end of list
+        };
+        static_assert(sizeof(Posting) == sizeof(IdentityTxPosting), "Posting must match the swapped entry");
+
+        // Number of postings used in current epoch
+        inline static unsigned int numberOfPostings = 0;
+
+        // Set if an identity or transaction could not be added because the index is full
+        inline static bool isIncomplete = false;
+
+        unsigned long long hashFunc(const m256i& publicKey)
+        {
+            return publicKey.m256i_u64[0] % identityTransactionsHeadsLength;
+        }
+
+        Head& getHeadByIndex(unsigned long long index)
+        {
+            ASSERT(index < identityTransactionsHeadsLength);
+#ifdef USE_SWAP
+            return (Head&)identityTransactionsHeadsSwapVM.getRef(index);
+#else
+            return ((Head*)identityTransactionsHeadsPtr)[index];
+#endif
+        }
+
+        Posting& getPosting(unsigned int posting)
+        {
+            ASSERT(posting > 0 && posting <= identityTransactionsPostingsLength);
+#ifdef USE_SWAP
+            return (Posting&)identityTransactionsPostingsSwapVM.getRef(posting - 1);
+#else
+            return ((Posting*)identityTransactionsPostingsPtr)[posting - 1];
+#endif
+        }
+
+        // Find the head of publicKey and set index to it. If it does not exist yet and create is set, a new head is
+        // added. Returns false if not found or if the hash map is full.
+        bool findHead(const m256i& publicKey, bool create, unsigned long long& index)
+        {
+            index = hashFunc(publicKey);
+            unsigned long long original_index = index;
+            while (!isZero(getHeadByIndex(index).publicKey))
+            {
+                if (getHeadByIndex(index).publicKey == publicKey)
+                {
+                    return true;
+                }
+                index = (index + 1) % identityTransactionsHeadsLength;
+                if (index == original_index)
+                {
+                    return false;
+                }
+            }
+            if (!create)
+            {
+                return false;
+            }
+            getHeadByIndex(index).publicKey = publicKey;
+            return true;
+        }
+
+        void addPosting(const m256i& publicKey, unsigned int tick, unsigned int transactionIndex, bool isSource)
+        {
+            // Zero key marks free hash map entries, so transactions to the zero identity are not indexed
+            if (isZero(publicKey))
+            {
+                return;
+            }
+
+            unsigned long long headIndex;
+            if (!findHead(publicKey, true, headIndex) || numberOfPostings >= identityTransactionsPostingsLength)
+            {
+                isIncomplete = true;
+                return;
+            }
+
+            // Postings of an identity are ordered by tick and transaction index. Skip transactions that are already
+            // in the list, for example if a tick is processed again.
+            const unsigned int lastPosting = getHeadByIndex(headIndex).lastPosting;
+            if (lastPosting)
+            {
+                const Posting& last = getPosting(lastPosting);
+                if (last.tick > tick || (last.tick == tick && last.transactionIndex >= transactionIndex))
+                {
+                    return;
+                }
+            }
+
+            const unsigned int posting = ++numberOfPostings;
+            Posting& newPosting = getPosting(posting);
+            newPosting.tick = tick;
+            newPosting.transactionIndex = transactionIndex;
+            newPosting.isSource = isSource;
+            newPosting.nextPosting = 0;
+            if (lastPosting)
+            {
+                getPosting(lastPosting).nextPosting = posting;
+            }
+            else
+            {
+                getHeadByIndex(headIndex).firstPosting = posting;
+            }
+            getHeadByIndex(headIndex).lastPosting = posting;
+        }
+
+        void reset()
+        {
+            numberOfPostings = 0;
+            isIncomplete = false;
+        }
+
+        // Add transaction stored at slot transactionIndex of its tick to the lists of its source and destination
+        void insertTransaction(const Transaction* transaction, unsigned int transactionIndex)
+        {
+            addPosting(transaction->sourcePublicKey, transaction->tick, transactionIndex, true);
+            if (transaction->destinationPublicKey != transaction->sourcePublicKey)
+            {
+                addPosting(transaction->destinationPublicKey, transaction->tick, transactionIndex, false);
+            }
+        }
+
+        // Call callback(const Transaction* transaction, bool isSource) for each transaction of publicKey in order of
+        // tick and transaction index. Returns false if the index is incomplete, so the caller has to scan the ticks.
+        template <typename CallbackT>
+        bool forEachTransaction(const m256i& publicKey, CallbackT callback)
+        {
+            if (isIncomplete)
+            {
+                return false;
+            }
+            unsigned long long headIndex;
+            const unsigned int firstPosting = (findHead(publicKey, false, headIndex)) ? getHeadByIndex(headIndex).firstPosting : 0;
+            for (unsigned int posting = firstPosting; posting; )
+            {
+                const Posting p = getPosting(posting);
+                posting = p.nextPosting;
+                const unsigned long long offset = TickTransactionOffsetsAccess::getByTickInCurrentEpoch(p.tick)[p.transactionIndex];
+                callback((const Transaction*)TickTransactionsAccess::ptr(offset), p.isSource != 0);
+            }
+            return true;
+        }
+    } identityTransactionsAccess;
 };
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "platform/m256.h"
+#include "platform/memory.h"
+#include "platform/concurrency.h"
+#include "network_messages/common_def.h"
+#include "public_settings.h"
+
+// Remembers tick votes whose signature has been verified already, so copies of a vote relayed by other peers
+// (which pass the dejavu filter because their dejavu differs) can be dropped without another FourQ check.
+// Also counts verified, deduplicated, and rejected votes per tick.
+class TickVoteCache
+{
+public:
+    // Number of ticks for which votes are remembered and counted at the same time
+    static constexpr unsigned int tickSlots = 4;
+
+    struct VoteCounters
+    {
+        volatile unsigned int tick;
+        volatile long long verified;
+        volatile long long deduplicated;
+        volatile long long rejected;
+    };
+
+private:
+    struct Entry
+    {
+        m256i digest;
+        unsigned char signature[SIGNATURE_SIZE];
+        unsigned int tick; // 0 = unused
+    };
+
+    Entry entries[NUMBER_OF_COMPUTORS][tickSlots];
+    volatile char entryLocks[NUMBER_OF_COMPUTORS];
+
+    VoteCounters counters[tickSlots];
+    volatile char countersLock;
+
+    // Get the counters of the tick, resetting the slot if it holds an older tick. Returns nullptr if the slot is
+    // already used by a newer tick.
+    VoteCounters* countersOf(unsigned int tick)
+    {
+        VoteCounters& slot = counters[tick % tickSlots];
+        if (slot.tick != tick)
+        {
+            ACQUIRE(countersLock);
+            if (slot.tick < tick)
+            {
+                slot.verified = 0;
+                slot.deduplicated = 0;
+                slot.rejected = 0;
+                slot.tick = tick;
+            }
+            RELEASE(countersLock);
+            if (slot.tick != tick)
+            {
+                return nullptr;
+            }
+        }
+        return &slot;
+    }
+
+public:
+    void init()
+    {
+        setMem(this, sizeof(*this), 0);
+    }
+
+    // Return true if exactly this vote (same computor, tick, digest, and signature) has been verified before.
+    bool isVerified(unsigned int computorIndex, unsigned int tick, const m256i& digest, const unsigned char* signature)
+    {
+        const Entry& entry = entries[computorIndex][tick % tickSlots];
+        ACQUIRE(entryLocks[computorIndex]);
+        const bool verified = entry.tick == tick && entry.digest == digest
+            && *((const m256i*)entry.signature) == *((const m256i*)signature)
+            && *((const m256i*)(entry.signature + 32)) == *((const m256i*)(signature + 32));
+        RELEASE(entryLocks[computorIndex]);
+        return verified;
+    }
+
+    // Remember a vote whose signature has been verified successfully.
+    void addVerified(unsigned int computorIndex, unsigned int tick, const m256i& digest, const unsigned char* signature)
+    {
+        Entry& entry = entries[computorIndex][tick % tickSlots];
+        ACQUIRE(entryLocks[computorIndex]);
+        entry.digest = digest;
+        copyMem(entry.signature, signature, SIGNATURE_SIZE);
+        entry.tick = tick;
+        RELEASE(entryLocks[computorIndex]);
+    }
+
+    void countVerified(unsigned int tick)
+    {
+        VoteCounters* tickCounters = countersOf(tick);
+        if (tickCounters)
+        {
+            _InterlockedIncrement64(&tickCounters->verified);
+        }
+    }
+
+    void countDeduplicated(unsigned int tick)
+    {
+        VoteCounters* tickCounters = countersOf(tick);
+        if (tickCounters)
+        {
+            _InterlockedIncrement64(&tickCounters->deduplicated);
+        }
+    }
+
+    void countRejected(unsigned int tick)
+    {
+        VoteCounters* tickCounters = countersOf(tick);
+        if (tickCounters)
+        {
+            _InterlockedIncrement64(&tickCounters->rejected);
+        }
+    }
+
+    // Get verified, deduplicated, and rejected votes of the tick (all zero if no vote of the tick has been counted).
+    void getCounters(unsigned int tick, long long& verified, long long& deduplicated, long long& rejected) const
+    {
+        const VoteCounters& slot = counters[tick % tickSlots];
+        if (slot.tick == tick)
+        {
+            verified = slot.verified;
+            deduplicated = slot.deduplicated;
+            rejected = slot.rejected;
+        }
+        else
+        {
+            verified = deduplicated = rejected = 0;
+        }
+    }
+};
@@ -123,6 +123,27 @@ public:
             EXPECT_EQ(it1->second, it2->second);
         }
 
+        // check maintained list lengths
+        for (const auto& it : arrayElementCount)
+        {
+            if (it.first != NO_ASSET_INDEX)
+                EXPECT_EQ(indexLists.ownershipsPossessionsCount[it.first], it.second);
+        }
+
+        // check that each record is found from the public key of its entity
+        for (unsigned int index = 0; index < ASSETS_CAPACITY; index++)
+        {
+            if (assets[index].varStruct.issuance.type != EMPTY)
+            {
+                bool found = false;
+                forEachAssetRecordOfEntity(assets[index].varStruct.issuance.publicKey, [index, &found](unsigned int i)
+                    {
+                        found = found || (i == index);
+                    });
+                EXPECT_TRUE(found);
+            }
+        }
+
         // check that number of owned and possessed shares are equal for each issuance
         issuanceIdx = indexLists.issuancesFirstIdx;
         while (issuanceIdx != NO_ASSET_INDEX)
@@ -0,0 +1,86 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/ticking/epoch_stats.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static EpochStats stats;
+
+TEST(TestEpochStats, CountsConsecutiveTicks)
+{
+    stats.beginEpoch(150, 1000);
+    EpochStats::Data data = stats.get();
+    EXPECT_EQ(data.epoch, 150);
+    EXPECT_EQ(data.initialTick, 1000u);
+    EXPECT_EQ(data.numberOfTicks, 0u);
+    EXPECT_EQ(data.quality(), 0.0);
+
+    stats.addTick(1000, false, 5, EpochStats::unknownTickDuration);
+    stats.addTick(1001, true, 0, 2000);
+    stats.addTick(1002, false, 7, 3000);
+    stats.addTick(1003, false, 1, 1000);
+
+    // not the next tick
+    stats.addTick(1002, false, 100, 100);
+    stats.addTick(1005, false, 100, 100);
+
+    data = stats.get();
+    EXPECT_EQ(data.numberOfTicks, 4u);
+    EXPECT_EQ(data.numberOfEmptyTicks, 1u);
+    EXPECT_EQ(data.numberOfTransactions, 13ull);
+    EXPECT_EQ(data.numberOfTimedTicks, 3u);
+    EXPECT_EQ(data.totalTickDuration, 6000ull);
+    EXPECT_EQ(data.maxTickDuration, 3000u);
+    EXPECT_EQ(data.quality(), 0.75);
+
+    // restore from snapshot data
+    stats.beginEpoch(151, 2000);
+    EXPECT_EQ(stats.get().numberOfTicks, 0u);
+    stats.set(data);
+    EXPECT_EQ(stats.get().epoch, 150);
+    stats.addTick(1004, true, 0, 500);
+    EXPECT_EQ(stats.get().numberOfTicks, 5u);
+    EXPECT_EQ(stats.get().numberOfEmptyTicks, 2u);
+}
+
+TEST(TestEpochStats, ReadersGetConsistentData)
+{
+    stats.beginEpoch(150, 0);
+
+    // Every second tick is empty and each tick with even number has as many transactions as its number
+    std::atomic<bool> stop = false;
+    std::atomic<unsigned long long> numberOfChecks = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; i++)
+    {
+        readers.emplace_back([&]()
+            {
+                while (!stop)
+                {
+                    const EpochStats::Data data = stats.get();
+                    const unsigned long long evenTicks = (data.numberOfTicks + 1) / 2;
+                    EXPECT_EQ(data.numberOfEmptyTicks, data.numberOfTicks / 2);
+                    EXPECT_EQ(data.numberOfTransactions, evenTicks * (evenTicks - 1));
+                    EXPECT_EQ(data.numberOfTimedTicks, data.numberOfTicks);
+                    numberOfChecks++;
+                }
+            });
+    }
+
+    for (unsigned int tick = 0; tick < 200000; tick++)
+    {
+        stats.addTick(tick, tick & 1, (tick & 1) ? 0 : tick, 10);
+    }
+    stop = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    EXPECT_GT(numberOfChecks, 0ull);
+    EXPECT_EQ(stats.get().numberOfTicks, 200000u);
+}
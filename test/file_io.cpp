@@ -682,3 +682,202 @@ TEST(TestAsyncFileIO, FindKLargestKDuplicated)
     }
 }
 
+
+#ifdef USE_DIRECT_FILE_IO
+
+static void fillTestPattern(std::vector<unsigned char>& data, unsigned int seed)
+{
+    for (unsigned long long i = 0; i < data.size(); i++)
+    {
+        data[i] = (unsigned char)((i * 31 + seed) ^ (i >> 11));
+    }
+}
+
+static void testDirectFileIORoundTrip(bool isThreadPoolForced)
+{
+    DirectFileIO fileIO;
+    EXPECT_TRUE(fileIO.init(isThreadPoolForced));
+    if (isThreadPoolForced)
+    {
+        EXPECT_EQ(fileIO.getBackend(), DirectFileIO::kThreadPool);
+    }
+
+    std::vector<unsigned char> written(3 * 1024 * 1024 + 17), read(written.size());
+    fillTestPattern(written, 7);
+    EXPECT_EQ(fileIO.write("tmp_direct_file_io", written.data(), written.size()), (long long)written.size());
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io", read.data(), read.size()), (long long)read.size());
+    EXPECT_TRUE(read == written);
+
+    // Missing file and file shorter than the request
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io_missing", read.data(), read.size()), -1);
+    EXPECT_EQ(fileIO.write("tmp_direct_file_io", written.data(), 100), 100);
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io", read.data(), 200), -1);
+
+    const DirectFileIO::Stats stats = fileIO.getStats();
+    EXPECT_EQ(stats.writes, 2);
+    EXPECT_EQ(stats.reads, 1);
+    EXPECT_EQ(stats.failures, 1);
+    EXPECT_EQ(stats.bytesWritten, written.size() + 100);
+    EXPECT_EQ(stats.bytesRead, read.size());
+    EXPECT_EQ(stats.inFlight, 0);
+    fileIO.deinit();
+    remove("tmp_direct_file_io");
+}
+
+// Many requests on parts of one file, submitted by several threads at the same time
+static void testDirectFileIOConcurrentRequests(bool isThreadPoolForced)
+{
+    DirectFileIO fileIO;
+    fileIO.init(isThreadPoolForced);
+
+    constexpr unsigned int numberOfThreads = 4;
+    constexpr unsigned int requestsPerThread = 32;
+    constexpr unsigned long long partSize = 64 * 1024;
+    std::vector<unsigned char> written(numberOfThreads * requestsPerThread * partSize), read(written.size());
+    fillTestPattern(written, 3);
+
+    for (bool isWrite : { true, false })
+    {
+        const int fd = DirectFileIO::openFile("tmp_direct_file_io_parts", isWrite);
+        ASSERT_GE(fd, 0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < numberOfThreads; t++)
+        {
+            threads.emplace_back([&, t]()
+                {
+                    FileIORequest requests[requestsPerThread];
+                    for (unsigned int i = 0; i < requestsPerThread; i++)
+                    {
+                        // interleave the parts of the threads
+                        const unsigned long long offset = (i * numberOfThreads + t) * partSize;
+                        requests[i].fd = fd;
+                        requests[i].isWrite = isWrite;
+                        requests[i].buffer = (isWrite ? written.data() : read.data()) + offset;
+                        requests[i].size = partSize;
+                        requests[i].offset = offset;
+                        fileIO.submit(requests[i]);
+                    }
+                    for (unsigned int i = 0; i < requestsPerThread; i++)
+                    {
+                        EXPECT_EQ(fileIO.wait(requests[i]), (long long)partSize);
+                        EXPECT_TRUE(requests[i].isDone);
+                    }
+                });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        close(fd);
+    }
+    EXPECT_TRUE(read == written);
+
+    const DirectFileIO::Stats stats = fileIO.getStats();
+    EXPECT_EQ(stats.writes, numberOfThreads * requestsPerThread);
+    EXPECT_EQ(stats.reads, numberOfThreads * requestsPerThread);
+    EXPECT_EQ(stats.failures, 0);
+    fileIO.deinit();
+    remove("tmp_direct_file_io_parts");
+}
+
+TEST(TestDirectFileIO, RoundTripIoUring)
+{
+    testDirectFileIORoundTrip(false);
+}
+
+TEST(TestDirectFileIO, RoundTripThreadPool)
+{
+    testDirectFileIORoundTrip(true);
+}
+
+TEST(TestDirectFileIO, ConcurrentRequestsIoUring)
+{
+    testDirectFileIOConcurrentRequests(false);
+}
+
+TEST(TestDirectFileIO, ConcurrentRequestsThreadPool)
+{
+    testDirectFileIOConcurrentRequests(true);
+}
+
+// Kernel that sets up io_uring but doesn't have IORING_OP_READ and IORING_OP_WRITE yet, like Linux 5.5
+class DirectFileIOWithoutReadWriteOps : public DirectFileIO
+{
+protected:
+    bool probeRequestOpcodes() override
+    {
+        std::vector<unsigned char> probe(sizeof(io_uring_probe) + (IORING_OP_CONNECT + 1) * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* ops = (io_uring_probe*)probe.data();
+        ops->last_op = IORING_OP_CONNECT;
+        for (unsigned int i = 0; i <= IORING_OP_CONNECT; i++)
+        {
+            ops->ops[i].op = (unsigned char)i;
+            ops->ops[i].flags = IO_URING_OP_SUPPORTED;
+        }
+        return areRequestOpcodesSupported(ops);
+    }
+};
+
+TEST(TestDirectFileIO, ThreadPoolIfReadWriteOpsAreMissing)
+{
+    DirectFileIOWithoutReadWriteOps fileIO;
+    EXPECT_TRUE(fileIO.init());
+    EXPECT_EQ(fileIO.getBackend(), DirectFileIO::kThreadPool);
+
+    std::vector<unsigned char> written(64 * 1024), read(written.size());
+    fillTestPattern(written, 13);
+    EXPECT_EQ(fileIO.write("tmp_direct_file_io_old_kernel", written.data(), written.size()), (long long)written.size());
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io_old_kernel", read.data(), read.size()), (long long)read.size());
+    EXPECT_TRUE(read == written);
+    EXPECT_EQ(fileIO.getStats().failures, 0);
+    fileIO.deinit();
+    remove("tmp_direct_file_io_old_kernel");
+}
+
+TEST(TestDirectFileIO, RegisteredBuffer)
+{
+    DirectFileIO fileIO;
+    fileIO.init();
+    std::vector<unsigned char> registered(256 * 1024), other(registered.size());
+    fillTestPattern(registered, 5);
+    const bool isRegistered = fileIO.registerBuffer(registered.data(), registered.size());
+    if (fileIO.getBackend() == DirectFileIO::kThreadPool)
+    {
+        EXPECT_FALSE(isRegistered);
+    }
+
+    EXPECT_EQ(fileIO.write("tmp_direct_file_io_registered", registered.data(), registered.size()), (long long)registered.size());
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io_registered", other.data(), other.size()), (long long)other.size());
+    EXPECT_TRUE(other == registered);
+    EXPECT_EQ(fileIO.getStats().fixedBufferTransfers, isRegistered ? 1 : 0);
+
+    // A request that starts in the registered buffer is read into it
+    setMem(registered.data(), registered.size(), 0);
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io_registered", registered.data(), registered.size()), (long long)registered.size());
+    EXPECT_TRUE(other == registered);
+    EXPECT_EQ(fileIO.getStats().fixedBufferTransfers, isRegistered ? 2 : 0);
+
+    fileIO.unregisterBuffer(registered.data(), registered.size());
+    EXPECT_EQ(fileIO.read("tmp_direct_file_io_registered", registered.data(), registered.size()), (long long)registered.size());
+    EXPECT_EQ(fileIO.getStats().fixedBufferTransfers, isRegistered ? 2 : 0);
+    fileIO.deinit();
+    remove("tmp_direct_file_io_registered");
+}
+
+TEST(TestDirectFileIO, FileSystemUsesDirectFileIO)
+{
+    // initialized by FileSystemWrapper
+    ASSERT_NE(gDirectFileIO, nullptr);
+    const DirectFileIO::Stats before = gDirectFileIO->getStats();
+    std::vector<unsigned char> written(1000), read(written.size());
+    fillTestPattern(written, 11);
+    EXPECT_EQ(save(L"tmp_direct_file_io_save", written.size(), written.data()), (long long)written.size());
+    EXPECT_EQ(load(L"tmp_direct_file_io_save", read.size(), read.data()), (long long)read.size());
+    EXPECT_TRUE(read == written);
+    const DirectFileIO::Stats after = gDirectFileIO->getStats();
+    EXPECT_EQ(after.writes, before.writes + 1);
+    EXPECT_EQ(after.reads, before.reads + 1);
+    remove("tmp_direct_file_io_save");
+}
+
+#endif
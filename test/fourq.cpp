@@ -262,3 +262,65 @@ TEST(TestFourQ, TestSign)
         }
     }
 }
+
+// verifyBatch(unsigned int count, const unsigned char* const* publicKeys, const unsigned char* const* messageDigests, const unsigned char* const* signatures, bool* results)
+TEST(TestFourQ, TestVerifyBatch)
+{
+#ifdef __AVX512F__
+    initAVX512FourQConstants();
+#endif
+
+    constexpr unsigned int numberOfTests = VERIFY_BATCH_MAX_SIZE;
+    unsigned char publicKeys[numberOfTests][32];
+    unsigned char messageDigests[numberOfTests][32];
+    unsigned char signatures[numberOfTests][64];
+    const unsigned char* publicKeyPtrs[numberOfTests];
+    const unsigned char* messageDigestPtrs[numberOfTests];
+    const unsigned char* signaturePtrs[numberOfTests];
+
+    for (unsigned int i = 0; i < numberOfTests; ++i)
+    {
+        unsigned char subseed[32];
+        unsigned char privateKey[32];
+        for (int k = 0; k < 32; ++k)
+        {
+            subseed[k] = (unsigned char)(i * 37 + k * 11 + 1);
+            messageDigests[i][k] = (unsigned char)(i * 13 + k * 7);
+        }
+        getPrivateKey(subseed, privateKey);
+        getPublicKey(privateKey, publicKeys[i]);
+        sign(subseed, publicKeys[i], messageDigests[i], signatures[i]);
+
+        publicKeyPtrs[i] = publicKeys[i];
+        messageDigestPtrs[i] = messageDigests[i];
+        signaturePtrs[i] = signatures[i];
+    }
+
+    // Invalidate some of the signatures in different ways
+    signatures[1][5] ^= 1;
+    messageDigests[4][0] ^= 1;
+    publicKeys[9][3] ^= 4;
+    signatures[16][40] ^= 1;
+    signatures[25][63] = 1;
+
+    for (unsigned int count : { 0u, 1u, 5u, numberOfTests })
+    {
+        bool results[numberOfTests];
+        verifyBatch(count, publicKeyPtrs, messageDigestPtrs, signaturePtrs, results);
+
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            EXPECT_EQ(results[i], verify(publicKeys[i], messageDigests[i], signatures[i])) << " at [" << i << "] of " << count;
+        }
+    }
+
+    bool results[numberOfTests];
+    verifyBatch(numberOfTests, publicKeyPtrs, messageDigestPtrs, signaturePtrs, results);
+    EXPECT_TRUE(results[0]);
+    EXPECT_FALSE(results[1]);
+    EXPECT_FALSE(results[4]);
+    EXPECT_FALSE(results[9]);
+    EXPECT_FALSE(results[16]);
+    EXPECT_FALSE(results[25]);
+    EXPECT_TRUE(results[numberOfTests - 1]);
+}
@@ -94,3 +94,58 @@ TEST(TestCoreK12, CompareK12Implementations)
     ASSERT_EQ(memcmp(outputArrayXKCP, outputArray, outputN), 0);
     delete [] inputPtr;
 }
+
+TEST(TestCoreK12, MultiBuffer64To32SameAsScalar)
+{
+    constexpr unsigned int maxCount = 67;
+    unsigned long long inputs[maxCount * 8];
+    for (unsigned int i = 0; i < maxCount * 8; ++i)
+        _rdrand64_step(&inputs[i]);
+
+    m256i expectedOutputs[maxCount];
+    for (unsigned int i = 0; i < maxCount; ++i)
+        KangarooTwelve64To32(&inputs[i * 8], &expectedOutputs[i]);
+
+    // every count from 0 to maxCount, so that all combinations of full vectors and scalar remainder are covered
+    for (unsigned int count = 0; count <= maxCount; ++count)
+    {
+        m256i outputs[maxCount + 1];
+        setMem(outputs, sizeof(outputs), 0xAB);
+        KangarooTwelve64To32Multi(inputs, outputs, count);
+        for (unsigned int i = 0; i < count; ++i)
+            EXPECT_EQ(outputs[i], expectedOutputs[i]) << "count " << count << ", index " << i;
+        for (unsigned int i = 0; i < 32; ++i)
+            EXPECT_EQ(outputs[count].m256i_u8[i], 0xAB);
+    }
+}
+
+TEST(TestCoreK12, PerformanceMultiBuffer64To32)
+{
+    constexpr unsigned int count = 1 << 20;
+    unsigned long long* inputs = new unsigned long long[count * 8];
+    m256i* outputs = new m256i[count];
+    m256i* expectedOutputs = new m256i[count];
+    for (unsigned int i = 0; i < count * 8; ++i)
+        inputs[i] = i * 0x9E3779B97F4A7C15ULL;
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (unsigned int i = 0; i < count; ++i)
+        KangarooTwelve64To32(&inputs[i * 8], &expectedOutputs[i]);
+    auto scalarMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    startTime = std::chrono::high_resolution_clock::now();
+    KangarooTwelve64To32Multi(inputs, outputs, count);
+    auto multiMicroSec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - startTime);
+
+    // Earlier tests leave std::hex set, so print the times in decimal and restore the format afterwards
+    std::ios coutFormat(nullptr);
+    coutFormat.copyfmt(std::cout);
+    std::cout << std::dec << "K12 64 to 32 of " << count << " inputs: scalar " << scalarMicroSec.count() << " us, multi-buffer "
+        << multiMicroSec.count() << " us" << std::endl;
+    std::cout.copyfmt(coutFormat);
+    EXPECT_EQ(memcmp(outputs, expectedOutputs, count * sizeof(m256i)), 0);
+
+    delete[] inputs;
+    delete[] outputs;
+    delete[] expectedOutputs;
+}
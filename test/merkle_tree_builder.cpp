@@ -0,0 +1,152 @@
+#define NO_UEFI
+#define SINGLE_COMPILE_UNIT
+
+#include "gtest/gtest.h"
+
+#include "../src/merkle_tree_builder.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+struct Record
+{
+    unsigned long long data[8];
+};
+
+static void hashRecords(const void* records, unsigned int firstIndex, unsigned int count, m256i* digests)
+{
+    for (unsigned int i = 0; i < count; i++)
+    {
+        KangarooTwelve64To32(&((const Record*)records)[firstIndex + i], &digests[i]);
+    }
+}
+
+// Single-threaded tree hashing as done before MerkleTreeBuilder
+static void buildTreeSequentially(const Record* records, unsigned int capacity, m256i* digests)
+{
+    unsigned int digestIndex;
+    for (digestIndex = 0; digestIndex < capacity; digestIndex++)
+    {
+        KangarooTwelve64To32(&records[digestIndex], &digests[digestIndex]);
+    }
+    unsigned int previousLevelBeginning = 0;
+    unsigned int numberOfLeafs = capacity;
+    while (numberOfLeafs > 1)
+    {
+        for (unsigned int i = 0; i < numberOfLeafs; i += 2)
+        {
+            KangarooTwelve64To32(&digests[previousLevelBeginning + i], &digests[digestIndex++]);
+        }
+
+        previousLevelBeginning += numberOfLeafs;
+        numberOfLeafs >>= 1;
+    }
+}
+
+static std::vector<Record> randomRecords(unsigned int capacity)
+{
+    std::mt19937_64 rnd64(capacity);
+    std::vector<Record> records(capacity);
+    for (auto& record : records)
+    {
+        for (auto& data : record.data)
+        {
+            data = rnd64();
+        }
+    }
+    return records;
+}
+
+// Runs helper threads that call MerkleTreeBuilder::help() until they are stopped
+struct Helpers
+{
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+
+    Helpers(MerkleTreeBuilder& builder, unsigned int numberOfThreads)
+    {
+        for (unsigned int i = 0; i < numberOfThreads; i++)
+        {
+            threads.emplace_back([this, &builder]()
+                {
+                    while (!stop)
+                    {
+                        if (!builder.help())
+                            _mm_pause();
+                    }
+                });
+        }
+    }
+
+    ~Helpers()
+    {
+        stop = true;
+        for (auto& thread : threads)
+            thread.join();
+    }
+};
+
+static void checkBuild(unsigned int capacity, unsigned int numberOfHelpers)
+{
+    static MerkleTreeBuilder builder;
+    std::vector<Record> records = randomRecords(capacity);
+    std::vector<m256i> expectedDigests(capacity * 2 - 1), digests(capacity * 2 - 1);
+    buildTreeSequentially(records.data(), capacity, expectedDigests.data());
+
+    Helpers helpers(builder, numberOfHelpers);
+    for (int repetition = 0; repetition < 3; repetition++)
+    {
+        std::fill(digests.begin(), digests.end(), m256i::zero());
+        builder.build(records.data(), capacity, hashRecords, digests.data());
+        for (unsigned int i = 0; i < capacity * 2 - 1; i++)
+        {
+            ASSERT_EQ(digests[i], expectedDigests[i]) << "capacity " << capacity << ", helpers " << numberOfHelpers << ", digest index " << i;
+        }
+    }
+}
+
+TEST(TestMerkleTreeBuilder, SameDigestsAsSequentialHashing)
+{
+    for (unsigned int capacity : { 2u, 64u, 512u, 4096u, 65536u })
+    {
+        checkBuild(capacity, 0);
+        checkBuild(capacity, 3);
+    }
+}
+
+TEST(TestMerkleTreeBuilder, PerformanceComparedToSequentialHashing)
+{
+    static MerkleTreeBuilder builder;
+    constexpr unsigned int capacity = 1 << 22;
+    std::vector<Record> records = randomRecords(capacity);
+    std::vector<m256i> expectedDigests(capacity * 2 - 1), digests(capacity * 2 - 1);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    buildTreeSequentially(records.data(), capacity, expectedDigests.data());
+    auto sequentialMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    std::cout << "Sequential tree hashing of " << capacity << " leaves: " << sequentialMilliSec.count() << " ms" << std::endl;
+
+    const unsigned int numberOfProcessors = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int numberOfHelpers = 0; numberOfHelpers < numberOfProcessors; numberOfHelpers = numberOfHelpers ? numberOfHelpers * 2 : 1)
+    {
+        Helpers helpers(builder, numberOfHelpers);
+        startTime = std::chrono::high_resolution_clock::now();
+        builder.build(records.data(), capacity, hashRecords, digests.data());
+        auto parallelMilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+        std::cout << "MerkleTreeBuilder with " << numberOfHelpers << " helpers: " << parallelMilliSec.count() << " ms" << std::endl;
+        EXPECT_EQ(digests[capacity * 2 - 2], expectedDigests[capacity * 2 - 2]);
+    }
+}
+
+TEST(TestMerkleTreeBuilder, SameDigestsWithAnyNumberOfHelpers)
+{
+    const unsigned int numberOfProcessors = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int numberOfHelpers = 1; numberOfHelpers <= numberOfProcessors; numberOfHelpers *= 2)
+    {
+        checkBuild(1 << 16, numberOfHelpers);
+    }
+}
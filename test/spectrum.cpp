@@ -6,8 +6,10 @@
 #include "gtest/gtest.h"
 #include "contract_testing.h"
 
+#include <algorithm>
 #include <chrono>
 #include <random>
+#include <vector>
 
 #include "logging_test.h"
 #include "spectrum/spectrum.h"
@@ -409,3 +411,126 @@ TEST(TestCoreSpectrum, AntiDustEdgeCaseHugeBinZeroBalance)
     test.afterAntiDust();
 }
 
+
+static void checkSpectrumDigestsAfterRebuild()
+{
+    std::vector<m256i> updatedDigests(spectrumDigests, spectrumDigests + (SPECTRUM_CAPACITY * 2 - 1));
+    rebuildSpectrumDigests();
+    for (unsigned long long i = 0; i < SPECTRUM_CAPACITY * 2 - 1; ++i)
+    {
+        if (updatedDigests[i] != spectrumDigests[i])
+        {
+            EXPECT_EQ(updatedDigests[i], spectrumDigests[i]) << "digest index " << i;
+            break;
+        }
+    }
+}
+
+TEST(TestCoreSpectrum, IncrementalDigestUpdate)
+{
+    SpectrumTest test;
+    rebuildSpectrumDigests();
+
+    m256i richId(123, 4, 5, 6);
+    increaseEnergy(richId, 1000000000llu);
+
+    // Few changes per tick take the path of the changed index list
+    for (int tick = 0; tick < 5; ++tick)
+    {
+        ++system.tick;
+        for (int i = 0; i < 1000; ++i)
+        {
+            transfer(richId, m256i(test.rnd64() % 5000, 1, 2, 3), test.rnd64() % 1000);
+        }
+        ACQUIRE(spectrumLock);
+        updateSpectrumDigests();
+        RELEASE(spectrumLock);
+    }
+    EXPECT_EQ(numberOfSpectrumChangedIndices, 0);
+    checkSpectrumDigestsAfterRebuild();
+
+    // More changes than the list can hold fall back to scanning the spectrum
+    ++system.tick;
+    for (unsigned int i = 0; i < spectrumChangedIndicesCapacity + 1000; ++i)
+    {
+        transfer(richId, m256i::randomValue(), 1);
+    }
+    EXPECT_TRUE(spectrumChangedIndicesOverflow);
+    ACQUIRE(spectrumLock);
+    updateSpectrumDigests();
+    RELEASE(spectrumLock);
+    EXPECT_FALSE(spectrumChangedIndicesOverflow);
+    checkSpectrumDigestsAfterRebuild();
+}
+
+static void checkRichList()
+{
+    std::vector<std::pair<long long, unsigned int>> expected;
+    for (unsigned int i = 0; i < SPECTRUM_CAPACITY; i++)
+    {
+        const long long balance = spectrum[i].incomingAmount - spectrum[i].outgoingAmount;
+        if (balance > 0)
+            expected.emplace_back(-balance, i);
+    }
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(richList.size(), expected.size());
+
+    const unsigned long long numberOfEntities = expected.size();
+    for (unsigned long long first : { 0ull, 1ull, 17ull, numberOfEntities / 2, numberOfEntities - 3, numberOfEntities + 5 })
+    {
+        std::vector<std::pair<long long, unsigned int>> page;
+        EXPECT_EQ(richList.getPage(first, 100, [&page](unsigned int spectrumIndex, long long balance)
+            {
+                page.emplace_back(-balance, spectrumIndex);
+            }), numberOfEntities);
+        const unsigned long long begin = std::min(first, numberOfEntities);
+        const unsigned long long end = std::min(first + 100, numberOfEntities);
+        EXPECT_TRUE(std::equal(page.begin(), page.end(), expected.begin() + begin, expected.begin() + end) && page.size() == end - begin) << "first " << first;
+    }
+}
+
+TEST(TestCoreSpectrum, RichListFollowsSpectrum)
+{
+    SpectrumTest test;
+    EXPECT_TRUE(richList.init());
+
+    m256i richId(123, 4, 5, 6);
+    increaseEnergy(richId, 1000000000llu);
+    for (int i = 0; i < 3000; ++i)
+    {
+        increaseEnergy(m256i(test.rnd64() % 5000, 7, 8, 9), test.rnd64() % 1000000);
+    }
+    richList.rebuild(spectrum);
+    checkRichList();
+
+    // Changes of ticks, including entities that lose their whole balance
+    for (int tick = 0; tick < 5; ++tick)
+    {
+        ++system.tick;
+        for (int i = 0; i < 1000; ++i)
+        {
+            transfer(richId, m256i(test.rnd64() % 5000, 1, 2, 3), test.rnd64() % 1000);
+            const m256i id(test.rnd64() % 5000, 7, 8, 9);
+            const int index = spectrumIndex(id);
+            if (index >= 0)
+                transfer(id, richId, (test.rnd64() % 2) ? energy(index) : energy(index) / 2);
+        }
+        ACQUIRE(spectrumLock);
+        updateSpectrumDigests();
+        RELEASE(spectrumLock);
+        checkRichList();
+    }
+
+    // More changes than the list can hold update the rich list from the change flags
+    ++system.tick;
+    for (unsigned int i = 0; i < spectrumChangedIndicesCapacity + 1000; ++i)
+    {
+        transfer(richId, m256i::randomValue(), 1 + i % 3);
+    }
+    ACQUIRE(spectrumLock);
+    updateSpectrumDigests();
+    RELEASE(spectrumLock);
+    checkRichList();
+
+    richList.deinit();
+}
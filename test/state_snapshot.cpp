@@ -0,0 +1,128 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/state_snapshot.h"
+
+#include <cstdlib>
+
+TEST(TestStateSnapshot, PagesAreSharedUntilChanged)
+{
+    typedef SnapshotPages<unsigned long long, 64 * 1024 * 4> Pages;
+    const unsigned int capacity = 64 * 1024 * 4;
+    std::vector<unsigned long long> records(capacity, 0);
+    unsigned long long changedPages[Pages::numberOfPages / 64] = {};
+    for (unsigned int i = 0; i < capacity; i += 3)
+    {
+        records[i] = i + 1;
+    }
+
+    Pages first;
+    first.update(nullptr, records.data(), changedPages);
+    for (unsigned int i = 0; i < capacity; i++)
+    {
+        EXPECT_EQ(first[i], records[i]);
+    }
+
+    // change a record in page 5 and clear pages 7 and 8
+    records[5 * Pages::recordsPerPage + 10] = 12345;
+    setMem(&records[7 * Pages::recordsPerPage], 2 * Pages::recordsPerPage * sizeof(records[0]), 0);
+    changedPages[0] = (1ULL << 5) | (1ULL << 7) | (1ULL << 8);
+
+    Pages second;
+    second.update(&first, records.data(), changedPages);
+    for (unsigned int i = 0; i < capacity; i++)
+    {
+        EXPECT_EQ(second[i], records[i]);
+        const unsigned int page = i / Pages::recordsPerPage;
+        if (page == 5 || page == 7 || page == 8)
+        {
+            EXPECT_NE(&second[i], &first[i]);
+        }
+        else
+        {
+            EXPECT_EQ(&second[i], &first[i]);
+        }
+    }
+
+    // the first snapshot is unchanged
+    EXPECT_EQ(first[5 * Pages::recordsPerPage + 10], 5ull * Pages::recordsPerPage + 11);
+    EXPECT_EQ(first[7 * Pages::recordsPerPage + 2], 7ull * Pages::recordsPerPage + 3);
+
+    // zero pages share one copy
+    EXPECT_EQ(&second[7 * Pages::recordsPerPage], &second[8 * Pages::recordsPerPage]);
+}
+
+// Same layout as AssetStorage::IndexLists
+struct AssetIndexLists
+{
+    unsigned int issuancesFirstIdx;
+    unsigned int ownershipsPossessionsFirstIdx[ASSETS_CAPACITY];
+    unsigned int ownershipsPossessionsCount[ASSETS_CAPACITY];
+    unsigned int nextIdx[ASSETS_CAPACITY];
+};
+
+TEST(TestStateSnapshot, PublishCopiesChangedRecords)
+{
+    EntityRecord* spectrum = (EntityRecord*)calloc(SPECTRUM_CAPACITY, sizeof(EntityRecord));
+    AssetRecord* assets = (AssetRecord*)calloc(ASSETS_CAPACITY, sizeof(AssetRecord));
+    unsigned long long* assetChangeFlags = (unsigned long long*)calloc(ASSETS_CAPACITY / 64, sizeof(unsigned long long));
+    ASSERT_NE(spectrum, nullptr);
+    ASSERT_NE(assets, nullptr);
+    AssetIndexLists* assetIndexLists = (AssetIndexLists*)calloc(1, sizeof(AssetIndexLists));
+    ASSERT_NE(assetChangeFlags, nullptr);
+    ASSERT_NE(assetIndexLists, nullptr);
+
+    StateSnapshots snapshots;
+    snapshots.publish(100, 1000, spectrum, assets, assetChangeFlags, *assetIndexLists);
+    EXPECT_EQ(snapshots.get(), nullptr);
+
+    snapshots.enable();
+    m256i publicKey(1, 2, 3, 4);
+    const unsigned int index = publicKey.m256i_u32[0] & (SPECTRUM_CAPACITY - 1);
+    spectrum[index].publicKey = publicKey;
+    spectrum[index].incomingAmount = 500;
+    assets[77].varStruct.issuance.type = ISSUANCE;
+    snapshots.publish(100, 1001, spectrum, assets, assetChangeFlags, *assetIndexLists);
+
+    std::shared_ptr<const StateSnapshot> first = snapshots.get();
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first->epoch, 100);
+    EXPECT_EQ(first->tick, 1001u);
+    EXPECT_EQ(first->spectrumIndex(publicKey), (int)index);
+    EXPECT_EQ(first->spectrumIndex(m256i(5, 6, 7, 8)), -1);
+    EXPECT_EQ(first->entities[index].incomingAmount, 500);
+    EXPECT_EQ(first->universe[77].varStruct.issuance.type, ISSUANCE);
+
+    // a change is only visible in the next snapshot after it has been recorded
+    spectrum[index].outgoingAmount = 200;
+    snapshots.markEntityChanged(index);
+    assets[ASSETS_CAPACITY - 1].varStruct.issuance.type = ISSUANCE;
+    assetChangeFlags[(ASSETS_CAPACITY - 1) >> 6] |= (1ULL << ((ASSETS_CAPACITY - 1) & 63));
+    assetIndexLists->issuancesFirstIdx = ASSETS_CAPACITY - 1;
+    assetIndexLists->nextIdx[ASSETS_CAPACITY - 1] = 77;
+    assetIndexLists->ownershipsPossessionsCount[77] = 3;
+    snapshots.markAssetListsChanged(ASSETS_CAPACITY - 1);
+    snapshots.markAssetListsChanged(77);
+    snapshots.publish(100, 1002, spectrum, assets, assetChangeFlags, *assetIndexLists);
+
+    std::shared_ptr<const StateSnapshot> second = snapshots.get();
+    EXPECT_EQ(second->tick, 1002u);
+    EXPECT_EQ(second->entities[index].outgoingAmount, 200);
+    EXPECT_EQ(second->universe[ASSETS_CAPACITY - 1].varStruct.issuance.type, ISSUANCE);
+    EXPECT_EQ(first->entities[index].outgoingAmount, 0);
+    EXPECT_EQ(first->universe[ASSETS_CAPACITY - 1].varStruct.issuance.type, 0);
+    EXPECT_EQ(&second->universe[77], &first->universe[77]);
+    EXPECT_EQ(second->issuancesFirstIdx, ASSETS_CAPACITY - 1);
+    EXPECT_EQ(second->nextIdx[ASSETS_CAPACITY - 1], 77u);
+    EXPECT_EQ(second->ownershipsPossessionsCount[77], 3u);
+    EXPECT_EQ(first->nextIdx[ASSETS_CAPACITY - 1], 0u);
+    EXPECT_EQ(first->ownershipsPossessionsCount[77], 0u);
+
+    first.reset();
+    second.reset();
+    free(assetIndexLists);
+    free(assetChangeFlags);
+    free(assets);
+    free(spectrum);
+}
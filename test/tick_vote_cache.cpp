@@ -0,0 +1,77 @@
+#define NO_UEFI
+
+#include "gtest/gtest.h"
+
+#include "../src/ticking/tick_vote_cache.h"
+
+static TickVoteCache tickVoteCache;
+
+static void makeSignature(unsigned char* signature, unsigned char seed)
+{
+    for (int i = 0; i < SIGNATURE_SIZE; i++)
+    {
+        signature[i] = (unsigned char)(seed + i);
+    }
+}
+
+TEST(TestTickVoteCache, RemembersVerifiedVotes)
+{
+    tickVoteCache.init();
+
+    const m256i digest(1, 2, 3, 4);
+    const m256i otherDigest(5, 6, 7, 8);
+    unsigned char signature[SIGNATURE_SIZE], otherSignature[SIGNATURE_SIZE];
+    makeSignature(signature, 1);
+    makeSignature(otherSignature, 2);
+
+    EXPECT_FALSE(tickVoteCache.isVerified(7, 1000, digest, signature));
+    tickVoteCache.addVerified(7, 1000, digest, signature);
+    EXPECT_TRUE(tickVoteCache.isVerified(7, 1000, digest, signature));
+
+    // Any difference in computor, tick, digest, or signature is not a copy of the verified vote
+    EXPECT_FALSE(tickVoteCache.isVerified(8, 1000, digest, signature));
+    EXPECT_FALSE(tickVoteCache.isVerified(7, 1001, digest, signature));
+    EXPECT_FALSE(tickVoteCache.isVerified(7, 1000, otherDigest, signature));
+    EXPECT_FALSE(tickVoteCache.isVerified(7, 1000, digest, otherSignature));
+
+    // Votes of following ticks are kept in other slots until the slot is reused
+    tickVoteCache.addVerified(7, 1001, otherDigest, otherSignature);
+    EXPECT_TRUE(tickVoteCache.isVerified(7, 1000, digest, signature));
+    EXPECT_TRUE(tickVoteCache.isVerified(7, 1001, otherDigest, otherSignature));
+    tickVoteCache.addVerified(7, 1000 + TickVoteCache::tickSlots, otherDigest, otherSignature);
+    EXPECT_FALSE(tickVoteCache.isVerified(7, 1000, digest, signature));
+}
+
+TEST(TestTickVoteCache, CountsVotesPerTick)
+{
+    tickVoteCache.init();
+
+    long long verified, deduplicated, rejected;
+    tickVoteCache.getCounters(2000, verified, deduplicated, rejected);
+    EXPECT_EQ(verified, 0);
+    EXPECT_EQ(deduplicated, 0);
+    EXPECT_EQ(rejected, 0);
+
+    tickVoteCache.countVerified(2000);
+    tickVoteCache.countVerified(2000);
+    tickVoteCache.countDeduplicated(2000);
+    tickVoteCache.countRejected(2001);
+
+    tickVoteCache.getCounters(2000, verified, deduplicated, rejected);
+    EXPECT_EQ(verified, 2);
+    EXPECT_EQ(deduplicated, 1);
+    EXPECT_EQ(rejected, 0);
+    tickVoteCache.getCounters(2001, verified, deduplicated, rejected);
+    EXPECT_EQ(verified, 0);
+    EXPECT_EQ(deduplicated, 0);
+    EXPECT_EQ(rejected, 1);
+
+    // A newer tick takes over the slot, late votes of the older tick are not counted anymore
+    tickVoteCache.countVerified(2000 + TickVoteCache::tickSlots);
+    tickVoteCache.countVerified(2000);
+    tickVoteCache.getCounters(2000 + TickVoteCache::tickSlots, verified, deduplicated, rejected);
+    EXPECT_EQ(verified, 1);
+    EXPECT_EQ(deduplicated, 0);
+    tickVoteCache.getCounters(2000, verified, deduplicated, rejected);
+    EXPECT_EQ(verified, 0);
+}
@@ -5,8 +5,12 @@
 #include "../src/public_settings.h"
 #include "../src/platform/virtual_memory.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <random>
+#include <thread>
+#include <vector>
 
 #include "network_messages/transactions.h"
 
@@ -242,6 +246,115 @@ TEST(TestVirtualMemory, TestVirtualMemory_SpecialCases) {
 }
 
 
+// exposes whether a page is in the cache
+template <typename T, unsigned long long prefixName, unsigned long long pageDirectory, unsigned long long pageCapacity, unsigned long long numCachePage>
+class CacheInspectingVirtualMemory : public VirtualMemory<T, prefixName, pageDirectory, pageCapacity, numCachePage>
+{
+public:
+    bool isCached(unsigned long long pageId)
+    {
+        return this->lookUpCachePage(pageId) != -1;
+    }
+};
+
+TEST(TestVirtualMemory, TestVirtualMemory_ScanKeepsHotPages) {
+    initFilesystem();
+    registerAsynFileIO(NULL);
+    const unsigned long long name_u64 = 987654321;
+    const unsigned long long pageDir = 0;
+    const unsigned long long pageCap = 64;
+    CacheInspectingVirtualMemory<unsigned long long, name_u64, pageDir, pageCap, 8> test_vm;
+    test_vm.init();
+    for (unsigned long long i = 0; i < pageCap * 64; i++)
+    {
+        test_vm.append(i);
+    }
+
+    // read pages 10, 11, 60 and 61 again and again
+    const unsigned long long hotPages[] = { 10, 60, 11, 61 };
+    for (int round = 0; round < 3; round++)
+    {
+        for (unsigned long long page : hotPages)
+        {
+            EXPECT_EQ(test_vm.get(page * pageCap + round), page * pageCap + round);
+        }
+    }
+    for (unsigned long long page : hotPages)
+    {
+        EXPECT_TRUE(test_vm.isCached(page));
+    }
+
+    // reading pages 0..50 once sequentially must not evict the hot pages
+    for (unsigned long long i = 0; i < pageCap * 51; i++)
+    {
+        if (i / pageCap != 10 && i / pageCap != 11)
+        {
+            EXPECT_EQ(test_vm.get(i), i);
+        }
+    }
+    for (unsigned long long page : hotPages)
+    {
+        EXPECT_TRUE(test_vm.isCached(page));
+        EXPECT_EQ(test_vm.get(page * pageCap + 7), page * pageCap + 7);
+    }
+    test_vm.deinit();
+}
+
+TEST(TestVirtualMemory, TestVirtualMemory_ConcurrentReadersAndWriter) {
+    initFilesystem();
+    registerAsynFileIO(NULL);
+    const unsigned long long name_u64 = 192837465;
+    const unsigned long long pageDir = 0;
+    const unsigned long long pageCap = 64;
+    VirtualMemory<unsigned long long, name_u64, pageDir, pageCap, 8> test_vm;
+    test_vm.init();
+
+    // item i has value i, readers check items while the writer appends and the pages are moved through the cache
+    std::atomic<bool> stop = false;
+    std::atomic<unsigned long long> numberOfChecks = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; i++)
+    {
+        readers.emplace_back([&, i]()
+            {
+                std::mt19937_64 gen64(i);
+                unsigned long long items[100];
+                while (!stop)
+                {
+                    const unsigned long long size = test_vm.size();
+                    if (size < 100)
+                    {
+                        continue;
+                    }
+                    // mostly the latest pages, which are more than the cache can hold
+                    const unsigned long long range = std::min(size - 99, pageCap * 16);
+                    const unsigned long long index = size - 1 - gen64() % range;
+                    EXPECT_EQ(test_vm.get(index), index);
+                    const unsigned long long offset = size - 100 - gen64() % range;
+                    EXPECT_EQ(test_vm.getMany(items, offset, 100), sizeof(items));
+                    for (unsigned long long j = 0; j < 100; j++)
+                    {
+                        EXPECT_EQ(items[j], offset + j);
+                    }
+                    numberOfChecks++;
+                }
+            });
+    }
+
+    for (unsigned long long i = 0; i < pageCap * 128; i++)
+    {
+        test_vm.append(i);
+    }
+    stop = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    EXPECT_GT(numberOfChecks, 0ull);
+    test_vm.deinit();
+}
+
 TEST(TestSwapVirtualMemory, TestSwapVirtualMemory_IndexModeRandomAccess) {
     initFilesystem();
     registerAsynFileIO(NULL);
@@ -452,4 +565,142 @@ TEST(TestSwapVirtualMemory, TestSwapVirtualMemory_TestCacheBuffer)
             EXPECT_TRUE((uint64_t)tx == (uint64_t)test_vm.getCacheBuffer(0) + i * test_vm.getPageSize());
         }
     }
-}
\ No newline at end of file
+}
+
+TEST(TestSwapVirtualMemory, TestSwapVirtualMemory_BackgroundIO)
+{
+    initFilesystem();
+    registerAsynFileIO(NULL);
+
+    struct TxHashMapEntry {
+        m256i digest;
+        unsigned long long offset;
+    };
+    constexpr unsigned long long pageCapacity = 64;
+    constexpr unsigned long long numberOfPages = 256;
+    SwapVirtualMemory<TxHashMapEntry, wcharToNumber(L"bgio"), wcharToNumber(L"data"), pageCapacity, 16, INDEX_MODE, 0> test_vm;
+    test_vm.init();
+    test_vm.reset();
+
+    // pages written back in the background must not lose later writes
+    unsigned long long numberOfAccesses = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned long long i = 0; i < pageCapacity * numberOfPages; i++)
+        {
+            TxHashMapEntry& entry = test_vm.getRef(i);
+            entry.digest = m256i::zero();
+            entry.digest.m256i_u64[0] = i;
+            entry.offset = i + pass;
+            numberOfAccesses++;
+        }
+    }
+    test_vm.waitForBackgroundIO();
+    SwapStats stats = test_vm.getStats();
+    EXPECT_EQ(stats.hits + stats.misses, numberOfAccesses);
+    EXPECT_GT(stats.writtenBehindPages, 0ull);
+
+    // sequential reading is served from pages loaded ahead
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned long long i = 0; i < pageCapacity * numberOfPages; i++)
+        {
+            TxHashMapEntry& entry = test_vm.getRef(i);
+            EXPECT_EQ(entry.digest.m256i_u64[0], i);
+            EXPECT_EQ(entry.offset, i + 1);
+            numberOfAccesses++;
+        }
+    }
+    test_vm.waitForBackgroundIO();
+    stats = test_vm.getStats();
+    EXPECT_EQ(stats.hits + stats.misses, numberOfAccesses);
+    EXPECT_GT(stats.readAheadPages, 0ull);
+    EXPECT_GT(stats.readAheadHits, 0ull);
+    EXPECT_LE(stats.readAheadHits, stats.readAheadPages);
+}
+
+#ifdef __linux__
+TEST(TestMappedSwapVirtualMemory, IndexModeKeepsDataAndPointers)
+{
+    initFilesystem();
+    registerAsynFileIO(NULL);
+
+    struct TxHashMapEntry {
+        m256i digest;
+        unsigned long long offset;
+    };
+    constexpr unsigned long long capacity = 1024 * 128 * 64;
+    MappedSwapVirtualMemory<TxHashMapEntry, wcharToNumber(L"mtxd"), wcharToNumber(L"data"), capacity, INDEX_MODE, 0> test_vm;
+    EXPECT_TRUE(test_vm.init());
+    test_vm.reset();
+
+    TxHashMapEntry* first = test_vm.getPtr(1);
+    first->offset = 1;
+    std::map<unsigned long long, unsigned long long> valueMap;
+    for (int i = 0; i < 10000; i++) {
+        auto randomIndex = rand64() % capacity;
+        TxHashMapEntry& entry = test_vm.getRef(randomIndex);
+        entry.offset = randomIndex * 3;
+        valueMap[randomIndex] = randomIndex * 3;
+    }
+    valueMap[1] = test_vm.getRef(1).offset;
+    EXPECT_EQ(test_vm.getPtr(1), first);
+    for (auto& it : valueMap) {
+        EXPECT_EQ(test_vm[it.first]->offset, it.second);
+    }
+
+    // Data survives a restart if the state is restored
+    std::vector<unsigned char> state(test_vm.getVmStateSize());
+    EXPECT_EQ(test_vm.dumpVMState(state.data()), state.size());
+    test_vm.deinit();
+    EXPECT_TRUE(test_vm.init());
+    EXPECT_EQ(test_vm.loadVMState(state.data()), state.size());
+    for (auto& it : valueMap) {
+        EXPECT_EQ(test_vm(it.first).offset, it.second);
+    }
+
+    // ... and is cleared otherwise
+    test_vm.deinit();
+    EXPECT_TRUE(test_vm.init());
+    for (auto& it : valueMap) {
+        EXPECT_EQ(test_vm(it.first).offset, 0ull);
+    }
+    test_vm.reset();
+    test_vm.deinit();
+}
+
+TEST(TestMappedSwapVirtualMemory, OffsetModeKeepsElementsContiguous)
+{
+    initFilesystem();
+    registerAsynFileIO(NULL);
+
+    constexpr unsigned long long maxElementSize = (sizeof(Transaction) + SIGNATURE_SIZE + MAX_INPUT_SIZE);
+    constexpr unsigned long long capacity = maxElementSize * 16;
+    MappedSwapVirtualMemory<Transaction, wcharToNumber(L"moff"), wcharToNumber(L"data"), capacity, OFFSET_MODE, SIGNATURE_SIZE + MAX_INPUT_SIZE> test_vm;
+    EXPECT_TRUE(test_vm.init());
+    test_vm.reset();
+
+    // Elements at any offset up to the capacity can be written completely
+    const unsigned long long offsets[] = { 0, maxElementSize * 2 - 8, capacity - 1 };
+    for (unsigned long long offset : offsets) {
+        Transaction* tx = test_vm[offset];
+        tx->amount = offset;
+        tx->inputSize = MAX_INPUT_SIZE;
+        unsigned char* input = (unsigned char*)(tx + 1);
+        for (int i = 0; i < MAX_INPUT_SIZE + SIGNATURE_SIZE; i++) {
+            input[i] = (unsigned char)(offset + i);
+        }
+    }
+    for (unsigned long long offset : offsets) {
+        const Transaction* tx = test_vm[offset];
+        EXPECT_EQ(tx->amount, (long long)offset);
+        EXPECT_EQ(tx->inputSize, MAX_INPUT_SIZE);
+        const unsigned char* input = (const unsigned char*)(tx + 1);
+        for (int i = 0; i < MAX_INPUT_SIZE + SIGNATURE_SIZE; i++) {
+            EXPECT_EQ(input[i], (unsigned char)(offset + i));
+        }
+    }
+    test_vm.reset();
+    test_vm.deinit();
+}
+#endif